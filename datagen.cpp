@@ -0,0 +1,571 @@
+// Synthetic data generator for the Diet Manager data files.
+//
+// Produces food_db.json, daily_food_log.json and user_profile.json in exactly
+// the schema foods.cpp reads and writes, at whatever size a benchmark or load
+// test needs. Output depends only on the command line and the toolchain: the
+// same seed yields byte-identical files wherever the same compiler and C math
+// library are used, because the generator uses its own PRNG and distributions
+// instead of the implementation-defined std::*_distribution classes. The
+// distributions go through pow/log/exp/cos, whose last bits may differ
+// between libm versions, so other platforms can draw slightly different values.
+//
+// Build:  g++ -std=c++17 -O2 datagen.cpp -o datagen
+// Usage:  ./datagen --basic 5000 --composites 2000 --users 10 --years 3 --seed 7 --out gen
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstdint>
+#include <sys/stat.h>
+
+using json = nlohmann::json;
+using namespace std;
+
+// SplitMix64: tiny, fast and fully specified, so runs are reproducible
+class Rng
+{
+private:
+    uint64_t state;
+
+public:
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform double in [0, 1)
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform integer in [lo, hi]
+    int range(int lo, int hi)
+    {
+        return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+    // Standard normal via Box-Muller
+    double normal()
+    {
+        double u1 = uniform();
+        double u2 = uniform();
+        if (u1 < 1e-300)
+            u1 = 1e-300;
+        return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+    }
+};
+
+// Zipf sampler over ranks [0, n): a handful of keywords and foods are very
+// common and there is a long tail, which is what real catalogs and diaries look like
+class ZipfSampler
+{
+private:
+    vector<double> cdf;
+
+public:
+    ZipfSampler(size_t n, double exponent)
+    {
+        cdf.resize(n);
+        double sum = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += 1.0 / pow(static_cast<double>(i + 1), exponent);
+            cdf[i] = sum;
+        }
+        for (auto &value : cdf)
+        {
+            value /= sum;
+        }
+    }
+
+    size_t sample(Rng &rng) const
+    {
+        double u = rng.uniform();
+        size_t index = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        return min(index, cdf.size() - 1);
+    }
+};
+
+struct GeneratorOptions
+{
+    int basicCount = 200;
+    int compositeCount = 50;
+    int maxDepth = 3;
+    int keywordVocabulary = 120;
+    int users = 1;
+    int years = 1;
+    double entriesPerDay = 4.0;
+    string startDate = "2024-01-01";
+    uint64_t seed = 1;
+    string outDir = ".";
+    bool compact = false;
+};
+
+struct GeneratedFood
+{
+    string name;
+    bool composite;
+    int depth;
+    int calories;
+    json details;
+};
+
+// ---- Date helpers (proleptic Gregorian, no time zones involved) ----
+
+long daysFromCivil(int y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const long era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long>(doe) - 719468;
+}
+
+string civilFromDays(long z)
+{
+    z += 719468;
+    const long era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const long y = static_cast<long>(yoe) + era * 400;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp + (mp < 10 ? 3 : -9);
+
+    stringstream ss;
+    ss << (y + (m <= 2)) << '-'
+       << setw(2) << setfill('0') << m << '-'
+       << setw(2) << setfill('0') << d;
+    return ss.str();
+}
+
+long parseDate(const string &date)
+{
+    int y = 0, m = 0, d = 0;
+    char dash1 = 0, dash2 = 0;
+    stringstream ss(date);
+    ss >> y >> dash1 >> m >> dash2 >> d;
+    if (!ss || dash1 != '-' || dash2 != '-' || m < 1 || m > 12 || d < 1 || d > 31)
+    {
+        cerr << "Invalid date '" << date << "', expected YYYY-MM-DD\n";
+        exit(1);
+    }
+    return daysFromCivil(y, m, d);
+}
+
+// ---- Catalog generation ----
+
+vector<string> buildKeywordVocabulary(int size)
+{
+    // The first entries are the real keywords already used in food_db.json, so
+    // the head of the Zipf distribution looks like the bundled catalog
+    vector<string> vocabulary = {
+        "fruit", "sweet", "dairy", "beverage", "bread", "cheese", "vegetable",
+        "protein", "snack", "breakfast", "meat", "grain", "spicy", "salty",
+        "dryfruits", "milk", "shake", "sandwich", "dessert", "soup"};
+    static const char *syllables[] = {"ka", "lo", "mi", "ra", "tu", "ve", "no", "si", "pa", "de", "zo", "gu"};
+
+    for (int i = 0; static_cast<int>(vocabulary.size()) < size; i++)
+    {
+        string word;
+        int n = i;
+        do
+        {
+            word += syllables[n % 12];
+            n /= 12;
+        } while (n > 0);
+        vocabulary.push_back(word + "food");
+    }
+    vocabulary.resize(size);
+    return vocabulary;
+}
+
+string makeFoodName(int index, bool composite)
+{
+    static const char *adjectives[] = {"fresh", "roasted", "spiced", "sweet", "smoked", "baked", "green", "golden",
+                                       "crispy", "creamy", "wild", "pickled", "toasted", "steamed", "raw", "salted"};
+    static const char *basics[] = {"apple", "rice", "lentil", "oat", "almond", "yogurt", "paneer", "tomato",
+                                   "carrot", "chicken", "egg", "mango", "potato", "spinach", "wheat", "cashew"};
+    static const char *dishes[] = {"curry", "salad", "shake", "sandwich", "bowl", "wrap", "stew", "pie",
+                                   "smoothie", "pulao", "soup", "toast", "porridge", "tikka", "roll", "bake"};
+
+    const int a = index % 16;
+    const int b = (index / 16) % 16;
+    const int serial = index / 256;
+
+    string name = string(adjectives[a]) + " " + basics[b];
+    if (composite)
+    {
+        name += " " + string(dishes[(index / 7) % 16]);
+    }
+    if (serial > 0)
+    {
+        name += " " + to_string(serial);
+    }
+    return name;
+}
+
+json makeKeywords(Rng &rng, const ZipfSampler &zipf, const vector<string> &vocabulary)
+{
+    int count = rng.range(1, 4);
+    set<string> chosen;
+    for (int i = 0; i < count * 3 && static_cast<int>(chosen.size()) < count; i++)
+    {
+        chosen.insert(vocabulary[zipf.sample(rng)]);
+    }
+    return json(vector<string>(chosen.begin(), chosen.end()));
+}
+
+vector<GeneratedFood> generateCatalog(const GeneratorOptions &options, Rng &rng)
+{
+    vector<string> vocabulary = buildKeywordVocabulary(options.keywordVocabulary);
+    ZipfSampler keywordZipf(vocabulary.size(), 1.1);
+
+    vector<GeneratedFood> foods;
+    foods.reserve(options.basicCount + options.compositeCount);
+
+    for (int i = 0; i < options.basicCount; i++)
+    {
+        GeneratedFood food;
+        food.name = makeFoodName(i, false);
+        food.composite = false;
+        food.depth = 0;
+        // Log-normal around ~120 kcal per serving, clamped to a sane range
+        food.calories = max(5, min(900, static_cast<int>(exp(4.8 + 0.7 * rng.normal()))));
+        food.details = {
+            {"keywords", makeKeywords(rng, keywordZipf, vocabulary)},
+            {"calories", food.calories}};
+        foods.push_back(move(food));
+    }
+
+    // Composites are built in layers: a composite of depth d uses at least one
+    // ingredient of depth d - 1, so the catalog contains nesting up to maxDepth
+    vector<vector<int>> byDepth(options.maxDepth + 1);
+    for (int i = 0; i < options.basicCount; i++)
+    {
+        byDepth[0].push_back(i);
+    }
+
+    for (int i = 0; i < options.compositeCount && options.basicCount > 0; i++)
+    {
+        int depth = 1 + static_cast<int>(rng.next() % options.maxDepth);
+        while (byDepth[depth - 1].empty())
+        {
+            depth--;
+        }
+
+        int ingredientCount = rng.range(2, 5);
+        json ingredients = json::object();
+        int totalCalories = 0;
+
+        for (int k = 0; k < ingredientCount; k++)
+        {
+            int sourceDepth = k == 0 ? depth - 1 : rng.range(0, depth - 1);
+            if (byDepth[sourceDepth].empty())
+            {
+                sourceDepth = 0;
+            }
+            const vector<int> &pool = byDepth[sourceDepth];
+            const GeneratedFood &ingredient = foods[pool[rng.next() % pool.size()]];
+            if (ingredients.contains(ingredient.name))
+            {
+                continue;
+            }
+            // Nested composites are already meal-sized, so they are used once
+            int servings = ingredient.composite ? 1 : rng.range(1, 3);
+            ingredients[ingredient.name] = servings;
+            totalCalories += ingredient.calories * servings;
+        }
+
+        GeneratedFood food;
+        food.name = makeFoodName(i, true);
+        food.composite = true;
+        food.depth = depth;
+        food.calories = totalCalories;
+        food.details = {
+            {"keywords", makeKeywords(rng, keywordZipf, vocabulary)},
+            {"ingredients", ingredients},
+            {"calories", totalCalories}};
+
+        byDepth[depth].push_back(static_cast<int>(foods.size()));
+        foods.push_back(move(food));
+    }
+
+    return foods;
+}
+
+// ---- Output ----
+
+// Writes one top-level member the way json::dump(4) would nest it
+void writeMember(ostream &out, const string &key, const json &value, bool compact, bool first)
+{
+    if (compact)
+    {
+        out << (first ? "" : ",") << json(key).dump() << ":" << value.dump();
+        return;
+    }
+
+    string body = value.dump(4);
+    string indented;
+    indented.reserve(body.size() + body.size() / 8);
+    for (char c : body)
+    {
+        indented += c;
+        if (c == '\n')
+            indented += "    ";
+    }
+    out << (first ? "\n" : ",\n") << "    " << json(key).dump() << ": " << indented;
+}
+
+bool writeCatalog(const string &path, const vector<GeneratedFood> &foods, bool compact)
+{
+    json db;
+    db["basic"] = json::object();
+    db["composite"] = json::object();
+    for (const auto &food : foods)
+    {
+        db[food.composite ? "composite" : "basic"][food.name] = food.details;
+    }
+
+    ofstream file(path);
+    if (!file.is_open())
+    {
+        cerr << "Cannot write " << path << "\n";
+        return false;
+    }
+    file << (compact ? db.dump() : db.dump(4));
+    return true;
+}
+
+// Streams the log one date at a time so multi-year histories never live in memory at once
+bool writeUserHistory(const string &dir, int user, const GeneratorOptions &options,
+                      const vector<GeneratedFood> &foods, uint64_t seed)
+{
+    Rng rng(seed);
+    long startDay = parseDate(options.startDate);
+    long dayCount = static_cast<long>(options.years) * 365;
+
+    // Each user has a personal ranking of favourite foods
+    vector<int> favourites(foods.size());
+    for (size_t i = 0; i < favourites.size(); i++)
+    {
+        favourites[i] = static_cast<int>(i);
+    }
+    for (size_t i = favourites.size(); i > 1; i--)
+    {
+        swap(favourites[i - 1], favourites[rng.next() % i]);
+    }
+    ZipfSampler foodZipf(foods.size(), 1.05);
+
+    ofstream logFile(dir + "/daily_food_log.json");
+    if (!logFile.is_open())
+    {
+        cerr << "Cannot write " << dir << "/daily_food_log.json\n";
+        return false;
+    }
+
+    logFile << "{";
+    bool first = true;
+    uint64_t entryCounter = 0;
+    for (long day = 0; day < dayCount; day++)
+    {
+        // Roughly Poisson around the configured mean, some days are skipped
+        int entries = max(0, static_cast<int>(lround(options.entriesPerDay + sqrt(options.entriesPerDay) * rng.normal())));
+        if (entries == 0)
+        {
+            continue;
+        }
+
+        json dayLog = json::array();
+        for (int e = 0; e < entries; e++)
+        {
+            const GeneratedFood &food = foods[favourites[foodZipf.sample(rng)]];
+            long epoch = (startDay + day) * 86400L + 7 * 3600 + e * 3 * 3600;
+            dayLog.push_back({
+                {"name", food.name},
+                {"servings", rng.range(1, 3)},
+                {"details", food.details},
+                {"id", to_string(epoch) + "_" + to_string(user * 1000003ULL + entryCounter++)}});
+        }
+        writeMember(logFile, civilFromDays(startDay + day), dayLog, options.compact, first);
+        first = false;
+    }
+    logFile << (options.compact || first ? "}" : "\n}");
+
+    // Profile with a slowly drifting weight and a new record roughly every week
+    json profile;
+    profile["gender"] = rng.range(0, 1) ? "M" : "F";
+    profile["height"] = rng.range(150, 195);
+    profile["dailyData"] = json::object();
+    int age = rng.range(18, 65);
+    double weight = rng.range(50, 100);
+    static const char *levels[] = {"sedentary", "light", "moderate", "active", "very active"};
+    string activityLevel = levels[rng.range(0, 4)];
+    for (long day = 0; day < dayCount; day += rng.range(5, 9))
+    {
+        weight = max(40.0, min(160.0, weight + 0.4 * rng.normal()));
+        if (rng.uniform() < 0.05)
+        {
+            activityLevel = levels[rng.range(0, 4)];
+        }
+        profile["dailyData"][civilFromDays(startDay + day)] = {
+            {"age", age + static_cast<int>(day / 365)},
+            {"weight", static_cast<int>(lround(weight))},
+            {"activityLevel", activityLevel}};
+    }
+
+    ofstream profileFile(dir + "/user_profile.json");
+    if (!profileFile.is_open())
+    {
+        cerr << "Cannot write " << dir << "/user_profile.json\n";
+        return false;
+    }
+    profileFile << (options.compact ? profile.dump() : profile.dump(4));
+    return true;
+}
+
+// A whole-number option value of at least minimum; anything else ends the program
+int countValue(const string &option, const string &text, int minimum)
+{
+    size_t used = 0;
+    int count = 0;
+    try
+    {
+        count = stoi(text, &used);
+    }
+    catch (const exception &)
+    {
+        used = 0;
+    }
+    if (used == 0 || used != text.size() || count < minimum)
+    {
+        cerr << "Invalid value for " << option << ": " << text << " (expected a whole number of at least " << minimum << ")\n";
+        exit(1);
+    }
+    return count;
+}
+
+void printUsage()
+{
+    cout << "Usage: datagen [options]\n"
+         << "  --basic N          number of basic foods (default 200)\n"
+         << "  --composites N     number of composite foods (default 50)\n"
+         << "  --depth D          maximum composite nesting depth (default 3)\n"
+         << "  --keywords N       keyword vocabulary size (default 120)\n"
+         << "  --users N          number of user histories (default 1)\n"
+         << "  --years M          years of history per user (default 1)\n"
+         << "  --per-day X        mean log entries per day (default 4)\n"
+         << "  --start YYYY-MM-DD first logged date (default 2024-01-01)\n"
+         << "  --seed S           PRNG seed (default 1)\n"
+         << "  --out DIR          output directory (default .)\n"
+         << "  --compact          write minified JSON instead of indent 4\n";
+}
+
+int main(int argc, char *argv[])
+{
+    GeneratorOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        auto value = [&]() -> string {
+            if (i + 1 >= argc)
+            {
+                cerr << "Missing value for " << arg << "\n";
+                exit(1);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--basic")
+            options.basicCount = countValue(arg, value(), 1);
+        else if (arg == "--composites")
+            options.compositeCount = countValue(arg, value(), 1);
+        else if (arg == "--depth")
+            options.maxDepth = countValue(arg, value(), 1);
+        else if (arg == "--keywords")
+            options.keywordVocabulary = countValue(arg, value(), 1);
+        else if (arg == "--users")
+            options.users = countValue(arg, value(), 0);
+        else if (arg == "--years")
+            options.years = countValue(arg, value(), 0);
+        else if (arg == "--per-day")
+            options.entriesPerDay = max(0.0, stod(value()));
+        else if (arg == "--start")
+            options.startDate = value();
+        else if (arg == "--seed")
+            options.seed = stoull(value());
+        else if (arg == "--out")
+            options.outDir = value();
+        else if (arg == "--compact")
+            options.compact = true;
+        else if (arg == "--help" || arg == "-h")
+        {
+            printUsage();
+            return 0;
+        }
+        else
+        {
+            cerr << "Unknown option: " << arg << "\n";
+            printUsage();
+            return 1;
+        }
+    }
+
+    parseDate(options.startDate);
+    mkdir(options.outDir.c_str(), 0755);
+
+    // Independent streams per stage, so changing --users does not change the catalog
+    Rng catalogRng(options.seed);
+    vector<GeneratedFood> foods = generateCatalog(options, catalogRng);
+    if (!writeCatalog(options.outDir + "/food_db.json", foods, options.compact))
+    {
+        return 1;
+    }
+    cout << "Wrote " << options.basicCount << " basic and " << foods.size() - options.basicCount
+         << " composite foods to " << options.outDir << "/food_db.json\n";
+
+    if (foods.empty())
+    {
+        return 0;
+    }
+
+    // A single user is written next to food_db.json so the directory can be used
+    // as-is; several users each get their own user_NNN directory
+    for (int user = 0; user < options.users; user++)
+    {
+        string dir = options.outDir;
+        if (options.users > 1)
+        {
+            stringstream ss;
+            ss << options.outDir << "/user_" << setw(3) << setfill('0') << user + 1;
+            dir = ss.str();
+            mkdir(dir.c_str(), 0755);
+        }
+
+        Rng userSeeder(options.seed ^ (0xA5A5A5A5ULL + static_cast<uint64_t>(user) * 0x9E3779B97F4A7C15ULL));
+        if (!writeUserHistory(dir, user, options, foods, userSeeder.next()))
+        {
+            return 1;
+        }
+    }
+
+    if (options.users > 0)
+    {
+        cout << "Wrote " << options.users << " user histories covering " << options.years << " year(s)\n";
+    }
+    return 0;
+}
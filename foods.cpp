@@ -1,10 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <nlohmann/json.hpp>
 #include <algorithm>
 #include <stack>
+#include <deque>
+#include <list>
 #include <set>
 #include <sstream>
 #include <iomanip>
@@ -12,1642 +15,11045 @@
 #include <functional>
 #include <memory>
 #include <regex> // Add this include for regex functionality
+#include <optional>
+#include <string_view>
+#include <cstring>
+#include <cmath>
+#include <charconv>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <memory_resource>
+#include <condition_variable>
+#include <future>
+#include <random>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 using namespace std;
 
-// Forward declarations
-class DietCalculator;
+// Operations timed by the built-in statistics (see PerfStats below)
+enum class PerfOp
+{
+    LoadDatabase,
+    SaveDatabase,
+    LoadLog,
+    SaveLog,
+    SearchFood,
+    AddCompositeFood,
+    IngredientLookup,
+    Undo,
+    Redo,
+    CalorieTarget,
+    DailyCalories,
+    BackgroundWrite,
+    ImportFoods,
+    FuzzyLookup,
+    PrefixLookup,
+    CalorieRange,
+    MealPlan,
+    Query,
+    SortFoods,
+    WhereUsed,
+    Count
+};
 
-class CommandManager
+// Monotonic counters and point-in-time sizes reported next to the latencies
+enum class PerfCounter
+{
+    DatabaseBytesWritten,
+    LogBytesWritten,
+    SavesCoalesced,
+    WritesSkipped,
+    SearchCacheHits,
+    SearchCacheMisses,
+    SearchCacheEvictions,
+    ExpansionCacheHits,
+    ExpansionCacheMisses,
+    ExpansionCacheDrops,
+    Count
+};
+
+enum class PerfGauge
+{
+    CatalogBasicFoods,
+    CatalogCompositeFoods,
+    LogDates,
+    LogEntries,
+    SearchCacheEntries,
+    ExpansionCacheEntries,
+    Count
+};
+
+// Puts a stream's format flags and precision back when the scope ends, so a
+// table printed in fixed point does not change how later numbers look
+class StreamFormatGuard
 {
 private:
-    stack<function<void()>> undoStack;
-    stack<function<void()>> redoStack;
+    ostream &out;
+    ios::fmtflags flags;
+    streamsize precision;
 
 public:
-    void executeCommand(function<void()> doCmd, function<void()> undoCmd)
+    explicit StreamFormatGuard(ostream &out) : out(out), flags(out.flags()), precision(out.precision()) {}
+
+    ~StreamFormatGuard()
     {
-        doCmd();
-        undoStack.push(undoCmd);
-        redoStack = stack<function<void()>>(); // Clear redo stack when a new command is executed
+        out.flags(flags);
+        out.precision(precision);
     }
+};
 
-    bool canUndo() const { return !undoStack.empty(); }
-    bool canRedo() const { return !redoStack.empty(); }
+#ifdef DIETMANAGER_STATS
 
-    void undo()
+// Heap allocation tallies fed by the replacement operator new below. The
+// per-thread count lets ScopedTimer charge allocations to an operation, the
+// process-wide totals are reported under "heap" in the statistics.
+struct AllocationCount
+{
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+};
+
+inline thread_local AllocationCount threadAllocations;
+inline atomic<uint64_t> processAllocations{0};
+inline atomic<uint64_t> processAllocatedBytes{0};
+
+// Every replacement below allocates and frees through these two. They stay
+// out of line so the compiler never pairs malloc or free with a
+// new-expression it can see, which -Wmismatched-new-delete would flag.
+[[gnu::noinline]] inline void *countedTryAllocate(size_t size, size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__) noexcept
+{
+    threadAllocations.calls++;
+    threadAllocations.bytes += size;
+    processAllocations.fetch_add(1, memory_order_relaxed);
+    processAllocatedBytes.fetch_add(size, memory_order_relaxed);
+    size = size ? size : 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
     {
-        if (canUndo())
+        return malloc(size);
+    }
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+[[gnu::noinline]] inline void countedRelease(void *block) noexcept
+{
+    free(block);
+}
+
+inline void *countedAllocate(size_t size, size_t alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+{
+    if (void *block = countedTryAllocate(size, alignment))
+    {
+        return block;
+    }
+    throw bad_alloc();
+}
+
+// The whole replaceable set, so no form of new escapes the count and every
+// form of delete matches the allocator behind it
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+void *operator new(size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void *operator new[](size_t size, align_val_t alignment) { return countedAllocate(size, static_cast<size_t>(alignment)); }
+void *operator new(size_t size, const nothrow_t &) noexcept { return countedTryAllocate(size); }
+void *operator new[](size_t size, const nothrow_t &) noexcept { return countedTryAllocate(size); }
+void *operator new(size_t size, align_val_t alignment, const nothrow_t &) noexcept
+{
+    return countedTryAllocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t &) noexcept
+{
+    return countedTryAllocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void *block) noexcept { countedRelease(block); }
+void operator delete[](void *block) noexcept { countedRelease(block); }
+void operator delete(void *block, size_t) noexcept { countedRelease(block); }
+void operator delete[](void *block, size_t) noexcept { countedRelease(block); }
+void operator delete(void *block, align_val_t) noexcept { countedRelease(block); }
+void operator delete[](void *block, align_val_t) noexcept { countedRelease(block); }
+void operator delete(void *block, size_t, align_val_t) noexcept { countedRelease(block); }
+void operator delete[](void *block, size_t, align_val_t) noexcept { countedRelease(block); }
+void operator delete(void *block, const nothrow_t &) noexcept { countedRelease(block); }
+void operator delete[](void *block, const nothrow_t &) noexcept { countedRelease(block); }
+void operator delete(void *block, align_val_t, const nothrow_t &) noexcept { countedRelease(block); }
+void operator delete[](void *block, align_val_t, const nothrow_t &) noexcept { countedRelease(block); }
+
+// HDR-style latency histogram: values below 16ns get their own bucket, larger
+// values use 16 linear sub-buckets per power of two (about 6% relative error).
+// Buckets are relaxed atomics, so recording is a handful of instructions and
+// safe from any thread.
+class LatencyHistogram
+{
+private:
+    static constexpr int SubBucketBits = 4;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+    atomic<uint64_t> buckets[BucketCount];
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> maxValue{0};
+
+    static int bucketIndex(uint64_t value)
+    {
+        if (value < SubBuckets)
         {
-            auto undoCmd = undoStack.top();
-            undoStack.pop();
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        int sub = static_cast<int>((value >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+        return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+    }
 
-            // Push the corresponding redo command onto the redo stack
-            redoStack.push(undoCmd);
-            undoCmd();
+    static uint64_t bucketUpperBound(int index)
+    {
+        if (index < SubBuckets)
+        {
+            return index;
         }
-        else
+        int exponent = index / SubBuckets + SubBucketBits - 1;
+        uint64_t sub = index % SubBuckets;
+        return ((SubBuckets + sub + 1) << (exponent - SubBucketBits)) - 1;
+    }
+
+public:
+    LatencyHistogram()
+    {
+        for (auto &bucket : buckets)
         {
-            cout << "Nothing to undo.\n";
+            bucket.store(0, memory_order_relaxed);
         }
     }
 
-    void redo()
+    void record(uint64_t nanos)
     {
-        if (canRedo())
+        buckets[bucketIndex(nanos)].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        total.fetch_add(nanos, memory_order_relaxed);
+        uint64_t seen = maxValue.load(memory_order_relaxed);
+        while (nanos > seen && !maxValue.compare_exchange_weak(seen, nanos, memory_order_relaxed))
         {
-            auto redoCmd = redoStack.top();
-            redoStack.pop();
+        }
+    }
 
-            // Push the corresponding undo command back onto the undo stack
-            undoStack.push(redoCmd);
-            redoCmd();
+    uint64_t getCount() const { return count.load(memory_order_relaxed); }
+
+    // Upper bound of the bucket containing the given percentile, in nanoseconds
+    uint64_t percentile(double p) const
+    {
+        uint64_t n = getCount();
+        if (n == 0)
+        {
+            return 0;
         }
-        else
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * n + 0.5);
+        rank = max<uint64_t>(1, min(rank, n));
+
+        uint64_t seen = 0;
+        for (int i = 0; i < BucketCount; i++)
         {
-            cout << "Nothing to redo.\n";
+            seen += buckets[i].load(memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return min(bucketUpperBound(i), maxValue.load(memory_order_relaxed));
+            }
         }
+        return maxValue.load(memory_order_relaxed);
     }
 
-    void clear()
+    json toJson() const
     {
-        undoStack = stack<function<void()>>();
-        redoStack = stack<function<void()>>();
+        uint64_t n = getCount();
+        return {
+            {"count", n},
+            {"total_us", total.load(memory_order_relaxed) / 1000.0},
+            {"mean_us", n ? total.load(memory_order_relaxed) / 1000.0 / n : 0.0},
+            {"p50_us", percentile(50) / 1000.0},
+            {"p90_us", percentile(90) / 1000.0},
+            {"p99_us", percentile(99) / 1000.0},
+            {"p999_us", percentile(99.9) / 1000.0},
+            {"max_us", maxValue.load(memory_order_relaxed) / 1000.0}};
     }
 };
 
-// Class to store user profile information
-class UserProfile
+// Process-wide statistics registry, compiled in with -DDIETMANAGER_STATS
+class PerfStats
 {
 private:
-    string profileFilename;
-    json profileData;
-    json dietGoals;
-    string currentDate;
-    shared_ptr<DietCalculator> calculator;
+    LatencyHistogram histograms[static_cast<int>(PerfOp::Count)];
+    atomic<uint64_t> allocations[static_cast<int>(PerfOp::Count)] = {};
+    atomic<uint64_t> counters[static_cast<int>(PerfCounter::Count)] = {};
+    atomic<int64_t> gauges[static_cast<int>(PerfGauge::Count)] = {};
+
+    PerfStats() = default;
 
 public:
-    UserProfile(const string &filename = "user_profile.json")
-        : profileFilename(filename)
+    static PerfStats &instance()
     {
-        loadProfile();
-        currentDate = getCurrentDate();
+        static PerfStats stats;
+        return stats;
     }
 
-    ~UserProfile()
+    static const char *name(PerfOp op)
     {
-        saveProfile();
+        static const char *names[] = {
+            "loadDatabase", "saveDatabase", "loadLog", "saveLog", "searchFood",
+            "addCompositeFood", "ingredientLookup", "undo", "redo",
+            "calorieTarget", "dailyCalories", "backgroundWrite", "importFoods", "fuzzyLookup",
+            "prefixLookup", "calorieRange", "mealPlan",
+            "query", "sortFoods", "whereUsed"};
+        return names[static_cast<int>(op)];
     }
 
-    void loadProfile()
+    static const char *name(PerfCounter counter)
     {
-        ifstream profileFile(profileFilename);
-        if (profileFile.is_open())
-        {
-            profileFile >> profileData;
-            profileFile.close();
-        }
-        else
-        {
-            // Initialize with default values
-            profileData = {
-                {"gender", ""},
-                {"height", 0},
-                {"dailyData", json::object()}};
-        }
+        static const char *names[] = {"databaseBytesWritten", "logBytesWritten", "savesCoalesced", "writesSkipped",
+                                      "searchCacheHits", "searchCacheMisses", "searchCacheEvictions",
+                                      "expansionCacheHits", "expansionCacheMisses", "expansionCacheDrops"};
+        return names[static_cast<int>(counter)];
     }
 
-    void saveProfile()
+    static const char *name(PerfGauge gauge)
     {
-        ofstream profileFile(profileFilename);
-        if (profileFile.is_open())
-        {
-            profileFile << profileData.dump(4);
-            profileFile.close();
-        }
+        static const char *names[] = {"catalogBasicFoods", "catalogCompositeFoods", "logDates", "logEntries",
+                                      "searchCacheEntries", "expansionCacheEntries"};
+        return names[static_cast<int>(gauge)];
     }
 
-    string getCurrentDate()
+    void record(PerfOp op, uint64_t nanos)
     {
-        time_t now = time(0);
-        tm *ltm = localtime(&now);
-
-        stringstream ss;
-        ss << 1900 + ltm->tm_year << '-'
-           << setw(2) << setfill('0') << 1 + ltm->tm_mon << '-'
-           << setw(2) << setfill('0') << ltm->tm_mday;
-        return ss.str();
+        histograms[static_cast<int>(op)].record(nanos);
     }
 
-    void setDate(const string &date)
+    void recordAllocations(PerfOp op, uint64_t calls)
     {
-        currentDate = date;
+        allocations[static_cast<int>(op)].fetch_add(calls, memory_order_relaxed);
     }
 
-    string getDate() const
+    void add(PerfCounter counter, uint64_t amount)
     {
-        return currentDate;
+        counters[static_cast<int>(counter)].fetch_add(amount, memory_order_relaxed);
     }
 
-    void setupProfile()
+    void set(PerfGauge gauge, int64_t value)
     {
-        string gender;
-        int height;
-
-        cout << "Enter your gender (M/F): ";
-        cin >> gender;
-        transform(gender.begin(), gender.end(), gender.begin(), ::toupper);
+        gauges[static_cast<int>(gauge)].store(value, memory_order_relaxed);
+    }
 
-        cout << "Enter your height in cm: ";
-        while (!(cin >> height) || height <= 0)
+    json toJson() const
+    {
+        json result;
+        result["operations"] = json::object();
+        for (int i = 0; i < static_cast<int>(PerfOp::Count); i++)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
+            json op = histograms[i].toJson();
+            op["allocations"] = allocations[i].load(memory_order_relaxed);
+            result["operations"][name(static_cast<PerfOp>(i))] = op;
         }
-
-        profileData["gender"] = gender;
-        profileData["height"] = height;
-
-        updateDailyData();
-        saveProfile();
+        result["heap"] = {
+            {"allocations", processAllocations.load(memory_order_relaxed)},
+            {"bytes", processAllocatedBytes.load(memory_order_relaxed)}};
+        result["counters"] = json::object();
+        for (int i = 0; i < static_cast<int>(PerfCounter::Count); i++)
+        {
+            result["counters"][name(static_cast<PerfCounter>(i))] = counters[i].load(memory_order_relaxed);
+        }
+        result["gauges"] = json::object();
+        for (int i = 0; i < static_cast<int>(PerfGauge::Count); i++)
+        {
+            result["gauges"][name(static_cast<PerfGauge>(i))] = gauges[i].load(memory_order_relaxed);
+        }
+        return result;
     }
 
-    void updateDailyData()
+    bool writeJson(const string &path) const
     {
-        int age, weight;
-        string activityLevel;
+        ofstream file(path);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file << toJson().dump(4);
+        return true;
+    }
 
-        cout << "Enter your age: ";
-        while (!(cin >> age) || age <= 0)
+    void print() const
+    {
+        StreamFormatGuard format(cout);
+        cout << "\n===== Performance Statistics =====\n";
+        cout << left << setw(20) << "Operation" << right << setw(8) << "Calls" << setw(12) << "Mean(us)"
+             << setw(12) << "p50(us)" << setw(12) << "p99(us)" << setw(12) << "Max(us)" << setw(13) << "Allocs/call" << "\n";
+        cout << string(89, '-') << "\n";
+        cout << fixed << setprecision(1);
+        for (int i = 0; i < static_cast<int>(PerfOp::Count); i++)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
+            json op = histograms[i].toJson();
+            cout << left << setw(20) << name(static_cast<PerfOp>(i)) << right << setw(8) << op["count"].get<uint64_t>()
+                 << setw(12) << op["mean_us"].get<double>() << setw(12) << op["p50_us"].get<double>()
+                 << setw(12) << op["p99_us"].get<double>() << setw(12) << op["max_us"].get<double>()
+                 << setw(13) << (op["count"].get<uint64_t>() ? double(allocations[i].load(memory_order_relaxed)) / op["count"].get<uint64_t>() : 0.0)
+                 << "\n";
         }
+        cout << defaultfloat << left;
 
-        cout << "Enter your weight in kg: ";
-        while (!(cin >> weight) || weight <= 0)
+        cout << "\n";
+        for (int i = 0; i < static_cast<int>(PerfCounter::Count); i++)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
+            cout << setw(25) << name(static_cast<PerfCounter>(i)) << ": " << counters[i].load(memory_order_relaxed) << "\n";
+        }
+        for (int i = 0; i < static_cast<int>(PerfGauge::Count); i++)
+        {
+            cout << setw(25) << name(static_cast<PerfGauge>(i)) << ": " << gauges[i].load(memory_order_relaxed) << "\n";
         }
+        cout << setw(25) << "heapAllocations" << ": " << processAllocations.load(memory_order_relaxed) << "\n";
+        cout << setw(25) << "heapBytesAllocated" << ": " << processAllocatedBytes.load(memory_order_relaxed) << "\n";
+    }
+};
 
-        cin.ignore();
-        cout << "Enter your activity level (sedentary/light/moderate/active/very active): ";
-        getline(cin, activityLevel);
-        transform(activityLevel.begin(), activityLevel.end(), activityLevel.begin(), ::tolower);
+// Records the lifetime of the enclosing scope, and the heap allocations made
+// on this thread during it, against an operation
+class ScopedTimer
+{
+private:
+    PerfOp op;
+    uint64_t allocationsAtStart;
+    chrono::steady_clock::time_point start;
 
-        // Store today's data
-        profileData["dailyData"][currentDate] = {
-            {"age", age},
-            {"weight", weight},
-            {"activityLevel", activityLevel}};
+public:
+    explicit ScopedTimer(PerfOp operation)
+        : op(operation), allocationsAtStart(threadAllocations.calls), start(chrono::steady_clock::now()) {}
 
-        saveProfile();
+    ~ScopedTimer()
+    {
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        PerfStats::instance().record(op, static_cast<uint64_t>(elapsed.count()));
+        PerfStats::instance().recordAllocations(op, threadAllocations.calls - allocationsAtStart);
     }
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define PERF_SCOPE(op) ScopedTimer PERF_CONCAT(perfScope_, __LINE__)(PerfOp::op)
+#define PERF_ADD(counter, amount) PerfStats::instance().add(PerfCounter::counter, (amount))
+#define PERF_ADD_DYNAMIC(counter, amount) PerfStats::instance().add((counter), (amount))
+#define PERF_SET(gauge, value) PerfStats::instance().set(PerfGauge::gauge, (value))
+
+#else
+
+// Statistics compiled out: the macros vanish and their arguments are never evaluated
+#define PERF_SCOPE(op) ((void)0)
+#define PERF_ADD(counter, amount) ((void)0)
+#define PERF_ADD_DYNAMIC(counter, amount) ((void)0)
+#define PERF_SET(gauge, value) ((void)0)
 
-    json getDailyData()
+#endif
+
+// Opt-in Chrome/Perfetto trace recorder. Spans are appended to a per-thread
+// buffer with no locking; the buffers are only merged and written out when the
+// trace is flushed at exit. While tracing is off a span costs one relaxed load.
+class TraceRecorder
+{
+private:
+    struct Event
     {
-        // If there's no data for the current date, use the most recent date's data
-        if (profileData["dailyData"].find(currentDate) == profileData["dailyData"].end())
-        {
-            string mostRecentDate = "";
+        const char *name;
+        const char *category;
+        int64_t startNanos;
+        int64_t durationNanos;
+    };
 
-            for (auto &[date, data] : profileData["dailyData"].items())
-            {
-                if (date > mostRecentDate)
-                {
-                    mostRecentDate = date;
-                }
-            }
+    struct ThreadBuffer
+    {
+        int tid;
+        string threadName;
+        vector<Event> events;
+    };
 
-            if (!mostRecentDate.empty())
-            {
-                // Copy the most recent data to the current date
-                profileData["dailyData"][currentDate] = profileData["dailyData"][mostRecentDate];
-                saveProfile();
-            }
-            else
-            {
-                // No previous data, prompt user to enter data
-                cout << "No profile data found for " << currentDate << ". Please update your information.\n";
-                updateDailyData();
-            }
-        }
+    atomic<bool> enabled{false};
+    string outputPath;
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    mutex registryMutex;
+    vector<unique_ptr<ThreadBuffer>> buffers;
 
-        return {
-            {"gender", profileData["gender"]},
-            {"height", profileData["height"]},
-            {"age", profileData["dailyData"][currentDate]["age"]},
-            {"weight", profileData["dailyData"][currentDate]["weight"]},
-            {"activityLevel", profileData["dailyData"][currentDate]["activityLevel"]}};
-    }
+    TraceRecorder() = default;
 
-    void setCalculator(shared_ptr<DietCalculator> calc)
+    ThreadBuffer &threadBuffer()
     {
-        calculator = calc;
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            lock_guard<mutex> lock(registryMutex);
+            buffers.push_back(make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->tid = static_cast<int>(buffers.size());
+            buffer->threadName = buffer->tid == 1 ? "main" : "worker-" + to_string(buffer->tid - 1);
+            buffer->events.reserve(4096);
+        }
+        return *buffer;
     }
 
-    int calculateDailyCalorieTarget();
-};
+    static void writeEscaped(ostream &out, const string &text)
+    {
+        out << json(text).dump();
+    }
 
-// Interface for different diet calculation methods
-class DietCalculator
-{
 public:
-    virtual ~DietCalculator() = default;
-    virtual int calculateCalories(const string &gender, int height, int age, int weight, const string &activityLevel) = 0;
-    virtual string getName() const = 0;
-};
-
-int UserProfile::calculateDailyCalorieTarget()
-{
-    if (!calculator)
+    static TraceRecorder &instance()
     {
-        return 0;
+        static TraceRecorder recorder;
+        return recorder;
     }
 
-    json data = getDailyData();
-    return calculator->calculateCalories(
-        data["gender"],
-        data["height"],
-        data["age"],
-        data["weight"],
-        data["activityLevel"]);
-}
+    void start(const string &path)
+    {
+        outputPath = path;
+        origin = chrono::steady_clock::now();
+        threadBuffer(); // the calling thread becomes "main"
+        enabled.store(true, memory_order_relaxed);
+    }
 
-// Harris-Benedict Equation for calculating daily calorie needs
-class HarrisBenedictCalculator : public DietCalculator
-{
-public:
-    int calculateCalories(const string &gender, int height, int age, int weight, const string &activityLevel) override
+    bool isEnabled() const
     {
-        double bmr = 0;
+        return enabled.load(memory_order_relaxed);
+    }
 
-        // Calculate BMR
-        if (gender == "M")
-        {
-            bmr = 88.362 + (13.397 * weight) + (4.799 * height) - (5.677 * age);
-        }
-        else
-        { // Female
-            bmr = 447.593 + (9.247 * weight) + (3.098 * height) - (4.330 * age);
-        }
+    int64_t now() const
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+    }
 
-        // Apply activity multiplier
-        double activityMultiplier = 1.2; // Default to sedentary
+    void record(const char *name, const char *category, int64_t startNanos, int64_t endNanos)
+    {
+        threadBuffer().events.push_back({name, category, startNanos, endNanos - startNanos});
+    }
 
-        if (activityLevel == "sedentary")
+    void setThreadName(const string &name)
+    {
+        if (isEnabled())
         {
-            activityMultiplier = 1.2;
+            threadBuffer().threadName = name;
         }
-        else if (activityLevel == "light")
+    }
+
+    // Writes all buffered spans as trace-event JSON; call once threads are joined
+    bool flush()
+    {
+        if (!isEnabled())
         {
-            activityMultiplier = 1.375;
+            return true;
         }
-        else if (activityLevel == "moderate")
+        enabled.store(false, memory_order_relaxed);
+
+        ofstream file(outputPath);
+        if (!file.is_open())
         {
-            activityMultiplier = 1.55;
+            return false;
         }
-        else if (activityLevel == "active")
+
+        lock_guard<mutex> lock(registryMutex);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        file << fixed << setprecision(3);
+        for (const auto &buffer : buffers)
         {
-            activityMultiplier = 1.725;
+            file << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                 << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+            writeEscaped(file, buffer->threadName);
+            file << "}}";
+            first = false;
+
+            for (const auto &event : buffer->events)
+            {
+                file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                     << ",\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                     << "\",\"ts\":" << event.startNanos / 1000.0
+                     << ",\"dur\":" << event.durationNanos / 1000.0 << "}";
+            }
+            buffer->events.clear();
         }
-        else if (activityLevel == "very active")
-        {
-            activityMultiplier = 1.9;
-        }
-
-        return static_cast<int>(bmr * activityMultiplier);
-    }
-
-    string getName() const override
-    {
-        return "Harris-Benedict Equation";
+        file << "\n]}\n";
+        return file.good();
     }
 };
 
-// Mifflin-St Jeor Equation for calculating daily calorie needs
-class MifflinStJeorCalculator : public DietCalculator
+// Records the enclosing scope as a trace span; names must be string literals
+class TraceSpan
 {
+private:
+    const char *name;
+    const char *category;
+    int64_t start;
+
 public:
-    int calculateCalories(const string &gender, int height, int age, int weight, const string &activityLevel) override
+    TraceSpan(const char *spanName, const char *spanCategory)
+        : name(spanName), category(spanCategory),
+          start(TraceRecorder::instance().isEnabled() ? TraceRecorder::instance().now() : -1)
     {
-        double bmr = 0;
+    }
 
-        // Calculate BMR
-        if (gender == "M")
+    ~TraceSpan()
+    {
+        if (start >= 0 && TraceRecorder::instance().isEnabled())
         {
-            bmr = (10 * weight) + (6.25 * height) - (5 * age) + 5;
-        }
-        else
-        { // Female
-            bmr = (10 * weight) + (6.25 * height) - (5 * age) - 161;
+            TraceRecorder::instance().record(name, category, start, TraceRecorder::instance().now());
         }
+    }
+};
 
-        // Apply activity multiplier
-        double activityMultiplier = 1.2; // Default to sedentary
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name, category) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name, category)
+
+// Two-stage JSON reader in the style of simdjson. The whole file is read into
+// one padded buffer; stage 1 classifies 64 bytes at a time (SSE2 compares
+// folded into 64-bit masks, scalar fallback elsewhere) and records the offset
+// of every structural character and value start outside strings; stage 2
+// walks that index and emits the same SAX events as nlohmann::json::sax_parse,
+// so FoodRecordSax and JsonDomBuilder work with either parser.
+class FastJson
+{
+public:
+    static constexpr size_t Padding = 64;
 
-        if (activityLevel == "sedentary")
-        {
-            activityMultiplier = 1.2;
-        }
-        else if (activityLevel == "light")
-        {
-            activityMultiplier = 1.375;
-        }
-        else if (activityLevel == "moderate")
+    struct Buffer
+    {
+        string data;       // file contents followed by Padding spaces
+        size_t length = 0; // bytes of real content
+    };
+
+    static bool readFile(const string &path, Buffer &buffer)
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file.is_open())
         {
-            activityMultiplier = 1.55;
+            return false;
         }
-        else if (activityLevel == "active")
+        streamsize size = file.tellg();
+        file.seekg(0);
+        buffer.length = static_cast<size_t>(max<streamsize>(size, 0));
+        buffer.data.assign(buffer.length + Padding, ' ');
+        if (!file.read(&buffer.data[0], size) && size != 0)
         {
-            activityMultiplier = 1.725;
+            return false;
         }
-        else if (activityLevel == "very active")
+        // A UTF-8 byte order mark is skipped as nlohmann::json does; blanking it
+        // keeps every offset in the file as it was
+        if (buffer.data.compare(0, 3, "\xEF\xBB\xBF") == 0 && buffer.length >= 3)
         {
-            activityMultiplier = 1.9;
+            buffer.data.replace(0, 3, 3, ' ');
         }
-
-        return static_cast<int>(bmr * activityMultiplier);
+        return true;
     }
 
-    string getName() const override
+    template <typename Sax>
+    static bool parse(const Buffer &buffer, Sax &sax, string &error)
     {
-        return "Mifflin-St Jeor Equation";
+        vector<uint32_t> structurals;
+        return parse(buffer, sax, error, structurals);
     }
-};
 
-// Factory for creating diet calculators
-class DietCalculatorFactory
-{
-public:
-    static shared_ptr<DietCalculator> createCalculator(const string &type)
+    // Same, reusing the caller's index storage across many small documents
+    template <typename Sax>
+    static bool parse(const Buffer &buffer, Sax &sax, string &error, vector<uint32_t> &structurals)
     {
-        if (type == "harris-benedict")
+        if (buffer.length > numeric_limits<uint32_t>::max())
         {
-            return make_shared<HarrisBenedictCalculator>();
+            error = "file too large";
+            return false;
         }
-        else if (type == "mifflin-st-jeor")
+        if (!indexStructurals(buffer, structurals, error))
         {
-            return make_shared<MifflinStJeorCalculator>();
+            return false;
         }
-
-        // Default to Harris-Benedict
-        return make_shared<HarrisBenedictCalculator>();
+        Parser<Sax> parser(buffer, structurals, sax, error);
+        return parser.run();
     }
 
-    static vector<string> getAvailableCalculators()
+private:
+    struct BlockMasks
     {
-        return {"harris-benedict", "mifflin-st-jeor"};
-    }
-};
-
-class FoodDatabase
-{
-protected:
-    string filename;
-    json foods;
-    CommandManager commandManager;
+        uint64_t quote;
+        uint64_t backslash;
+        uint64_t structural; // { } [ ] : ,
+        uint64_t whitespace;
+    };
 
-public:
-    bool canUndo() const
+    static void classify(const char *block, BlockMasks &masks)
     {
-        return commandManager.canUndo();
+#if defined(__SSE2__)
+        masks = {0, 0, 0, 0};
+        for (int lane = 0; lane < 4; lane++)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + lane * 16));
+            auto eq = [&](char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); };
+            auto bits = [](__m128i m) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(m))); };
+            int shift = lane * 16;
+
+            masks.quote |= bits(eq('"')) << shift;
+            masks.backslash |= bits(eq('\\')) << shift;
+            __m128i structural = _mm_or_si128(_mm_or_si128(_mm_or_si128(eq('{'), eq('}')), _mm_or_si128(eq('['), eq(']'))),
+                                              _mm_or_si128(eq(':'), eq(',')));
+            masks.structural |= bits(structural) << shift;
+            __m128i whitespace = _mm_or_si128(_mm_or_si128(eq(' '), eq('\n')), _mm_or_si128(eq('\t'), eq('\r')));
+            masks.whitespace |= bits(whitespace) << shift;
+        }
+#else
+        masks = {0, 0, 0, 0};
+        for (int i = 0; i < 64; i++)
+        {
+            uint64_t bit = 1ULL << i;
+            switch (block[i])
+            {
+            case '"': masks.quote |= bit; break;
+            case '\\': masks.backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': masks.structural |= bit; break;
+            case ' ': case '\n': case '\t': case '\r': masks.whitespace |= bit; break;
+            default: break;
+            }
+        }
+#endif
     }
 
-    bool canRedo() const
+    // Bit i of the result is the XOR of bits 0..i of x
+    static uint64_t prefixXor(uint64_t x)
     {
-        return commandManager.canRedo();
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
     }
 
-    void undo()
+    static bool indexStructurals(const Buffer &buffer, vector<uint32_t> &structurals, string &error)
     {
-        commandManager.undo();
-    }
+        structurals.clear();
+        structurals.reserve(buffer.length / 6 + 16);
 
-    void redo()
-    {
-        commandManager.redo();
-    }
-    FoodDatabase(const string &file = "food_db.json") : filename(file)
-    {
-        loadDatabase();
-    }
+        const char *data = buffer.data.data();
+        uint64_t escapeCarry = 0;    // previous block ended in an unescaped backslash
+        uint64_t inStringCarry = 0;  // all ones while a string spans the block boundary
+        uint64_t separatorCarry = 1; // previous byte was whitespace/structural (or start of input)
 
-    virtual void loadDatabase()
-    {
-        ifstream file(filename);
-        if (file.is_open())
+        for (size_t offset = 0; offset < buffer.length; offset += 64)
         {
-            file >> foods;
-            file.close();
+            BlockMasks masks;
+            classify(data + offset, masks);
+
+            // Characters escaped by a backslash. Backslashes are rare in our
+            // data, so resolve runs bit by bit instead of with carry arithmetic.
+            uint64_t escaped = escapeCarry;
+            escapeCarry = 0;
+            for (uint64_t bs = masks.backslash; bs; bs &= bs - 1)
+            {
+                int i = __builtin_ctzll(bs);
+                if (escaped & (1ULL << i))
+                {
+                    continue; // this backslash is itself escaped
+                }
+                if (i == 63)
+                    escapeCarry = 1;
+                else
+                    escaped |= 1ULL << (i + 1);
+            }
+
+            uint64_t quotes = masks.quote & ~escaped;
+            uint64_t inString = prefixXor(quotes) ^ inStringCarry; // opening quote and contents, not closing quote
+            inStringCarry = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+
+            uint64_t separators = masks.structural | masks.whitespace | (quotes & ~inString);
+            uint64_t precededBySeparator = (separators << 1) | separatorCarry;
+            separatorCarry = separators >> 63;
+
+            uint64_t scalarStarts = ~separators & ~masks.quote & precededBySeparator & ~inString;
+            uint64_t bits = (masks.structural & ~inString) | (quotes & inString) | scalarStarts;
+
+            // The padding is whitespace, so the last partial block needs no masking
+            while (bits)
+            {
+                structurals.push_back(static_cast<uint32_t>(offset + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
         }
-        else
+
+        if (inStringCarry)
+        {
+            error = "unterminated string";
+            return false;
+        }
+        if (structurals.empty())
         {
-            foods["basic"] = json::object();
-            foods["composite"] = json::object();
+            error = "empty document";
+            return false;
         }
+        return true;
     }
 
-    virtual void saveDatabase()
+    template <typename Sax>
+    class Parser
     {
-        ofstream file(filename);
-        if (file.is_open())
+    private:
+        const char *data;
+        size_t length;
+        const vector<uint32_t> &index;
+        Sax &sax;
+        string &error;
+        size_t next = 0;
+        string text;
+
+        bool fail(const string &message, size_t at)
         {
-            file << foods.dump(4);
-            file.close();
+            if (error.empty())
+            {
+                error = message + " at byte " + to_string(at);
+            }
+            return false;
         }
-    }
 
-    void addBasicFood(const string& name, const vector<string>& keywords, int calories) {
-        // Convert name to lowercase for consistent storage
-        string lowerName = name;
-        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
-    
-        // Save the current state for undo
-        json previousState = foods["basic"].contains(lowerName) ? foods["basic"][lowerName] : json();
-    
-        // Check if food already exists (case insensitive)
-        if (foods["basic"].contains(lowerName)) {
-            cout << "Food '" << lowerName << "' already exists with "
-                 << foods["basic"][lowerName]["calories"].get<int>() << " calories.\n"
-                 << "Do you want to update it? (1 = Yes, 0 = No): ";
-    
-            int choice;
-            while (!(cin >> choice) || (choice != 0 && choice != 1)) {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Enter 1 to update, 0 to cancel: ";
+        // The handler rejected a value; it reports its own message
+        bool rejected(size_t at)
+        {
+            if (error.empty() && sax.error.empty())
+            {
+                error = "invalid value at byte " + to_string(at);
             }
-            cin.ignore();
-    
-            if (choice == 0) {
-                cout << "Food not updated.\n";
-                return;
+            else if (error.empty())
+            {
+                error = sax.error;
             }
+            return false;
         }
-    
-        // Create the do command
-        auto doCmd = [this, lowerName, keywords, calories]() {
-            foods["basic"][lowerName] = {
-                {"keywords", keywords},
-                {"calories", calories}
-            };
-            saveDatabase();
-            cout << "Basic food '" << lowerName << "' added/updated successfully!\n";
-        };
-    
-        // Create the undo command
-        auto undoCmd = [this, lowerName, previousState]() {
-            if (previousState.is_null()) {
-                // If the food was newly added, remove it from the database
-                foods["basic"].erase(lowerName);
-            } else {
-                // If the food existed before, restore its previous state
-                foods["basic"][lowerName] = previousState;
-            }
-            saveDatabase();
-            cout << "Undo: Basic food '" << lowerName << "' removed or restored to its previous state.\n";
-        };
-    
-        // Execute the command
-        commandManager.executeCommand(doCmd, undoCmd);
-    }
 
-    void addBasicFoodUI()
-    {
-        string name;
-        vector<string> keywords;
-        int calories, keywordCount;
-
-        cout << "Enter food name: ";
-        getline(cin, name);
-
-        // Ask user for the number of keywords
-        cout << "Enter the number of keywords: ";
-        while (!(cin >> keywordCount) || keywordCount < 0)
+        static bool isDelimiter(char c)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a non-negative number: ";
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',' || c == ':' ||
+                   c == '}' || c == ']' || c == '{' || c == '[';
         }
-        cin.ignore();
 
-        keywords.resize(keywordCount);
-        for (int i = 0; i < keywordCount; ++i)
+        static bool validUtf8(const unsigned char *s, size_t n)
         {
-            cout << "Enter keyword " << i + 1 << ": ";
-            getline(cin, keywords[i]);
+            for (size_t i = 0; i < n;)
+            {
+                unsigned char c = s[i];
+                size_t extra;
+                if (c < 0x80)
+                    extra = 0;
+                else if (c >= 0xC2 && c <= 0xDF)
+                    extra = 1;
+                else if ((c & 0xF0) == 0xE0)
+                    extra = 2;
+                else if (c >= 0xF0 && c <= 0xF4)
+                    extra = 3;
+                else
+                    return false;
+
+                if (n - i <= extra)
+                    return false;
+                for (size_t k = 1; k <= extra; k++)
+                {
+                    if ((s[i + k] & 0xC0) != 0x80)
+                        return false;
+                }
+                // Overlong forms, UTF-16 surrogates and code points past U+10FFFF
+                // pass the checks above but are not UTF-8; these narrow the
+                // second byte the way the Unicode table of well-formed sequences does
+                unsigned char next = s[i + 1];
+                if ((c == 0xE0 && next < 0xA0) || (c == 0xED && next > 0x9F) || (c == 0xF0 && next < 0x90) ||
+                    (c == 0xF4 && next > 0x8F))
+                    return false;
+                i += extra + 1;
+            }
+            return true;
         }
 
-        // Get calorie value
-        cout << "Enter calories: ";
-        while (!(cin >> calories) || calories <= 0)
+        static void appendUtf8(string &out, uint32_t cp)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive calorie value: ";
+            if (cp < 0x80)
+            {
+                out += static_cast<char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
         }
-        cin.ignore();
-
-        addBasicFood(name, keywords, calories);
-    }
-
-    void addCompositeFood(const string &name, const vector<string> &keywords, unordered_map<string, int> &ingredients)
-    {
-        string lowerName = name;
-        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
-
-        int totalCalories = 0;
-        unordered_map<string, int> finalIngredients;
 
-        for (auto &[ingredientName, servings] : ingredients)
+        bool readHex4(size_t at, uint32_t &value)
         {
-            string lowerIngredientName = ingredientName;
-            transform(lowerIngredientName.begin(), lowerIngredientName.end(), lowerIngredientName.begin(), ::tolower);
-
-            bool found = false;
-
-            // Search in "basic" category
-            for (const auto &[basicName, details] : foods["basic"].items())
+            value = 0;
+            for (size_t i = 0; i < 4; i++)
             {
-                string lowerBasicName = basicName;
-                transform(lowerBasicName.begin(), lowerBasicName.end(), lowerBasicName.begin(), ::tolower);
+                char c = data[at + i];
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                    value |= c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    value |= c - 'A' + 10;
+                else
+                    return false;
+            }
+            return true;
+        }
 
-                if (lowerBasicName == lowerIngredientName)
+        // Decodes the string whose opening quote is at `at` into `text`
+        bool readString(size_t at)
+        {
+            text.clear();
+            size_t i = at + 1;
+            size_t runStart = i;
+            bool nonAscii = false;
+            while (true)
+            {
+                if (i >= length)
+                {
+                    return fail("unterminated string", at);
+                }
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                if (c == '"')
                 {
-                    totalCalories += details["calories"].get<int>() * servings;
-                    finalIngredients[lowerBasicName] = servings;
-                    found = true;
+                    text.append(data + runStart, i - runStart);
                     break;
                 }
-            }
-
-            // Search in "composite" category
-            if (!found)
-            {
-                for (const auto &[compositeName, details] : foods["composite"].items())
+                if (c < 0x20)
                 {
-                    string lowerCompositeName = compositeName;
-                    transform(lowerCompositeName.begin(), lowerCompositeName.end(), lowerCompositeName.begin(), ::tolower);
-
-                    if (lowerCompositeName == lowerIngredientName)
-                    {
-                        totalCalories += details["calories"].get<int>() * servings;
-                        finalIngredients[lowerCompositeName] = servings;
-                        found = true;
-                        break;
-                    }
+                    return fail("control character in string", i);
                 }
-            }
-
-            // If ingredient is not found, prompt user for a valid one
-            while (!found)
-            {
-                cout << "Error: Ingredient '" << ingredientName << "' not found.\n";
-                cout << "Enter a valid ingredient name: ";
-                string newIngredientName; // FIX: Separate input variable
-                getline(cin, newIngredientName);
-                transform(newIngredientName.begin(), newIngredientName.end(), newIngredientName.begin(), ::tolower);
-
-                // Recheck ingredient
-                for (const auto &[basicName, details] : foods["basic"].items())
+                nonAscii |= c >= 0x80;
+                if (c != '\\')
                 {
-                    string lowerBasicName = basicName;
-                    transform(lowerBasicName.begin(), lowerBasicName.end(), lowerBasicName.begin(), ::tolower);
+                    i++;
+                    continue;
+                }
 
-                    if (lowerBasicName == newIngredientName)
+                text.append(data + runStart, i - runStart);
+                char e = data[i + 1];
+                i += 2;
+                switch (e)
+                {
+                case '"': text += '"'; break;
+                case '\\': text += '\\'; break;
+                case '/': text += '/'; break;
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u':
+                {
+                    uint32_t cp;
+                    if (!readHex4(i, cp))
+                        return fail("invalid \\u escape", i);
+                    i += 4;
+                    if (cp >= 0xD800 && cp <= 0xDBFF)
                     {
-                        totalCalories += details["calories"].get<int>() * servings;
-                        finalIngredients[lowerBasicName] = servings;
-                        found = true;
-                        break;
+                        uint32_t low;
+                        if (data[i] != '\\' || data[i + 1] != 'u' || !readHex4(i + 2, low) || low < 0xDC00 || low > 0xDFFF)
+                            return fail("invalid surrogate pair", i);
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
                     }
-                }
-                if (!found)
-                {
-                    for (const auto &[compositeName, details] : foods["composite"].items())
+                    else if (cp >= 0xDC00 && cp <= 0xDFFF)
                     {
-                        string lowerCompositeName = compositeName;
-                        transform(lowerCompositeName.begin(), lowerCompositeName.end(), lowerCompositeName.begin(), ::tolower);
-
-                        if (lowerCompositeName == newIngredientName)
-                        {
-                            totalCalories += details["calories"].get<int>() * servings;
-                            finalIngredients[lowerCompositeName] = servings;
-                            found = true;
-                            break;
-                        }
+                        return fail("invalid surrogate pair", i);
                     }
+                    appendUtf8(text, cp);
+                    break;
+                }
+                default:
+                    return fail("invalid escape", i - 1);
                 }
+                runStart = i;
+            }
+            if (nonAscii && !validUtf8(reinterpret_cast<const unsigned char *>(text.data()), text.size()))
+            {
+                return fail("invalid UTF-8 in string", at);
             }
+            return true;
         }
-        json previousState = foods["composite"].contains(lowerName) ? foods["composite"][lowerName] : json();
 
-        // Check if composite food exists
-        if (foods["composite"].contains(lowerName))
+        bool readNumber(size_t at)
         {
-            cout << "Composite food '" << lowerName << "' already exists with "
-                 << foods["composite"][lowerName]["calories"].get<int>() << " calories.\n"
-                 << "Do you want to update it? (1 = Yes, 0 = No): ";
-
-            int choice;
-            while (!(cin >> choice) || (choice != 0 && choice != 1))
+            const char *p = data + at;
+            const char *start = p;
+            bool negative = *p == '-';
+            if (negative)
+                p++;
+            if (*p < '0' || *p > '9')
+                return fail("invalid number", at);
+            if (*p == '0' && p[1] >= '0' && p[1] <= '9')
+                return fail("leading zero in number", at);
+
+            uint64_t magnitude = 0;
+            int digits = 0;
+            while (*p >= '0' && *p <= '9')
             {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Enter 1 to update, 0 to cancel: ";
+                magnitude = magnitude * 10 + (*p - '0');
+                digits++;
+                p++;
             }
-            cin.ignore();
 
-            if (choice == 0)
+            bool isFloat = false;
+            if (*p == '.')
             {
-                cout << "Composite food not updated.\n";
-                return;
+                isFloat = true;
+                p++;
+                if (*p < '0' || *p > '9')
+                    return fail("invalid number", at);
+                while (*p >= '0' && *p <= '9')
+                    p++;
             }
-        }
-
-        auto doCmd = [this, lowerName, keywords, finalIngredients, totalCalories]() {
-            foods["composite"][lowerName] = {
-                {"keywords", keywords},
-                {"ingredients", finalIngredients},
-                {"calories", totalCalories}
-            };
-            saveDatabase();
-            cout << "Composite food '" << lowerName << "' added/updated successfully!\n";
-        };
-    
-        // Create the undo command
-        auto undoCmd = [this, lowerName, previousState]() {
-            if (previousState.is_null()) {
-                // If the food was newly added, remove it from the database
-                foods["composite"].erase(lowerName);
-            } else {
-                // If the food existed before, restore its previous state
-                foods["composite"][lowerName] = previousState;
+            if (*p == 'e' || *p == 'E')
+            {
+                isFloat = true;
+                p++;
+                if (*p == '+' || *p == '-')
+                    p++;
+                if (*p < '0' || *p > '9')
+                    return fail("invalid number", at);
+                while (*p >= '0' && *p <= '9')
+                    p++;
+            }
+            if (!isDelimiter(*p))
+            {
+                return fail("invalid number", at);
             }
-            saveDatabase();
-            cout << "Undo: Composite food '" << lowerName << "' removed or restored to its previous state.\n";
-        };
-        // Execute the command
-        commandManager.executeCommand(doCmd, undoCmd);
-    }
-
-    void addCompositeFoodUI()
-    {
-        string name;
-        vector<string> keywords;
-        unordered_map<string, int> ingredients;
-        int keywordCount, ingredientCount;
-
-        cout << "Enter composite food name: ";
-        getline(cin, name); // Removed the unnecessary cin.ignore()
 
-        // Ask user for number of keywords
-        cout << "Enter number of keywords: ";
-        while (!(cin >> keywordCount) || keywordCount < 0)
-        {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a non-negative number: ";
+            bool ok;
+            if (!isFloat && digits <= 19 && (!negative || magnitude <= static_cast<uint64_t>(numeric_limits<int64_t>::max()) + 1))
+            {
+                ok = negative ? sax.number_integer(static_cast<json::number_integer_t>(0 - magnitude))
+                              : sax.number_unsigned(magnitude);
+            }
+            else
+            {
+                string raw(start, p - start);
+                double value = strtod(raw.c_str(), nullptr);
+                if (!isfinite(value))
+                {
+                    return fail("number out of range", at);
+                }
+                ok = sax.number_float(value, raw);
+            }
+            return ok || rejected(at);
         }
-        cin.ignore(); // Correct usage after cin >>
 
-        keywords.resize(keywordCount);
-        for (int i = 0; i < keywordCount; ++i)
+        bool readScalar(size_t at)
         {
-            cout << "Enter keyword " << i + 1 << ": ";
-            getline(cin, keywords[i]);
+            const char *p = data + at;
+            switch (*p)
+            {
+            case '"':
+                if (!readString(at))
+                    return false;
+                return sax.string(text) || rejected(at);
+            case 't':
+                if (memcmp(p, "true", 4) != 0 || !isDelimiter(p[4]))
+                    return fail("invalid literal", at);
+                return sax.boolean(true) || rejected(at);
+            case 'f':
+                if (memcmp(p, "false", 5) != 0 || !isDelimiter(p[5]))
+                    return fail("invalid literal", at);
+                return sax.boolean(false) || rejected(at);
+            case 'n':
+                if (memcmp(p, "null", 4) != 0 || !isDelimiter(p[4]))
+                    return fail("invalid literal", at);
+                return sax.null() || rejected(at);
+            default:
+                return readNumber(at);
+            }
         }
 
-        // Ask user for number of ingredients
-        cout << "Enter number of ingredients: ";
-        while (!(cin >> ingredientCount) || ingredientCount <= 0)
-        {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
-        }
-        cin.ignore(); // Correct usage after cin >>
+        bool hasNext() const { return next < index.size(); }
+        size_t peek() const { return index[next]; }
 
-        for (int i = 0; i < ingredientCount; ++i)
+    public:
+        Parser(const Buffer &buffer, const vector<uint32_t> &structurals, Sax &handler, string &message)
+            : data(buffer.data.data()), length(buffer.length), index(structurals), sax(handler), error(message)
         {
-            string ingredientName;
-            int servings;
-            cout << "Enter ingredient name: ";
-            getline(cin, ingredientName);
-            cout << "Enter number of servings: ";
-            while (!(cin >> servings) || servings <= 0)
-            {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Enter a positive number: ";
-            }
-            cin.ignore(); // Correct usage after cin >>
-            ingredients[ingredientName] = servings;
         }
 
-        addCompositeFood(name, keywords, ingredients);
-    }
+        bool run()
+        {
+            vector<char> stack; // '{' or '[' for each open container
+            const size_t unknownSize = static_cast<size_t>(-1);
 
-    json searchFood(const vector<string> &keywords, bool matchAll = true)
-    {
-        json results;
-        results["basic"] = json::object();
-        results["composite"] = json::object();
+            enum class Expect { Value, FirstKeyOrEnd, Key, FirstValueOrEnd, CommaOrEnd } expect = Expect::Value;
 
-        for (const auto &category : {"basic", "composite"})
-        {
-            for (auto &[name, details] : foods[category].items())
+            while (hasNext())
             {
-                bool matches = matchAll; // Start with true for matchAll, false for matchAny
+                size_t at = peek();
+                char c = data[at];
+                next++;
 
-                for (const auto &keyword : keywords)
+                switch (expect)
                 {
-                    // Convert the search keyword to lowercase
-                    string lowerKeyword = keyword;
-                    transform(lowerKeyword.begin(), lowerKeyword.end(), lowerKeyword.begin(), ::tolower);
-
-                    bool keywordFound = false;
-                    for (const auto &foodKeyword : details["keywords"])
+                case Expect::FirstKeyOrEnd:
+                    if (c == '}')
                     {
-                        // Convert each stored keyword to lowercase for comparison
-                        string lowerFoodKeyword = foodKeyword.get<string>();
-                        transform(lowerFoodKeyword.begin(), lowerFoodKeyword.end(), lowerFoodKeyword.begin(), ::tolower);
-
-                        if (lowerFoodKeyword.find(lowerKeyword) != string::npos)
-                        {
-                            keywordFound = true;
-                            break;
-                        }
+                        stack.pop_back();
+                        if (!sax.end_object())
+                            return rejected(at);
+                        expect = Expect::CommaOrEnd;
+                        break;
                     }
+                    [[fallthrough]];
+                case Expect::Key:
+                    if (c != '"')
+                        return fail("expected object key", at);
+                    if (!readString(at))
+                        return false;
+                    if (!sax.key(text))
+                        return rejected(at);
+                    if (!hasNext() || data[peek()] != ':')
+                        return fail("expected ':'", at);
+                    next++;
+                    expect = Expect::Value;
+                    break;
 
-                    if (matchAll && !keywordFound)
+                case Expect::FirstValueOrEnd:
+                    if (c == ']')
                     {
-                        matches = false;
+                        stack.pop_back();
+                        if (!sax.end_array())
+                            return rejected(at);
+                        expect = Expect::CommaOrEnd;
                         break;
                     }
-                    else if (!matchAll && keywordFound)
+                    [[fallthrough]];
+                case Expect::Value:
+                    if (c == '{')
                     {
-                        matches = true;
-                        break;
+                        if (stack.size() >= 1024)
+                            return fail("nesting too deep", at);
+                        stack.push_back('{');
+                        if (!sax.start_object(unknownSize))
+                            return rejected(at);
+                        expect = Expect::FirstKeyOrEnd;
+                    }
+                    else if (c == '[')
+                    {
+                        if (stack.size() >= 1024)
+                            return fail("nesting too deep", at);
+                        stack.push_back('[');
+                        if (!sax.start_array(unknownSize))
+                            return rejected(at);
+                        expect = Expect::FirstValueOrEnd;
+                    }
+                    else if (c == '}' || c == ']' || c == ',' || c == ':')
+                    {
+                        return fail("expected value", at);
+                    }
+                    else
+                    {
+                        if (!readScalar(at))
+                            return false;
+                        expect = Expect::CommaOrEnd;
+                    }
+                    break;
+
+                case Expect::CommaOrEnd:
+                    if (stack.empty())
+                        return fail("trailing content after document", at);
+                    if (c == ',')
+                    {
+                        expect = stack.back() == '{' ? Expect::Key : Expect::Value;
+                    }
+                    else if (c == '}' && stack.back() == '{')
+                    {
+                        stack.pop_back();
+                        if (!sax.end_object())
+                            return rejected(at);
                     }
+                    else if (c == ']' && stack.back() == '[')
+                    {
+                        stack.pop_back();
+                        if (!sax.end_array())
+                            return rejected(at);
+                    }
+                    else
+                    {
+                        return fail("expected ',' or end of container", at);
+                    }
+                    break;
                 }
 
-                if (matches)
+                if (stack.empty() && expect == Expect::CommaOrEnd && hasNext())
                 {
-                    results[category][name] = details;
+                    return fail("trailing content after document", peek());
                 }
             }
+
+            if (!stack.empty() || expect != Expect::CommaOrEnd)
+            {
+                return fail("unexpected end of input", length);
+            }
+            return true;
         }
+    };
+};
 
-        return results;
+// SAX handler that builds an ordinary json DOM, for files that stay as json
+class JsonDomBuilder
+{
+public:
+    std::string error;
+
+private:
+    json &root;
+    vector<json *> stack;
+    std::string pendingKey;
+
+    json *addValue(json &&value)
+    {
+        if (stack.empty())
+        {
+            root = move(value);
+            return &root;
+        }
+        json &parent = *stack.back();
+        if (parent.is_array())
+        {
+            parent.push_back(move(value));
+            return &parent.back();
+        }
+        json &slot = parent[pendingKey];
+        slot = move(value);
+        return &slot;
     }
 
-    json getAllFoods()
+public:
+    explicit JsonDomBuilder(json &target) : root(target) {}
+
+    bool null() { addValue(nullptr); return true; }
+    bool boolean(bool value) { addValue(value); return true; }
+    bool number_integer(json::number_integer_t value) { addValue(value); return true; }
+    bool number_unsigned(json::number_unsigned_t value) { addValue(value); return true; }
+    bool number_float(json::number_float_t value, const std::string &) { addValue(value); return true; }
+    bool string(std::string &value) { addValue(value); return true; }
+    bool binary(json::binary_t &value) { addValue(json::binary(value)); return true; }
+    bool key(std::string &value) { pendingKey = value; return true; }
+    bool start_object(size_t) { stack.push_back(addValue(json::object())); return true; }
+    bool end_object() { stack.pop_back(); return true; }
+    bool start_array(size_t) { stack.push_back(addValue(json::array())); return true; }
+    bool end_array() { stack.pop_back(); return true; }
+
+    bool parse_error(size_t position, const std::string &, const nlohmann::detail::exception &ex)
     {
-        json results;
-        results["basic"] = foods["basic"];
-        results["composite"] = foods["composite"];
-        return results;
+        error = "syntax error at byte " + to_string(position) + ": " + ex.what();
+        return false;
     }
 };
 
-class DailyFoodLog
+// Streams JSON text with the same layout as json::dump(4), for stores that
+// serialize typed data without building a DOM first. Callers are expected
+// to emit object members in key order, as nlohmann's std::map would.
+class JsonWriter
 {
 private:
-    string logFilename;
-    json logData;
-    CommandManager commandManager;
+    string &out;
+    size_t baseLevel;        // indentation of the enclosing text, for fragments
+    vector<bool> hasMembers; // per open container
+    bool afterKey = false;
 
-    string getCurrentDate()
+    void newline(size_t level)
     {
-        time_t now = time(0);
-        tm *ltm = localtime(&now);
+        out += '\n';
+        out.append((baseLevel + level) * 4, ' ');
+    }
 
-        stringstream ss;
-        ss << 1900 + ltm->tm_year << '-'
-           << setw(2) << setfill('0') << 1 + ltm->tm_mon << '-'
-           << setw(2) << setfill('0') << ltm->tm_mday;
-        return ss.str();
+    // Separator and indentation before a member or array element
+    void beginValue()
+    {
+        if (afterKey)
+        {
+            afterKey = false;
+            return;
+        }
+        if (!hasMembers.empty())
+        {
+            if (hasMembers.back())
+            {
+                out += ',';
+            }
+            hasMembers.back() = true;
+            newline(hasMembers.size());
+        }
     }
 
-public:
-    DailyFoodLog(const string &filename = "daily_food_log.json")
-        : logFilename(filename)
+    void open(char bracket)
     {
-        loadLog();
+        beginValue();
+        out += bracket;
+        hasMembers.push_back(false);
     }
 
-    ~DailyFoodLog()
+    void close(char bracket)
     {
-        saveLog();
+        bool nonEmpty = hasMembers.back();
+        hasMembers.pop_back();
+        if (nonEmpty)
+        {
+            newline(hasMembers.size());
+        }
+        out += bracket;
     }
 
-    bool canUndo() const
+    void quoted(string_view text)
     {
-        return commandManager.canUndo();
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 15];
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
     }
 
-    bool canRedo() const
+public:
+    explicit JsonWriter(string &target, size_t level = 0) : out(target), baseLevel(level) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(string_view name)
     {
-        return commandManager.canRedo();
+        beginValue();
+        quoted(name);
+        out += ": ";
+        afterKey = true;
     }
 
-    
+    void value(string_view text)
+    {
+        beginValue();
+        quoted(text);
+    }
 
-    void saveLog()
+    void value(int64_t number)
     {
-        ofstream logFile(logFilename);
-        if (logFile.is_open())
-        {
-            logFile << logData.dump(4);
-            logFile.close();
-        }
+        beginValue();
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), number);
+        out.append(digits, result.ptr);
     }
 
-    void loadLog()
+    // Any value in dump(4)'s layout, indented to where it lands
+    void embed(const json &value)
     {
-        ifstream logFile(logFilename);
-        if (logFile.is_open())
+        beginValue();
+        string text = value.dump(4);
+        string indent(1, '\n');
+        indent.append((baseLevel + hasMembers.size()) * 4, ' ');
+        size_t start = 0;
+        for (size_t newline = text.find('\n'); newline != string::npos; newline = text.find('\n', start))
         {
-            logFile >> logData;
-            logFile.close();
+            out.append(text, start, newline - start);
+            out += indent;
+            start = newline + 1;
         }
-        else
+        out.append(text, start, string::npos);
+    }
+
+    // Members of a kept object that sort before `next` (all that are left when
+    // it is empty), written so they interleave with known members in key order
+    void membersBefore(json::const_iterator &member, json::const_iterator end, string_view next)
+    {
+        for (; member != end && (next.empty() || member.key() < next); ++member)
         {
-            logData = json::object();
+            key(member.key());
+            embed(*member);
         }
     }
 
-    void addFoodToLog(const string &date, const string &foodName, int servings, const json &foodDetails)
+    // Shortest form that reads back the same, with ".0" on whole numbers as dump() writes them
+    void decimal(double number)
     {
-        // Create the do command
-        auto doCmd = [this, date, foodName, servings, foodDetails]()
+        beginValue();
+        char digits[352];
+        auto result = to_chars(digits, digits + sizeof(digits), number, chars_format::fixed);
+        out.append(digits, result.ptr);
+        if (!memchr(digits, '.', result.ptr - digits))
         {
-            if (logData[date].is_null())
-            {
-                logData[date] = json::array();
-            }
+            out += ".0";
+        }
+    }
+};
 
-            json foodEntry = {
-                {"name", foodName},
-                {"servings", servings},
-                {"details", foodDetails}};
+// Saves files on a background thread so commands do not wait for
+// serialization and disk I/O. A store submits a job holding an immutable
+// snapshot of its data; jobs for the same file arriving within the coalescing
+// window replace each other, so a burst of edits costs one write. Each file
+// has two buffers that alternate between "last written" and "being
+// serialized", which keeps their capacity and lets unchanged content skip the
+// write. Files are replaced atomically through a temporary and a rename.
+class BackgroundWriter
+{
+public:
+    using Serializer = function<void(string &)>;
 
-            // Add a unique identifier to the entry for easier undo/redo
-            foodEntry["id"] = to_string(time(0)) + "_" + to_string(rand());
+    enum class SyncPolicy
+    {
+        Never,  // leave it to the OS
+        OnExit, // fsync everything written once, in the durable flush at exit
+        Always  // fsync every write before it replaces the file
+    };
 
-            logData[date].push_back(foodEntry);
-            saveLog();
-        };
+private:
+    struct FileState
+    {
+        Serializer pending;
+        PerfCounter bytesCounter = PerfCounter::DatabaseBytesWritten; // what the pending job's bytes count towards
+        string buffers[2];
+        int front = 0;        // buffers[front] holds what is on disk
+        bool written = false; // buffers[front] is valid
+        bool unsynced = false;
+    };
+
+    mutex lock;
+    condition_variable wake;
+    condition_variable idle;
+    map<string, FileState> files;
+    size_t pendingCount = 0;
+    bool busy = false;
+    bool flushRequested = false;
+    bool stopping = false;
+    chrono::steady_clock::time_point deadline;
+    chrono::milliseconds window{100};
+    SyncPolicy policy = SyncPolicy::OnExit;
+    thread worker;
+
+    BackgroundWriter() = default;
+
+    static bool syncPath(const string &path, int flags)
+    {
+        int fd = ::open(path.c_str(), flags);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
 
-        // Create the undo command
-        auto undoCmd = [this, date, foodName, servings]()
+    static string directoryOf(const string &path)
+    {
+        size_t slash = path.rfind('/');
+        return slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    static bool writeFile(const string &path, const string &contents, bool sync)
+    {
+        string temporary = path + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        size_t done = 0;
+        while (done < contents.size())
         {
-            if (!logData[date].is_null())
+            ssize_t n = ::write(fd, contents.data() + done, contents.size() - done);
+            if (n < 0 && errno == EINTR)
             {
-                for (auto it = logData[date].begin(); it != logData[date].end(); ++it)
-                {
-                    if ((*it)["name"] == foodName && (*it)["servings"] == servings)
-                    {
-                        logData[date].erase(it);
-                        break;
-                    }
-                }
-                saveLog();
+                continue;
             }
-        };
-
-        commandManager.executeCommand(doCmd, undoCmd);
+            if (n <= 0)
+            {
+                ::close(fd);
+                ::unlink(temporary.c_str());
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        bool ok = (!sync || ::fsync(fd) == 0);
+        ok = ::close(fd) == 0 && ok;
+        ok = ok && ::rename(temporary.c_str(), path.c_str()) == 0;
+        if (ok && sync)
+        {
+            syncPath(directoryOf(path), O_RDONLY | O_DIRECTORY);
+        }
+        return ok;
     }
 
-    void updateServingsInLog(const string &date, int index, int newServings)
+    // Serializes into the back buffer and writes it unless nothing changed
+    void process(const string &path, FileState &file, const Serializer &serialize, [[maybe_unused]] PerfCounter bytesCounter, bool sync)
     {
-        if (logData[date].is_null() || index < 0 || index >= logData[date].size())
+        PERF_SCOPE(BackgroundWrite);
+        TRACE_SPAN("backgroundWrite", "io");
+        string &back = file.buffers[1 - file.front];
+        back.clear();
+        serialize(back);
+
+        if (file.written && back == file.buffers[file.front])
         {
-            cout << "Invalid entry index!\n";
+            PERF_ADD(WritesSkipped, 1);
             return;
         }
-
-        // Store the old servings for undo functionality
-        int oldServings = logData[date][index]["servings"];
-        
-        // Create the do command
-        auto doCmd = [this, date, index, newServings]()
-        {
-            logData[date][index]["servings"] = newServings;
-            saveLog();
-        };
-
-        // Create the undo command
-        auto undoCmd = [this, date, index, oldServings]()
+        if (!writeFile(path, back, sync))
         {
-            logData[date][index]["servings"] = oldServings;
-            saveLog();
-        };
-
-        commandManager.executeCommand(doCmd, undoCmd);
+            cerr << "Could not write " << path << ": " << strerror(errno) << "\n";
+            return;
+        }
+        PERF_ADD_DYNAMIC(bytesCounter, back.size());
+        file.front = 1 - file.front;
+        file.written = true;
+        file.unsynced = !sync;
     }
 
-    void removeFoodFromLog()
+    void run()
     {
-        // string date = userProfile.getDate();
-        // json dailyLog = foodLog.viewDailyLog(date);
+        TraceRecorder::instance().setThreadName("writer");
+        unique_lock<mutex> guard(lock);
+        while (true)
+        {
+            wake.wait(guard, [this]() { return stopping || pendingCount > 0; });
+            if (pendingCount == 0)
+            {
+                break; // stopping with nothing left to write
+            }
+            // Let more saves pile up until the window closes or someone flushes
+            wake.wait_until(guard, deadline, [this]() { return flushRequested || stopping; });
 
-        // if (dailyLog.is_null() || dailyLog.empty())
-        // {
-        //     cout << "No food entries for " << date << "\n";
-        //     return;
-        // }
-
-        // // Display the food log with numbers
-        // cout << "\n===== Food Log for " << date << " =====\n";
-        // for (int i = 0; i < dailyLog.size(); i++)
-        // {
-        //     string foodName = dailyLog[i]["name"];
-        //     int servings = dailyLog[i]["servings"];
-        //     cout << (i + 1) << ". " << foodName << " (" << servings << " servings)\n";
-        // }
-
-        // // Ask for selection
-        // int selection;
-        // cout << "\nSelect entry to remove (enter number): ";
-        // while (!(cin >> selection) || selection < 1 || selection > dailyLog.size())
-        // {
-        //     cin.clear();
-        //     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        //     cout << "Invalid input! Enter a number between 1 and " << dailyLog.size() << ": ";
-        // }
-        // cin.ignore();
-
-        // // Convert to zero-based index
-        // int arrayIndex = selection - 1;
+            vector<tuple<const string *, FileState *, Serializer, PerfCounter>> jobs;
+            for (auto &[path, file] : files)
+            {
+                if (file.pending)
+                {
+                    jobs.emplace_back(&path, &file, move(file.pending), file.bytesCounter);
+                    file.pending = nullptr;
+                }
+            }
+            pendingCount = 0;
+            busy = true;
+            bool sync = policy == SyncPolicy::Always;
+            guard.unlock();
 
-        // // Get the selected food entry
-        // string foodName = dailyLog[arrayIndex]["name"];
-        // int currentServings = dailyLog[arrayIndex]["servings"];
+            for (auto &[path, file, serialize, bytesCounter] : jobs)
+            {
+                process(*path, *file, serialize, bytesCounter, sync);
+            }
 
-        // // Ask for the number of servings to remove
-        // int servingsToRemove;
-        // cout << "Enter the number of servings to remove: ";
-        // while (!(cin >> servingsToRemove) || servingsToRemove <= 0)
-        // {
-        //     cin.clear();
-        //     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        //     cout << "Invalid input! Enter a positive number: ";
-        // }
-        // cin.ignore();
+            guard.lock();
+            busy = false;
+            idle.notify_all();
+        }
+    }
 
-        // // Check if the servings to remove exceed the current servings
-        // if (servingsToRemove > currentServings)
-        // {
-        //     cout << "Error: Cannot remove more servings than currently present (" << currentServings << " servings).\n";
-        //     return;
-        // }
+public:
+    static BackgroundWriter &instance()
+    {
+        static BackgroundWriter writer;
+        return writer;
+    }
 
-        // // Update the servings in the log
-        // if (servingsToRemove == currentServings)
-        // {
-        //     // Remove the entry completely if all servings are removed
-        //     foodLog.removeFoodFromLogByIndex(date, arrayIndex);
-        //     cout << "Entry removed successfully.\n";
-        // }
-        // else
-        // {
-        //     // Update the servings in the log
-        //     dailyLog[arrayIndex]["servings"] = currentServings - servingsToRemove;
-        //     foodLog.saveLog();
-        //     cout << "Updated servings for " << foodName << " to " << (currentServings - servingsToRemove) << " servings.\n";
-        // }
+    ~BackgroundWriter()
+    {
+        stop();
+    }
 
-        // // Update the servings in the database
-        // json allFoods = foodDb.getAllFoods();
-        // if (allFoods["basic"].contains(foodName))
-        // {
-        //     // Update servings in the basic food category
-        //     allFoods["basic"][foodName]["servings"] = currentServings - servingsToRemove;
-        // }
-        // else if (allFoods["composite"].contains(foodName))
-        // {
-        //     // Update servings in the composite food category
-        //     allFoods["composite"][foodName]["servings"] = currentServings - servingsToRemove;
-        // }
-        // foodDb.saveDatabase();
+    void configure(chrono::milliseconds coalesceWindow, SyncPolicy syncPolicy)
+    {
+        lock_guard<mutex> guard(lock);
+        window = coalesceWindow;
+        policy = syncPolicy;
     }
 
-    void removeFoodFromLogByIndex(const string &date, int index)
+    // Queues a save; a newer job for the same file replaces one still waiting
+    void submit(const string &path, PerfCounter bytesCounter, Serializer serialize)
     {
-        if (logData[date].is_null() || index < 0 || index >= logData[date].size())
+        lock_guard<mutex> guard(lock);
+        if (!worker.joinable())
         {
-            cout << "Invalid entry index!\n";
-            return;
+            stopping = false;
+            worker = thread(&BackgroundWriter::run, this);
+        }
+        FileState &file = files[path];
+        if (file.pending)
+        {
+            PERF_ADD(SavesCoalesced, 1);
+        }
+        else
+        {
+            if (pendingCount == 0)
+            {
+                deadline = chrono::steady_clock::now() + window;
+            }
+            pendingCount++;
         }
+        file.pending = move(serialize);
+        file.bytesCounter = bytesCounter;
+        wake.notify_one();
+    }
 
-        // Store the entry for undo functionality
-        json entryToRemove = logData[date][index];
+    // Waits until every queued save is on disk. A durable flush also fsyncs
+    // files written since the last one, unless the policy is Never.
+    void flush(bool durable = false)
+    {
+        unique_lock<mutex> guard(lock);
+        flushRequested = true;
+        wake.notify_one();
+        idle.wait(guard, [this]() { return pendingCount == 0 && !busy; });
+        flushRequested = false;
 
-        // Create the do command
-        auto doCmd = [this, date, index]()
+        if (durable && policy != SyncPolicy::Never)
         {
-            logData[date].erase(logData[date].begin() + index);
-            saveLog();
-        };
+            TRACE_SPAN("durableFlush", "io");
+            set<string> directories;
+            for (auto &[path, file] : files)
+            {
+                if (file.unsynced)
+                {
+                    if (!syncPath(path, O_RDONLY))
+                    {
+                        cerr << "Could not sync " << path << ": " << strerror(errno) << "\n";
+                    }
+                    directories.insert(directoryOf(path));
+                    file.unsynced = false;
+                }
+            }
+            for (const auto &directory : directories)
+            {
+                syncPath(directory, O_RDONLY | O_DIRECTORY);
+            }
+        }
+    }
 
-        // Create the undo command
-        auto undoCmd = [this, date, index, entryToRemove]()
+    // Writes what is queued and joins the thread; a later submit restarts it
+    void stop()
+    {
         {
-            if (logData[date].is_null())
+            lock_guard<mutex> guard(lock);
+            if (!worker.joinable())
             {
-                logData[date] = json::array();
+                return;
             }
-            // Insert back at the same position
-            logData[date].insert(logData[date].begin() + index, entryToRemove);
-            saveLog();
-        };
-
-        commandManager.executeCommand(doCmd, undoCmd);
+            stopping = true;
+            wake.notify_one();
+        }
+        worker.join();
     }
 
-    json viewDailyLog(const string &date)
+    static bool parsePolicy(const string &name, SyncPolicy &result)
     {
-        return logData[date];
+        static const pair<const char *, SyncPolicy> names[] = {
+            {"never", SyncPolicy::Never}, {"exit", SyncPolicy::OnExit}, {"always", SyncPolicy::Always}};
+        for (const auto &[text, value] : names)
+        {
+            if (name == text)
+            {
+                result = value;
+                return true;
+            }
+        }
+        return false;
     }
+};
 
-    void undo()
+// Forward declarations
+class DietCalculator;
+
+// Runs a block with a store's saves held back, then saves once if any were
+// requested. Used by transactions and compound undo/redo steps so a batch
+// of mutations is persisted a single time.
+class DeferredSave
+{
+private:
+    function<void()> save;
+    int depth = 0;
+    bool requested = false;
+
+public:
+    explicit DeferredSave(function<void()> saveNow) : save(move(saveNow)) {}
+
+    // Called at the top of a save; true means "not now, it has been noted"
+    bool defer()
     {
-        commandManager.undo();
+        if (depth > 0)
+        {
+            requested = true;
+            return true;
+        }
+        return false;
     }
 
-    void redo()
+    void hold()
     {
-        commandManager.redo();
+        depth++;
     }
 
-    int getDailyCalories(const string &date)
+    // Ends a hold; the outermost one saves unless told to drop the request
+    void release(bool saveRequested = true)
     {
-        int totalCalories = 0;
-
-        if (!logData[date].is_null())
+        if (--depth == 0)
         {
-            for (const auto &entry : logData[date])
+            bool run = requested && saveRequested;
+            requested = false;
+            if (run)
             {
-                int servings = entry["servings"].get<int>();
-                int calories = entry["details"]["calories"].get<int>();
-                totalCalories += servings * calories;
+                save();
             }
         }
+    }
 
-        return totalCalories;
+    void around(const function<void()> &body)
+    {
+        hold();
+        try
+        {
+            body();
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+        release();
     }
 };
 
-class DietManagerApp
+class CommandManager
 {
 private:
-    FoodDatabase foodDb;
-    DailyFoodLog foodLog;
-    UserProfile userProfile;
-    shared_ptr<DietCalculator> calculator;
-    string calculatorType;
+    struct Command
+    {
+        function<void()> apply;
+        function<void()> revert;
+    };
+
+    stack<Command> undoStack;
+    stack<Command> redoStack;
+    bool grouping = false;
+    vector<Command> group; // commands executed since beginGroup()
 
 public:
-    DietManagerApp()
-        : foodDb("food_db.json"),
-          foodLog("daily_food_log.json"),
-          userProfile("user_profile.json")
+    void executeCommand(function<void()> doCmd, function<void()> undoCmd)
     {
-        // Default to Harris-Benedict calculator
-        calculatorType = "harris-benedict";
-        calculator = DietCalculatorFactory::createCalculator(calculatorType);
-        userProfile.setCalculator(calculator);
+        doCmd();
+        if (grouping)
+        {
+            group.push_back({move(doCmd), move(undoCmd)});
+            return;
+        }
+        undoStack.push({move(doCmd), move(undoCmd)});
+        redoStack = stack<Command>(); // Clear redo stack when a new command is executed
     }
 
-    ~DietManagerApp()
+    // Collects the commands executed from now on into one undo/redo step
+    void beginGroup()
     {
-        // Save everything on exit
-        foodDb.saveDatabase();
-        // DailyFoodLog and UserProfile save in their destructors
+        if (grouping)
+        {
+            throw logic_error("a transaction is already open");
+        }
+        grouping = true;
+        group.clear();
     }
 
-    void run()
+    // Closes the group as a single step. `around` wraps every replay of the
+    // step's commands, e.g. to hold back saves until all of them have run.
+    void commitGroup(function<void(const function<void()> &)> around)
     {
-        int choice;
+        if (!grouping)
+        {
+            throw logic_error("no transaction is open");
+        }
+        grouping = false;
+        if (group.empty())
+        {
+            return;
+        }
 
-        // Check if user profile exists
-        ifstream profileCheck("user_profile.json");
-        if (!profileCheck.good())
+        auto commands = make_shared<vector<Command>>(move(group));
+        group.clear();
+        Command step;
+        step.apply = [commands, around]()
         {
-            cout << "Welcome to Diet Manager! Let's set up your profile.\n";
-            userProfile.setupProfile();
+            around([&]() {
+                for (const auto &command : *commands)
+                    command.apply();
+            });
+        };
+        step.revert = [commands, around]()
+        {
+            around([&]() {
+                for (auto it = commands->rbegin(); it != commands->rend(); ++it)
+                    it->revert();
+            });
+        };
+        undoStack.push(move(step));
+        redoStack = stack<Command>();
+    }
+
+    // Reverts everything executed since beginGroup(), newest first
+    void abortGroup()
+    {
+        if (!grouping)
+        {
+            throw logic_error("no transaction is open");
         }
-        profileCheck.close();
+        grouping = false;
+        for (auto it = group.rbegin(); it != group.rend(); ++it)
+        {
+            it->revert();
+        }
+        group.clear();
+    }
 
-        do
+    bool inGroup() const { return grouping; }
+    bool canUndo() const { return !undoStack.empty(); }
+    bool canRedo() const { return !redoStack.empty(); }
+
+    void undo()
+    {
+        PERF_SCOPE(Undo);
+        TRACE_SPAN("undo", "command");
+        if (canUndo())
         {
-            displayMainMenu();
-            while (!(cin >> choice))
-            {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Please enter a number: ";
-            }
-            cin.ignore();
+            Command command = undoStack.top();
+            undoStack.pop();
 
-            processMenuChoice(choice);
-        } while (choice != 0);
+            // Keep it so redo can apply it again
+            redoStack.push(command);
+            command.revert();
+        }
+        else
+        {
+            cout << "Nothing to undo.\n";
+        }
     }
 
-private:
-void displayMainMenu()
+    void redo()
+    {
+        PERF_SCOPE(Redo);
+        TRACE_SPAN("redo", "command");
+        if (canRedo())
+        {
+            Command command = redoStack.top();
+            redoStack.pop();
+
+            // Push it back onto the undo stack
+            undoStack.push(command);
+            command.apply();
+        }
+        else
+        {
+            cout << "Nothing to redo.\n";
+        }
+    }
+
+    void clear()
+    {
+        undoStack = stack<Command>();
+        redoStack = stack<Command>();
+        grouping = false;
+        group.clear();
+    }
+};
+
+// Class to store user profile information
+class UserProfile
 {
-    cout << "\n===== Diet Manager Application =====\n";
-    cout << left << setw(5) << "1." << "Add Basic Food\n";
-    cout << left << setw(5) << "2." << "Add Composite Food\n";
-    cout << left << setw(5) << "3." << "View All Foods\n";
-    cout << left << setw(5) << "4." << "Add Food to Daily Log\n";
-    cout << left << setw(5) << "5." << "View Daily Food Log\n";
-    cout << left << setw(5) << "6." << "Remove Food from Log\n";
-    cout << left << setw(5) << "7." << "Update Profile Information\n";
-    cout << left << setw(5) << "8." << "Change Calorie Calculation Method\n";
-    cout << left << setw(5) << "9." << "View Calorie Summary\n";
-    cout << left << setw(5) << "10." << "Set Date\n";
-    cout << left << setw(5) << "11." << "Undo Last Action\n";
-    cout << left << setw(5) << "12." << "Redo Last Action\n";
-    cout << left << setw(5) << "13." << "Save Database\n";
-    cout << left << setw(5) << "0." << "Exit\n";
-    cout << "Enter your choice: ";
+private:
+    string profileFilename;
+    json profileData;
+    json dietGoals;
+    string currentDate;
+    shared_ptr<DietCalculator> calculator;
+
+public:
+    UserProfile(const string &filename = "user_profile.json")
+        : profileFilename(filename)
+    {
+        loadProfile();
+        currentDate = getCurrentDate();
+    }
+
+    ~UserProfile()
+    {
+        saveProfile();
+    }
+
+    void loadProfile()
+    {
+        TRACE_SPAN("loadProfile", "io");
+        FastJson::Buffer buffer;
+        if (FastJson::readFile(profileFilename, buffer))
+        {
+            JsonDomBuilder builder(profileData);
+            string error;
+            if (!FastJson::parse(buffer, builder, error) || !validateSchema(profileData, error))
+            {
+                throw runtime_error(profileFilename + ": " + error);
+            }
+        }
+        else
+        {
+            // Initialize with default values
+            profileData = {
+                {"gender", ""},
+                {"height", 0},
+                {"dailyData", json::object()}};
+        }
+    }
+
+    // Checks the types of the fields the calculators read
+    static bool validateSchema(const json &data, string &error)
+    {
+        if (!data.is_object())
+        {
+            error = "profile must be a JSON object";
+            return false;
+        }
+        if (data.contains("gender") && !data["gender"].is_string())
+        {
+            error = "'gender' must be a string";
+            return false;
+        }
+        if (data.contains("height") && !data["height"].is_number())
+        {
+            error = "'height' must be a number";
+            return false;
+        }
+        if (!data.contains("dailyData"))
+        {
+            return true;
+        }
+        if (!data["dailyData"].is_object())
+        {
+            error = "'dailyData' must be an object of dates";
+            return false;
+        }
+        for (const auto &[date, day] : data["dailyData"].items())
+        {
+            if (!day.is_object() ||
+                (day.contains("age") && !day["age"].is_number()) ||
+                (day.contains("weight") && !day["weight"].is_number()) ||
+                (day.contains("activityLevel") && !day["activityLevel"].is_string()))
+            {
+                error = "dailyData for " + date + " must have numeric 'age'/'weight' and a string 'activityLevel'";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void saveProfile()
+    {
+        TRACE_SPAN("saveProfile", "io");
+        ofstream profileFile(profileFilename);
+        if (profileFile.is_open())
+        {
+            profileFile << profileData.dump(4);
+            profileFile.close();
+        }
+    }
+
+    string getCurrentDate()
+    {
+        time_t now = time(0);
+        tm *ltm = localtime(&now);
+
+        stringstream ss;
+        ss << 1900 + ltm->tm_year << '-'
+           << setw(2) << setfill('0') << 1 + ltm->tm_mon << '-'
+           << setw(2) << setfill('0') << ltm->tm_mday;
+        return ss.str();
+    }
+
+    void setDate(const string &date)
+    {
+        currentDate = date;
+    }
+
+    string getDate() const
+    {
+        return currentDate;
+    }
+
+    void setupProfile()
+    {
+        string gender;
+        int height;
+
+        cout << "Enter your gender (M/F): ";
+        cin >> gender;
+        transform(gender.begin(), gender.end(), gender.begin(), ::toupper);
+
+        cout << "Enter your height in cm: ";
+        while (!(cin >> height) || height <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+
+        profileData["gender"] = gender;
+        profileData["height"] = height;
+
+        updateDailyData();
+        saveProfile();
+    }
+
+    void updateDailyData()
+    {
+        int age, weight;
+        string activityLevel;
+
+        cout << "Enter your age: ";
+        while (!(cin >> age) || age <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+
+        cout << "Enter your weight in kg: ";
+        while (!(cin >> weight) || weight <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+
+        cin.ignore();
+        cout << "Enter your activity level (sedentary/light/moderate/active/very active): ";
+        getline(cin, activityLevel);
+        transform(activityLevel.begin(), activityLevel.end(), activityLevel.begin(), ::tolower);
+
+        // Store today's data
+        profileData["dailyData"][currentDate] = {
+            {"age", age},
+            {"weight", weight},
+            {"activityLevel", activityLevel}};
+
+        saveProfile();
+    }
+
+    // The profile for the current date, pointing into the loaded profile
+    // rather than copied out of it; valid until the profile is next updated
+    struct DailyData
+    {
+        string_view gender;
+        int height = 0;
+        int age = 0;
+        int weight = 0;
+        string_view activityLevel;
+    };
+
+    // Gives the current date profile data if it has none: a copy of the most
+    // recent date's, or what the user enters when there is no earlier day
+    void startDailyData()
+    {
+        json &dailyData = profileData["dailyData"];
+        if (dailyData.contains(currentDate))
+        {
+            return;
+        }
+
+        const json *latest = mostRecentData();
+        if (latest)
+        {
+            dailyData[currentDate] = *latest;
+            saveProfile();
+        }
+        else
+        {
+            cout << "No profile data found for " << currentDate << ". Please update your information.\n";
+            updateDailyData();
+        }
+    }
+
+    // Reads the current date's data, or the most recent date's when
+    // startDailyData has not been called for it; never changes the profile
+    DailyData getDailyData() const
+    {
+        static const json none = json::object();
+        const json *today = &none;
+        auto dailyData = profileData.find("dailyData");
+        if (dailyData != profileData.end())
+        {
+            auto found = dailyData->find(currentDate);
+            today = found != dailyData->end() ? &*found : mostRecentData();
+            today = today ? today : &none;
+        }
+
+        DailyData data;
+        data.gender = stringField(profileData, "gender");
+        data.height = intField(profileData, "height");
+        data.age = intField(*today, "age");
+        data.weight = intField(*today, "weight");
+        data.activityLevel = stringField(*today, "activityLevel");
+        return data;
+    }
+
+    void setCalculator(shared_ptr<DietCalculator> calc)
+    {
+        calculator = calc;
+    }
+
+    int calculateDailyCalorieTarget() const;
+
+private:
+    // The data of the latest date in the profile, or null if there is none;
+    // the object keeps its keys sorted and YYYY-MM-DD dates sort as text
+    const json *mostRecentData() const
+    {
+        auto dailyData = profileData.find("dailyData");
+        if (dailyData == profileData.end() || dailyData->empty())
+        {
+            return nullptr;
+        }
+        return &dailyData->back();
+    }
+
+    static string_view stringField(const json &object, const char *key)
+    {
+        auto it = object.find(key);
+        return it != object.end() && it->is_string() ? string_view(it->get_ref<const string &>()) : string_view();
+    }
+
+    static int intField(const json &object, const char *key)
+    {
+        auto it = object.find(key);
+        return it != object.end() && it->is_number() ? it->get<int>() : 0;
+    }
+};
+
+// Interface for different diet calculation methods
+class DietCalculator
+{
+public:
+    virtual ~DietCalculator() = default;
+    virtual int calculateCalories(string_view gender, int height, int age, int weight, string_view activityLevel) = 0;
+    virtual string getName() const = 0;
+};
+
+int UserProfile::calculateDailyCalorieTarget() const
+{
+    PERF_SCOPE(CalorieTarget);
+    TRACE_SPAN("calculateDailyCalorieTarget", "calc");
+    if (!calculator)
+    {
+        return 0;
+    }
+
+    DailyData data = getDailyData();
+    return calculator->calculateCalories(
+        data.gender,
+        data.height,
+        data.age,
+        data.weight,
+        data.activityLevel);
 }
 
-    void processMenuChoice(int choice)
+// Harris-Benedict Equation for calculating daily calorie needs
+class HarrisBenedictCalculator : public DietCalculator
+{
+public:
+    int calculateCalories(string_view gender, int height, int age, int weight, string_view activityLevel) override
+    {
+        double bmr = 0;
+
+        // Calculate BMR
+        if (gender == "M")
+        {
+            bmr = 88.362 + (13.397 * weight) + (4.799 * height) - (5.677 * age);
+        }
+        else
+        { // Female
+            bmr = 447.593 + (9.247 * weight) + (3.098 * height) - (4.330 * age);
+        }
+
+        // Apply activity multiplier
+        double activityMultiplier = 1.2; // Default to sedentary
+
+        if (activityLevel == "sedentary")
+        {
+            activityMultiplier = 1.2;
+        }
+        else if (activityLevel == "light")
+        {
+            activityMultiplier = 1.375;
+        }
+        else if (activityLevel == "moderate")
+        {
+            activityMultiplier = 1.55;
+        }
+        else if (activityLevel == "active")
+        {
+            activityMultiplier = 1.725;
+        }
+        else if (activityLevel == "very active")
+        {
+            activityMultiplier = 1.9;
+        }
+
+        return static_cast<int>(bmr * activityMultiplier);
+    }
+
+    string getName() const override
+    {
+        return "Harris-Benedict Equation";
+    }
+};
+
+// Mifflin-St Jeor Equation for calculating daily calorie needs
+class MifflinStJeorCalculator : public DietCalculator
+{
+public:
+    int calculateCalories(string_view gender, int height, int age, int weight, string_view activityLevel) override
+    {
+        double bmr = 0;
+
+        // Calculate BMR
+        if (gender == "M")
+        {
+            bmr = (10 * weight) + (6.25 * height) - (5 * age) + 5;
+        }
+        else
+        { // Female
+            bmr = (10 * weight) + (6.25 * height) - (5 * age) - 161;
+        }
+
+        // Apply activity multiplier
+        double activityMultiplier = 1.2; // Default to sedentary
+
+        if (activityLevel == "sedentary")
+        {
+            activityMultiplier = 1.2;
+        }
+        else if (activityLevel == "light")
+        {
+            activityMultiplier = 1.375;
+        }
+        else if (activityLevel == "moderate")
+        {
+            activityMultiplier = 1.55;
+        }
+        else if (activityLevel == "active")
+        {
+            activityMultiplier = 1.725;
+        }
+        else if (activityLevel == "very active")
+        {
+            activityMultiplier = 1.9;
+        }
+
+        return static_cast<int>(bmr * activityMultiplier);
+    }
+
+    string getName() const override
+    {
+        return "Mifflin-St Jeor Equation";
+    }
+};
+
+// Factory for creating diet calculators
+class DietCalculatorFactory
+{
+public:
+    static shared_ptr<DietCalculator> createCalculator(const string &type)
+    {
+        if (type == "harris-benedict")
+        {
+            return make_shared<HarrisBenedictCalculator>();
+        }
+        else if (type == "mifflin-st-jeor")
+        {
+            return make_shared<MifflinStJeorCalculator>();
+        }
+
+        // Default to Harris-Benedict
+        return make_shared<HarrisBenedictCalculator>();
+    }
+
+    static vector<string> getAvailableCalculators()
+    {
+        return {"harris-benedict", "mifflin-st-jeor"};
+    }
+};
+
+// Bump allocator for string bytes. Strings are copied back to back into
+// 64 KiB blocks and never move, so views into the arena stay valid for its
+// whole lifetime and a catalog's names cost a few large allocations.
+class StringArena
+{
+private:
+    static constexpr size_t BlockSize = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks;
+    size_t used = BlockSize;
+    size_t reserved = 0;
+
+public:
+    string_view store(string_view text)
+    {
+        if (text.empty())
+        {
+            return {};
+        }
+        if (text.size() > BlockSize / 4)
+        {
+            // Oversized strings get a block of their own
+            blocks.push_back(make_unique<char[]>(text.size()));
+            reserved += text.size();
+            memcpy(blocks.back().get(), text.data(), text.size());
+            string_view stored(blocks.back().get(), text.size());
+            if (blocks.size() > 1)
+            {
+                swap(blocks.back(), blocks[blocks.size() - 2]); // keep the open block last
+            }
+            return stored;
+        }
+
+        if (used + text.size() > BlockSize)
+        {
+            blocks.push_back(make_unique<char[]>(BlockSize));
+            reserved += BlockSize;
+            used = 0;
+        }
+        char *destination = blocks.back().get() + used;
+        memcpy(destination, text.data(), text.size());
+        used += text.size();
+        return string_view(destination, text.size());
+    }
+
+    size_t bytesReserved() const
+    {
+        return reserved;
+    }
+};
+
+// Assigns dense 32-bit IDs to strings so records can refer to names and
+// keywords by integer instead of carrying their own copies. Nothing is ever
+// removed, so the ID table and hash nodes come from a monotonic resource.
+// The catalog and the food log share global(), so a food's name, keywords
+// and ingredients have the same IDs in both and are stored once.
+class StringInterner
+{
+private:
+    pmr::monotonic_buffer_resource memory;
+    StringArena arena;
+    pmr::vector<string_view> views{&memory}; // ID -> bytes in the arena
+    pmr::unordered_map<string_view, uint32_t> ids{&memory};
+
+public:
+    static constexpr uint32_t npos = numeric_limits<uint32_t>::max();
+
+    static StringInterner &global()
+    {
+        static StringInterner interner;
+        return interner;
+    }
+
+    uint32_t intern(string_view text)
+    {
+        auto it = ids.find(text);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(views.size());
+        views.push_back(arena.store(text));
+        ids.emplace(views.back(), id);
+        return id;
+    }
+
+    uint32_t find(string_view text) const
+    {
+        auto it = ids.find(text);
+        return it == ids.end() ? npos : it->second;
+    }
+
+    // Copies text into the arena without giving it an ID, for one-off strings
+    string_view copy(string_view text)
+    {
+        return arena.store(text);
+    }
+
+    string_view str(uint32_t id) const
+    {
+        return views[id];
+    }
+
+    const pmr::vector<string_view> &all() const
+    {
+        return views;
+    }
+
+    size_t size() const
+    {
+        return views.size();
+    }
+
+    // Arena blocks plus an estimate of the ID table and hash index: a view,
+    // a hash node and a bucket pointer per string, ignoring spare capacity
+    size_t footprint() const
+    {
+        size_t perString = sizeof(string_view) + sizeof(pair<const string_view, uint32_t>) + 3 * sizeof(void *);
+        return arena.bytesReserved() + views.size() * perString;
+    }
+};
+
+// Tally of the strings a store refers to, for the memory report
+struct StringReferences
+{
+    size_t count = 0;
+    size_t unsharedBytes = 0; // if every reference carried its own std::string
+
+    void add(string_view text)
+    {
+        // libstdc++ keeps up to 15 characters inside the string object itself
+        count++;
+        unsharedBytes += sizeof(string) + (text.size() > 15 ? text.size() + 1 : 0);
+    }
+};
+
+// Nutrients per serving besides calories, as one fixed-width vector of
+// floats. Amounts are kept to hundredths; the order is alphabetical, which is
+// how JSON objects list them. Totals over ingredients or log entries add up
+// whole vectors scaled by servings, two SSE2 multiply-adds at a time where
+// available. A food without nutrient data has all zeros and writes nothing.
+struct Nutrients
+{
+    static constexpr size_t Count = 8;
+    static constexpr const char *names[Count] = {"carbs", "cholesterol", "fat", "fiber",
+                                                 "protein", "saturatedFat", "sodium", "sugar"};
+    static constexpr const char *units[Count] = {"g", "mg", "g", "g", "g", "g", "mg", "g"};
+
+    alignas(16) float amounts[Count] = {};
+
+    // Position of a nutrient name, or -1
+    static int indexOf(string_view name)
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            if (name == names[i])
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    static float round(double amount)
+    {
+        return static_cast<float>(std::round(amount * 100) / 100);
+    }
+
+    // An amount as written out, rounded to hundredths
+    static double written(float amount)
+    {
+        return std::round(static_cast<double>(amount) * 100) / 100;
+    }
+
+    float &operator[](size_t i) { return amounts[i]; }
+    float operator[](size_t i) const { return amounts[i]; }
+
+    bool empty() const
+    {
+        for (float amount : amounts)
+        {
+            if (written(amount) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // this += other * servings
+    void addScaled(const Nutrients &other, float servings)
+    {
+#if defined(__SSE2__)
+        __m128 factor = _mm_set1_ps(servings);
+        for (size_t i = 0; i < Count; i += 4)
+        {
+            __m128 sum = _mm_add_ps(_mm_load_ps(amounts + i), _mm_mul_ps(_mm_load_ps(other.amounts + i), factor));
+            _mm_store_ps(amounts + i, sum);
+        }
+#else
+        for (size_t i = 0; i < Count; i++)
+        {
+            amounts[i] += other.amounts[i] * servings;
+        }
+#endif
+    }
+
+    // The non-zero amounts as a "nutrients" member, merged in key order with
+    // kept members of it that this version does not know; nothing if neither
+    void write(JsonWriter &writer, const json &unknown = json::object()) const
+    {
+        if (empty() && unknown.empty())
+        {
+            return;
+        }
+        writer.key("nutrients");
+        writer.beginObject();
+        auto member = unknown.begin();
+        for (size_t i = 0; i < Count; i++)
+        {
+            if (written(amounts[i]) != 0)
+            {
+                writer.membersBefore(member, unknown.end(), names[i]);
+                writer.key(names[i]);
+                writer.decimal(written(amounts[i]));
+            }
+        }
+        writer.membersBefore(member, unknown.end(), {});
+        writer.endObject();
+    }
+
+    void addTo(json &details) const
+    {
+        if (empty())
+        {
+            return;
+        }
+        json &object = details["nutrients"] = json::object();
+        for (size_t i = 0; i < Count; i++)
+        {
+            if (written(amounts[i]) != 0)
+            {
+                object[names[i]] = written(amounts[i]);
+            }
+        }
+    }
+
+    // Whether an amount can be stored; the binary log keeps it as unsigned hundredths
+    static bool validAmount(double value) { return value >= 0 && value <= 1e6; }
+
+    // Parses "protein=3.5 fat=1" (commas also separate); false with a message if malformed
+    static bool parse(string_view text, Nutrients &result, string &error)
+    {
+        result = {};
+        size_t pos = 0;
+        while (true)
+        {
+            pos = text.find_first_not_of(" ,\t", pos);
+            if (pos == string_view::npos)
+            {
+                return true;
+            }
+            size_t end = min(text.find_first_of(" ,\t", pos), text.size());
+            string_view item = text.substr(pos, end - pos);
+            pos = end;
+
+            size_t equals = item.find('=');
+            int index = indexOf(item.substr(0, equals));
+            if (equals == string_view::npos || index < 0)
+            {
+                error = "'" + string(item) + "' is not nutrient=amount with a known nutrient";
+                return false;
+            }
+            string amount(item.substr(equals + 1));
+            char *parsed = nullptr;
+            double value = strtod(amount.c_str(), &parsed);
+            if (amount.empty() || parsed != amount.c_str() + amount.size() || !validAmount(value))
+            {
+                error = "'" + string(item) + "' needs a non-negative amount";
+                return false;
+            }
+            result[index] = round(value);
+        }
+    }
+
+    // Reads a "nutrients" object; unknown names and amounts out of range are ignored
+    static Nutrients fromJson(const json &details)
+    {
+        Nutrients result;
+        auto it = details.find("nutrients");
+        if (it != details.end() && it->is_object())
+        {
+            for (const auto &[name, amount] : it->items())
+            {
+                int index = indexOf(name);
+                if (index >= 0 && amount.is_number() && validAmount(amount.get<double>()))
+                {
+                    result[index] = round(amount.get<double>());
+                }
+            }
+        }
+        return result;
+    }
+};
+
+// Typed in-memory form of one food_db.json entry
+struct FoodRecord
+{
+    uint32_t name = StringInterner::npos;
+    bool composite = false;
+    vector<uint32_t> keywords;
+    int calories = 0;
+    vector<pair<uint32_t, int>> ingredients; // (ingredient name ID, servings)
+    Nutrients nutrients;
+};
+
+// SAX handler for nlohmann::json::sax_parse that turns food_db.json straight
+// into FoodRecords without building a DOM. Each record is handed to the sink
+// as soon as its object closes and the buffers are reused for the next one.
+// Members the loader does not know about are skipped, anything with the
+// wrong type is reported as an error.
+class FoodRecordSax
+{
+public:
+    using Sink = function<void(const FoodRecord &)>;
+    size_t recordCount = 0;
+    std::string error;
+
+private:
+    StringInterner &strings;
+    Sink sink;
+    int depth = 0;
+    int skipDepth = 0;   // > 0 while inside a container that is being skipped
+    bool skipValue = false;
+    enum class Member { Other, Calories, Keywords, Ingredients, Nutrients };
+
+    std::string category;  // last key at the top level
+    Member member = Member::Other;
+    uint32_t pendingName = StringInterner::npos;       // food whose object comes next
+    uint32_t pendingIngredient = StringInterner::npos; // ingredient whose servings come next
+    int pendingNutrient = -1;                          // nutrient whose amount comes next
+    bool composite = false;
+    FoodRecord current;
+
+    bool fail(const std::string &message)
+    {
+        error = message;
+        return false;
+    }
+
+    // True when the value about to arrive should be ignored
+    bool skipping()
+    {
+        if (skipDepth > 0)
+        {
+            return true;
+        }
+        if (skipValue)
+        {
+            skipValue = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool inFood() const { return depth == 3; }
+    bool inKeywords() const { return depth == 4 && member == Member::Keywords; }
+    bool inIngredients() const { return depth == 4 && member == Member::Ingredients; }
+    bool inNutrients() const { return depth == 4 && member == Member::Nutrients; }
+
+    bool number(double value)
+    {
+        if (skipping())
+            return true;
+        if (inFood() && member == Member::Calories)
+        {
+            current.calories = static_cast<int>(value);
+            return true;
+        }
+        if (inIngredients())
+        {
+            current.ingredients.emplace_back(pendingIngredient, static_cast<int>(value));
+            return true;
+        }
+        if (inNutrients())
+        {
+            if (!Nutrients::validAmount(value))
+                return fail("nutrient amount out of range in " + context());
+            current.nutrients[pendingNutrient] = Nutrients::round(value);
+            return true;
+        }
+        return fail("unexpected number in " + context());
+    }
+
+    bool scalar(const char *type)
+    {
+        if (skipping())
+            return true;
+        return fail(std::string("unexpected ") + type + " in " + context());
+    }
+
+    std::string context() const
+    {
+        if (depth < 2)
+            return "food database";
+        if (depth == 2)
+            return "'" + category + "'";
+        return "food '" + std::string(strings.str(current.name)) + "'";
+    }
+
+public:
+    FoodRecordSax(StringInterner &interner, Sink onRecord) : strings(interner), sink(move(onRecord)) {}
+
+    bool null() { return scalar("null"); }
+    bool boolean(bool) { return scalar("boolean"); }
+    bool number_integer(json::number_integer_t value) { return number(static_cast<double>(value)); }
+    bool number_unsigned(json::number_unsigned_t value) { return number(static_cast<double>(value)); }
+    bool number_float(json::number_float_t value, const std::string &) { return number(value); }
+    bool binary(json::binary_t &) { return scalar("binary value"); }
+
+    bool string(std::string &value)
+    {
+        if (skipping())
+            return true;
+        if (inKeywords())
+        {
+            current.keywords.push_back(strings.intern(value));
+            return true;
+        }
+        return fail("unexpected string '" + value + "' in " + context());
+    }
+
+    bool key(std::string &value)
+    {
+        if (skipDepth > 0)
+        {
+            return true;
+        }
+
+        // Only these members are understood; skip everything else
+        switch (depth)
+        {
+        case 1:
+            category = value;
+            skipValue = value != "basic" && value != "composite";
+            break;
+        case 2:
+            pendingName = strings.intern(value);
+            break;
+        case 3:
+            member = value == "calories" ? Member::Calories
+                     : value == "keywords" ? Member::Keywords
+                     : value == "ingredients" ? Member::Ingredients
+                     : value == "nutrients" ? Member::Nutrients
+                                              : Member::Other;
+            skipValue = member == Member::Other;
+            break;
+        default:
+            if (member == Member::Nutrients)
+            {
+                pendingNutrient = Nutrients::indexOf(value);
+                skipValue = pendingNutrient < 0;
+            }
+            else
+            {
+                pendingIngredient = strings.intern(value);
+            }
+            break;
+        }
+        return true;
+    }
+
+    bool start_object(size_t)
+    {
+        if (skipping())
+        {
+            skipDepth++;
+            return true;
+        }
+        if (depth <= 2 || (depth == 3 && (member == Member::Ingredients || member == Member::Nutrients)))
+        {
+            depth++;
+            if (depth == 2)
+            {
+                composite = category == "composite";
+            }
+            else if (depth == 3)
+            {
+                current.keywords.clear();
+                current.ingredients.clear();
+                current.calories = 0;
+                current.nutrients = {};
+                current.name = pendingName;
+                current.composite = composite;
+            }
+            return true;
+        }
+        return fail("unexpected object in " + context());
+    }
+
+    bool end_object()
+    {
+        if (skipDepth > 0)
+        {
+            skipDepth--;
+            return true;
+        }
+        if (depth == 3)
+        {
+            sink(current);
+            recordCount++;
+        }
+        depth--;
+        return true;
+    }
+
+    bool start_array(size_t)
+    {
+        if (skipping())
+        {
+            skipDepth++;
+            return true;
+        }
+        if (depth == 3 && member == Member::Keywords)
+        {
+            depth++;
+            return true;
+        }
+        return fail(depth == 0 ? "food database must be a JSON object" : "unexpected array in " + context());
+    }
+
+    bool end_array()
+    {
+        if (skipDepth > 0)
+        {
+            skipDepth--;
+            return true;
+        }
+        depth--;
+        return true;
+    }
+
+    bool parse_error(size_t position, const std::string &, const nlohmann::detail::exception &ex)
+    {
+        return fail("syntax error at byte " + to_string(position) + ": " + ex.what());
+    }
+};
+
+// Read-only view of a contiguous run of column values
+template <typename T>
+struct ColumnRange
+{
+    const T *first;
+    const T *last;
+
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    const T &operator[](size_t i) const { return first[i]; }
+};
+
+// A column of interned string IDs seen as the strings themselves
+class InternedRange
+{
+public:
+    class iterator
+    {
+        const uint32_t *at;
+        const StringInterner *strings;
+
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = string_view;
+        using difference_type = ptrdiff_t;
+        using pointer = const string_view *;
+        using reference = string_view;
+
+        iterator(const uint32_t *at, const StringInterner *strings) : at(at), strings(strings) {}
+        string_view operator*() const { return strings->str(*at); }
+        iterator &operator++() { ++at; return *this; }
+        bool operator==(const iterator &other) const { return at == other.at; }
+        bool operator!=(const iterator &other) const { return at != other.at; }
+    };
+
+    InternedRange(ColumnRange<uint32_t> ids, const StringInterner &strings) : ids(ids), strings(&strings) {}
+    iterator begin() const { return {ids.begin(), strings}; }
+    iterator end() const { return {ids.end(), strings}; }
+    size_t size() const { return ids.size(); }
+    string_view operator[](size_t i) const { return strings->str(ids[i]); }
+
+private:
+    ColumnRange<uint32_t> ids;
+    const StringInterner *strings;
+};
+
+// Copy of everything food_db.json needs, taken on the thread that owns the
+// catalog so the background writer can serialize it while editing goes on.
+// The string views point into the interner's arena, which never moves or
+// frees bytes, so only the ID table has to be copied.
+struct CatalogSnapshot
+{
+    vector<string_view> strings; // interner ID -> text
+    vector<uint32_t> names;
+    vector<int32_t> calories;
+    vector<uint8_t> composite;
+    vector<uint32_t> keywordBegin, keywordCount, ingredientBegin, ingredientCount;
+    vector<uint32_t> keywordPool, ingredientPool;
+    vector<int32_t> servingsPool;
+    vector<Nutrients> nutrients;
+
+    // Writes the catalog exactly as getAllFoods().dump(4) would
+    void serialize(string &out) const
+    {
+        JsonWriter writer(out);
+        vector<uint32_t> order;
+        vector<pair<string_view, int32_t>> ingredients;
+        writer.beginObject();
+        for (bool category : {false, true})
+        {
+            order.clear();
+            for (uint32_t row = 0; row < names.size(); row++)
+            {
+                if (composite[row] == category)
+                {
+                    order.push_back(row);
+                }
+            }
+            sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return strings[names[a]] < strings[names[b]]; });
+
+            writer.key(category ? "composite" : "basic");
+            writer.beginObject();
+            for (uint32_t row : order)
+            {
+                writer.key(strings[names[row]]);
+                writer.beginObject();
+                writer.key("calories");
+                writer.value(calories[row]);
+                if (category)
+                {
+                    ingredients.clear();
+                    for (uint32_t i = ingredientBegin[row]; i < ingredientBegin[row] + ingredientCount[row]; i++)
+                    {
+                        ingredients.emplace_back(strings[ingredientPool[i]], servingsPool[i]);
+                    }
+                    sort(ingredients.begin(), ingredients.end());
+                    writer.key("ingredients");
+                    writer.beginObject();
+                    for (const auto &[ingredient, servings] : ingredients)
+                    {
+                        writer.key(ingredient);
+                        writer.value(servings);
+                    }
+                    writer.endObject();
+                }
+                writer.key("keywords");
+                writer.beginArray();
+                for (uint32_t i = keywordBegin[row]; i < keywordBegin[row] + keywordCount[row]; i++)
+                {
+                    writer.value(strings[keywordPool[i]]);
+                }
+                writer.endArray();
+                nutrients[row].write(writer);
+                writer.endObject();
+            }
+            writer.endObject();
+        }
+        writer.endObject();
+    }
+};
+
+// BK-tree over interned strings for typo-tolerant lookup. Each child hangs
+// off its parent by their edit distance, so by the triangle inequality a
+// search within distance k only has to descend into children whose key lies
+// within k of the query's distance to the parent, instead of comparing the
+// query with every string. Strings are only ever added; callers check that
+// what a search returns still exists.
+class FuzzyIndex
+{
+public:
+    struct Match
+    {
+        uint32_t id;
+        int distance;
+    };
+
+private:
+    static constexpr uint32_t npos = numeric_limits<uint32_t>::max();
+
+    struct Node
+    {
+        uint32_t id;
+        uint32_t distance;              // to the parent
+        uint32_t maxChild = 0;          // largest distance among the children
+        uint32_t firstChild = npos;
+        uint32_t nextSibling = npos;
+    };
+
+    vector<Node> nodes;
+    vector<bool> members; // by string ID
+    mutable vector<int> previousRow, currentRow;
+    mutable vector<uint32_t> pending;
+
+    // The string being inserted or searched for, preprocessed for Myers'
+    // bit-parallel algorithm: one bit per position of each byte value
+    mutable string_view pattern;
+    mutable uint64_t positions[256];
+
+    void prepare(string_view text) const
+    {
+        pattern = text;
+        if (text.size() <= 64)
+        {
+            memset(positions, 0, sizeof(positions));
+            for (size_t i = 0; i < text.size(); i++)
+            {
+                positions[static_cast<uint8_t>(text[i])] |= 1ULL << i;
+            }
+        }
+    }
+
+    // Levenshtein distance from the prepared pattern; above cap means "more than cap"
+    int distanceTo(string_view text, int cap) const
+    {
+        size_t m = pattern.size();
+        if (m == 0 || m > 64)
+        {
+            return distance(pattern, text, cap);
+        }
+        if (static_cast<int>(max(m, text.size()) - min(m, text.size())) > cap)
+        {
+            return cap + 1;
+        }
+        // Vertical deltas of the current DP column as +1/-1 bit vectors
+        uint64_t plus = m == 64 ? ~0ULL : (1ULL << m) - 1, minus = 0;
+        uint64_t last = 1ULL << (m - 1);
+        int score = static_cast<int>(m);
+        for (char c : text)
+        {
+            uint64_t equal = positions[static_cast<uint8_t>(c)];
+            uint64_t verticalMatch = equal | minus;
+            uint64_t horizontalMatch = (((equal & plus) + plus) ^ plus) | equal;
+            uint64_t horizontalPlus = minus | ~(horizontalMatch | plus);
+            uint64_t horizontalMinus = plus & horizontalMatch;
+            if (horizontalPlus & last)
+                score++;
+            else if (horizontalMinus & last)
+                score--;
+            // Row 0 grows by one per column
+            horizontalPlus = (horizontalPlus << 1) | 1;
+            horizontalMinus <<= 1;
+            plus = horizontalMinus | ~(verticalMatch | horizontalPlus);
+            minus = horizontalPlus & verticalMatch;
+        }
+        return score;
+    }
+
+    // Levenshtein distance by dynamic programming, for patterns Myers cannot take;
+    // anything above cap as soon as it must exceed it
+    int distance(string_view a, string_view b, int cap) const
+    {
+        if (static_cast<int>(max(a.size(), b.size()) - min(a.size(), b.size())) > cap)
+        {
+            return cap + 1;
+        }
+        previousRow.resize(b.size() + 1);
+        currentRow.resize(b.size() + 1);
+        for (size_t j = 0; j <= b.size(); j++)
+        {
+            previousRow[j] = static_cast<int>(j);
+        }
+        for (size_t i = 1; i <= a.size(); i++)
+        {
+            currentRow[0] = static_cast<int>(i);
+            int rowMinimum = currentRow[0];
+            for (size_t j = 1; j <= b.size(); j++)
+            {
+                int substitution = previousRow[j - 1] + (a[i - 1] != b[j - 1]);
+                currentRow[j] = min({previousRow[j] + 1, currentRow[j - 1] + 1, substitution});
+                rowMinimum = min(rowMinimum, currentRow[j]);
+            }
+            if (rowMinimum > cap)
+            {
+                return cap + 1;
+            }
+            swap(previousRow, currentRow);
+        }
+        return previousRow[b.size()];
+    }
+
+public:
+    bool empty() const
+    {
+        return nodes.empty();
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        members.clear();
+    }
+
+    void insert(uint32_t id, const StringInterner &strings)
+    {
+        if (id < members.size() && members[id])
+        {
+            return;
+        }
+        if (id >= members.size())
+        {
+            members.resize(max<size_t>(id + 1, members.size() * 2), false);
+        }
+        members[id] = true;
+
+        if (nodes.empty())
+        {
+            nodes.push_back({id, 0});
+            return;
+        }
+        prepare(strings.str(id));
+        uint32_t current = 0;
+        while (true)
+        {
+            uint32_t d = static_cast<uint32_t>(distanceTo(strings.str(nodes[current].id), numeric_limits<int>::max() - 1));
+            uint32_t child = nodes[current].firstChild;
+            while (child != npos && nodes[child].distance != d)
+            {
+                child = nodes[child].nextSibling;
+            }
+            if (child == npos)
+            {
+                uint32_t added = static_cast<uint32_t>(nodes.size());
+                nodes.push_back({id, d, 0, npos, nodes[current].firstChild});
+                nodes[current].firstChild = added;
+                nodes[current].maxChild = max(nodes[current].maxChild, d);
+                return;
+            }
+            current = child;
+        }
+    }
+
+    // Strings within maxDistance of the query, nearest first, at most limit of them
+    vector<Match> find(string_view query, int maxDistance, size_t limit, const StringInterner &strings) const
+    {
+        vector<Match> matches;
+        if (nodes.empty())
+        {
+            return matches;
+        }
+        prepare(query);
+        pending.assign(1, 0);
+        while (!pending.empty())
+        {
+            const Node &node = nodes[pending.back()];
+            pending.pop_back();
+            // Only distances up to maxChild + maxDistance can lead anywhere
+            int d = distanceTo(strings.str(node.id), static_cast<int>(node.maxChild) + maxDistance);
+            if (d <= maxDistance)
+            {
+                matches.push_back({node.id, d});
+            }
+            for (uint32_t child = node.firstChild; child != npos; child = nodes[child].nextSibling)
+            {
+                if (abs(static_cast<int>(nodes[child].distance) - d) <= maxDistance)
+                {
+                    pending.push_back(child);
+                }
+            }
+        }
+        sort(matches.begin(), matches.end(), [&](const Match &a, const Match &b) {
+            return a.distance != b.distance ? a.distance < b.distance : strings.str(a.id) < strings.str(b.id);
+        });
+        if (matches.size() > limit)
+        {
+            matches.resize(limit);
+        }
+        return matches;
+    }
+};
+
+// Sorted array of distinct strings for prefix completion. Besides the string
+// IDs it keeps the first eight bytes of every string as a big-endian integer,
+// so a binary search walks one contiguous column of integers and only looks
+// at the strings themselves when a prefix is longer than the key. Strings
+// must not contain NUL bytes. Adds and removals are queued and merged in one
+// pass by the next lookup, so a bulk change does not shift the array once
+// per string.
+class PrefixIndex
+{
+    vector<uint64_t> keys;   // leading bytes of each string, ordered like the strings
+    vector<uint32_t> ids;    // string IDs in lexicographic order
+    vector<uint32_t> pending; // IDs whose presence may have changed since the last merge
+    bool built = false;
+
+    // First eight bytes, zero padded; the padding sorts below every real byte
+    static uint64_t keyOf(string_view text, uint8_t padding = 0)
+    {
+        uint64_t key = 0;
+        for (size_t i = 0; i < 8; i++)
+        {
+            key = (key << 8) | (i < text.size() ? static_cast<uint8_t>(text[i]) : padding);
+        }
+        return key;
+    }
+
+    bool less(uint32_t a, uint32_t b, const StringInterner &strings) const
+    {
+        return strings.str(a) < strings.str(b);
+    }
+
+public:
+    bool isBuilt() const
+    {
+        return built;
+    }
+
+    // Every string in order, as of the last refresh
+    const vector<uint32_t> &sorted() const
+    {
+        return ids;
+    }
+
+    void clear()
+    {
+        keys.clear();
+        ids.clear();
+        pending.clear();
+        built = false;
+    }
+
+    void build(vector<uint32_t> all, const StringInterner &strings)
+    {
+        sort(all.begin(), all.end(), [&](uint32_t a, uint32_t b) { return less(a, b, strings); });
+        all.erase(unique(all.begin(), all.end()), all.end());
+        ids = move(all);
+        keys.resize(ids.size());
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            keys[i] = keyOf(strings.str(ids[i]));
+        }
+        pending.clear();
+        built = true;
+    }
+
+    // Notes that a string may have been added or removed; nothing happens until
+    // the index is built
+    void touch(uint32_t id)
+    {
+        if (built)
+        {
+            pending.push_back(id);
+        }
+    }
+
+    // Applies the queued changes; present says whether a string belongs in the index now
+    template <typename Present>
+    void refresh(Present present, const StringInterner &strings)
+    {
+        if (pending.empty())
+        {
+            return;
+        }
+        sort(pending.begin(), pending.end());
+        pending.erase(unique(pending.begin(), pending.end()), pending.end());
+
+        // Drop touched strings that are gone, remembering which touched ones are still here
+        vector<bool> kept(pending.size(), false);
+        size_t out = 0;
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            auto it = lower_bound(pending.begin(), pending.end(), ids[i]);
+            if (it != pending.end() && *it == ids[i])
+            {
+                if (!present(ids[i]))
+                {
+                    continue;
+                }
+                kept[it - pending.begin()] = true;
+            }
+            ids[out++] = ids[i];
+        }
+        ids.resize(out);
+
+        vector<uint32_t> added;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            if (!kept[i] && present(pending[i]))
+            {
+                added.push_back(pending[i]);
+            }
+        }
+        pending.clear();
+
+        sort(added.begin(), added.end(), [&](uint32_t a, uint32_t b) { return less(a, b, strings); });
+        size_t middle = ids.size();
+        ids.insert(ids.end(), added.begin(), added.end());
+        inplace_merge(ids.begin(), ids.begin() + middle, ids.end(), [&](uint32_t a, uint32_t b) { return less(a, b, strings); });
+        keys.resize(ids.size());
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            keys[i] = keyOf(strings.str(ids[i]));
+        }
+    }
+
+    // Strings starting with prefix in lexicographic order, skipping the first
+    // offset and returning at most limit; total receives how many there are
+    vector<uint32_t> complete(string_view prefix, size_t offset, size_t limit, size_t &total, const StringInterner &strings) const
+    {
+        // Every string with the prefix has a key between the prefix padded with
+        // the lowest and with the highest byte
+        auto first = lower_bound(keys.begin(), keys.end(), keyOf(prefix, 0x00));
+        auto last = upper_bound(first, keys.end(), keyOf(prefix, 0xff));
+        size_t begin = first - keys.begin(), end = last - keys.begin();
+        if (prefix.size() > 8)
+        {
+            // Within the run of equal keys the strings themselves decide
+            auto lowest = partition_point(ids.begin() + begin, ids.begin() + end,
+                                          [&](uint32_t id) { return strings.str(id) < prefix; });
+            auto highest = partition_point(lowest, ids.begin() + end,
+                                           [&](uint32_t id) { return strings.str(id).substr(0, prefix.size()) == prefix; });
+            begin = lowest - ids.begin();
+            end = highest - ids.begin();
+        }
+
+        total = end - begin;
+        vector<uint32_t> result;
+        for (size_t i = begin + min(offset, total); i < end && result.size() < limit; i++)
+        {
+            result.push_back(ids[i]);
+        }
+        return result;
+    }
+};
+
+// Foods ordered by calories per serving, as parallel sorted columns, so the
+// foods within a calorie range are one binary search away. A food is keyed by
+// its folded name and category. Changes are queued like PrefixIndex's and
+// merged by the next lookup; an update that changes a food's calories is a
+// removal of the old entry plus an insertion of the new one.
+class CalorieIndex
+{
+public:
+    struct Entry
+    {
+        int calories;
+        uint32_t name; // folded name ID
+        bool composite;
+    };
+
+private:
+    vector<int32_t> calorieColumn; // ascending
+    vector<uint32_t> nameColumn;
+    vector<uint8_t> compositeColumn;
+    vector<uint64_t> pending; // touched foods as name << 1 | composite
+    bool built = false;
+
+    static uint64_t keyOf(uint32_t name, bool composite)
+    {
+        return static_cast<uint64_t>(name) << 1 | composite;
+    }
+
+    static bool less(const Entry &a, const Entry &b)
+    {
+        return tie(a.calories, a.name, a.composite) < tie(b.calories, b.name, b.composite);
+    }
+
+    void assign(const vector<Entry> &entries)
+    {
+        calorieColumn.resize(entries.size());
+        nameColumn.resize(entries.size());
+        compositeColumn.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            calorieColumn[i] = entries[i].calories;
+            nameColumn[i] = entries[i].name;
+            compositeColumn[i] = entries[i].composite;
+        }
+    }
+
+public:
+    bool isBuilt() const
+    {
+        return built;
+    }
+
+    size_t size() const
+    {
+        return calorieColumn.size();
+    }
+
+    Entry operator[](size_t i) const
+    {
+        return {calorieColumn[i], nameColumn[i], compositeColumn[i] != 0};
+    }
+
+    void clear()
+    {
+        calorieColumn.clear();
+        nameColumn.clear();
+        compositeColumn.clear();
+        pending.clear();
+        built = false;
+    }
+
+    void build(vector<Entry> entries)
+    {
+        sort(entries.begin(), entries.end(), less);
+        assign(entries);
+        pending.clear();
+        built = true;
+    }
+
+    // Notes that a food may have been added, changed or removed
+    void touch(uint32_t name, bool composite)
+    {
+        if (built)
+        {
+            pending.push_back(keyOf(name, composite));
+        }
+    }
+
+    // Applies the queued changes; current(name, composite, calories) says
+    // whether the food exists now and with how many calories
+    template <typename Current>
+    void refresh(Current current)
+    {
+        if (pending.empty())
+        {
+            return;
+        }
+        sort(pending.begin(), pending.end());
+        pending.erase(unique(pending.begin(), pending.end()), pending.end());
+
+        // Keep a touched entry only if the food still has exactly those calories
+        vector<bool> kept(pending.size(), false);
+        vector<Entry> entries;
+        entries.reserve(size() + pending.size());
+        for (size_t i = 0; i < size(); i++)
+        {
+            Entry entry = (*this)[i];
+            auto it = lower_bound(pending.begin(), pending.end(), keyOf(entry.name, entry.composite));
+            if (it != pending.end() && *it == keyOf(entry.name, entry.composite))
+            {
+                int calories;
+                if (!current(entry.name, entry.composite, calories) || calories != entry.calories)
+                {
+                    continue;
+                }
+                kept[it - pending.begin()] = true;
+            }
+            entries.push_back(entry);
+        }
+
+        size_t middle = entries.size();
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            Entry entry{0, static_cast<uint32_t>(pending[i] >> 1), (pending[i] & 1) != 0};
+            if (!kept[i] && current(entry.name, entry.composite, entry.calories))
+            {
+                entries.push_back(entry);
+            }
+        }
+        pending.clear();
+
+        sort(entries.begin() + middle, entries.end(), less);
+        inplace_merge(entries.begin(), entries.begin() + middle, entries.end(), less);
+        assign(entries);
+    }
+
+    // Positions [first, last) of the entries with calories in [low, high]
+    pair<size_t, size_t> range(int low, int high) const
+    {
+        auto first = lower_bound(calorieColumn.begin(), calorieColumn.end(), low);
+        auto last = upper_bound(first, calorieColumn.end(), high);
+        return {static_cast<size_t>(first - calorieColumn.begin()), static_cast<size_t>(last - calorieColumn.begin())};
+    }
+};
+
+// Columnar (struct-of-arrays) food catalog. Each food is a row and every
+// attribute is its own contiguous column, so scans touch only the columns
+// they need. Keyword and ingredient lists live in shared pools and each row
+// stores a (begin, count) range into them. Rows are kept dense: erasing moves
+// the last row into the hole, so row numbers are not stable across mutations.
+class FoodCatalog
+{
+public:
+    static constexpr uint32_t npos = numeric_limits<uint32_t>::max();
+    using NameIndex = pmr::unordered_map<uint32_t, uint32_t>;
+
+private:
+    // Every column, pool and index node is carved from this resource, so the
+    // name index does not cost one heap allocation per food and dropping the
+    // catalog hands back a few large chunks. Declared first, destroyed last.
+    pmr::unsynchronized_pool_resource memory;
+
+    pmr::vector<uint32_t> nameColumn{&memory};       // interned name as stored in the file
+    pmr::vector<uint32_t> foldedNameColumn{&memory}; // interned lowercase name, the lookup key
+    pmr::vector<int32_t> calorieColumn{&memory};
+    pmr::vector<uint8_t> compositeColumn{&memory};
+    pmr::vector<uint32_t> keywordBegin{&memory};
+    pmr::vector<uint32_t> keywordCount{&memory};
+    pmr::vector<uint32_t> ingredientBegin{&memory};
+    pmr::vector<uint32_t> ingredientCount{&memory};
+    pmr::vector<Nutrients> nutrientColumn{&memory}; // one aligned vector per row
+
+    pmr::vector<uint32_t> keywordPool{&memory};
+    pmr::vector<uint32_t> ingredientPool{&memory};
+    pmr::vector<int32_t> servingsPool{&memory};
+    size_t deadPoolEntries = 0; // pool slots no longer referenced by any row
+
+    NameIndex byName[2]{NameIndex(&memory), NameIndex(&memory)}; // folded name ID -> row, [0] basic, [1] composite
+
+    void appendLists(uint32_t row, const FoodRecord &record)
+    {
+        keywordBegin[row] = static_cast<uint32_t>(keywordPool.size());
+        keywordCount[row] = static_cast<uint32_t>(record.keywords.size());
+        keywordPool.insert(keywordPool.end(), record.keywords.begin(), record.keywords.end());
+
+        ingredientBegin[row] = static_cast<uint32_t>(ingredientPool.size());
+        ingredientCount[row] = static_cast<uint32_t>(record.ingredients.size());
+        for (const auto &[ingredient, servings] : record.ingredients)
+        {
+            ingredientPool.push_back(ingredient);
+            servingsPool.push_back(servings);
+        }
+    }
+
+    // Rewrites the pools in row order once more than half of them is garbage
+    void compactPoolsIfNeeded()
+    {
+        size_t live = keywordPool.size() + ingredientPool.size() - deadPoolEntries;
+        if (deadPoolEntries < 1024 || deadPoolEntries < live)
+        {
+            return;
+        }
+
+        pmr::vector<uint32_t> keywords(&memory), ingredients(&memory);
+        pmr::vector<int32_t> servings(&memory);
+        keywords.reserve(keywordPool.size());
+        ingredients.reserve(ingredientPool.size());
+        servings.reserve(servingsPool.size());
+        for (size_t row = 0; row < size(); row++)
+        {
+            uint32_t begin = keywordBegin[row];
+            keywordBegin[row] = static_cast<uint32_t>(keywords.size());
+            keywords.insert(keywords.end(), keywordPool.begin() + begin, keywordPool.begin() + begin + keywordCount[row]);
+
+            begin = ingredientBegin[row];
+            ingredientBegin[row] = static_cast<uint32_t>(ingredients.size());
+            ingredients.insert(ingredients.end(), ingredientPool.begin() + begin, ingredientPool.begin() + begin + ingredientCount[row]);
+            servings.insert(servings.end(), servingsPool.begin() + begin, servingsPool.begin() + begin + ingredientCount[row]);
+        }
+        keywordPool.swap(keywords);
+        ingredientPool.swap(ingredients);
+        servingsPool.swap(servings);
+        deadPoolEntries = 0;
+    }
+
+public:
+    size_t size() const { return nameColumn.size(); }
+    size_t count(bool composite) const { return byName[composite].size(); }
+
+    uint32_t find(bool composite, uint32_t foldedNameId) const
+    {
+        auto it = byName[composite].find(foldedNameId);
+        return it == byName[composite].end() ? npos : it->second;
+    }
+
+    uint32_t name(uint32_t row) const { return nameColumn[row]; }
+    uint32_t foldedName(uint32_t row) const { return foldedNameColumn[row]; }
+    int calories(uint32_t row) const { return calorieColumn[row]; }
+    bool isComposite(uint32_t row) const { return compositeColumn[row] != 0; }
+    const Nutrients &nutrients(uint32_t row) const { return nutrientColumn[row]; }
+
+    ColumnRange<uint32_t> keywords(uint32_t row) const
+    {
+        const uint32_t *first = keywordPool.data() + keywordBegin[row];
+        return {first, first + keywordCount[row]};
+    }
+
+    ColumnRange<uint32_t> ingredients(uint32_t row) const
+    {
+        const uint32_t *first = ingredientPool.data() + ingredientBegin[row];
+        return {first, first + ingredientCount[row]};
+    }
+
+    ColumnRange<int32_t> servings(uint32_t row) const
+    {
+        const int32_t *first = servingsPool.data() + ingredientBegin[row];
+        return {first, first + ingredientCount[row]};
+    }
+
+    // Whole columns, for scans that want to stream one attribute
+    const pmr::vector<int32_t> &calorieValues() const { return calorieColumn; }
+    const pmr::vector<uint8_t> &compositeFlags() const { return compositeColumn; }
+
+    void clear()
+    {
+        for (auto *column : {&nameColumn, &foldedNameColumn, &keywordBegin, &keywordCount, &ingredientBegin,
+                             &ingredientCount, &keywordPool, &ingredientPool})
+        {
+            column->clear();
+        }
+        calorieColumn.clear();
+        compositeColumn.clear();
+        nutrientColumn.clear();
+        servingsPool.clear();
+        deadPoolEntries = 0;
+        byName[0].clear();
+        byName[1].clear();
+    }
+
+    // Inserts a food, or overwrites the row of the same category and folded name
+    uint32_t upsert(const FoodRecord &record, uint32_t foldedNameId)
+    {
+        auto [it, inserted] = byName[record.composite].try_emplace(foldedNameId, static_cast<uint32_t>(size()));
+        uint32_t row = it->second;
+
+        if (inserted)
+        {
+            nameColumn.push_back(record.name);
+            foldedNameColumn.push_back(foldedNameId);
+            calorieColumn.push_back(record.calories);
+            compositeColumn.push_back(record.composite);
+            nutrientColumn.push_back(record.nutrients);
+            keywordBegin.push_back(0);
+            keywordCount.push_back(0);
+            ingredientBegin.push_back(0);
+            ingredientCount.push_back(0);
+        }
+        else
+        {
+            deadPoolEntries += keywordCount[row] + ingredientCount[row];
+            nameColumn[row] = record.name;
+            calorieColumn[row] = record.calories;
+            nutrientColumn[row] = record.nutrients;
+        }
+
+        appendLists(row, record);
+        compactPoolsIfNeeded();
+        return row;
+    }
+
+    void erase(uint32_t row)
+    {
+        deadPoolEntries += keywordCount[row] + ingredientCount[row];
+        byName[compositeColumn[row]].erase(foldedNameColumn[row]);
+
+        uint32_t last = static_cast<uint32_t>(size() - 1);
+        if (row != last)
+        {
+            nameColumn[row] = nameColumn[last];
+            foldedNameColumn[row] = foldedNameColumn[last];
+            calorieColumn[row] = calorieColumn[last];
+            compositeColumn[row] = compositeColumn[last];
+            nutrientColumn[row] = nutrientColumn[last];
+            keywordBegin[row] = keywordBegin[last];
+            keywordCount[row] = keywordCount[last];
+            ingredientBegin[row] = ingredientBegin[last];
+            ingredientCount[row] = ingredientCount[last];
+            byName[compositeColumn[row]][foldedNameColumn[row]] = row;
+        }
+
+        for (auto *column : {&nameColumn, &foldedNameColumn, &keywordBegin, &keywordCount, &ingredientBegin, &ingredientCount})
+        {
+            column->pop_back();
+        }
+        calorieColumn.pop_back();
+        compositeColumn.pop_back();
+        nutrientColumn.pop_back();
+        compactPoolsIfNeeded();
+    }
+
+    shared_ptr<const CatalogSnapshot> snapshot(const StringInterner &strings) const
+    {
+        auto result = make_shared<CatalogSnapshot>();
+        result->strings.assign(strings.all().begin(), strings.all().end());
+        result->names.assign(nameColumn.begin(), nameColumn.end());
+        result->calories.assign(calorieColumn.begin(), calorieColumn.end());
+        result->composite.assign(compositeColumn.begin(), compositeColumn.end());
+        result->keywordBegin.assign(keywordBegin.begin(), keywordBegin.end());
+        result->keywordCount.assign(keywordCount.begin(), keywordCount.end());
+        result->ingredientBegin.assign(ingredientBegin.begin(), ingredientBegin.end());
+        result->ingredientCount.assign(ingredientCount.begin(), ingredientCount.end());
+        result->keywordPool.assign(keywordPool.begin(), keywordPool.end());
+        result->ingredientPool.assign(ingredientPool.begin(), ingredientPool.end());
+        result->servingsPool.assign(servingsPool.begin(), servingsPool.end());
+        result->nutrients.assign(nutrientColumn.begin(), nutrientColumn.end());
+        return result;
+    }
+
+    // Copies a row back out as a record, e.g. to remember it for undo
+    FoodRecord record(uint32_t row) const
+    {
+        FoodRecord result;
+        result.name = nameColumn[row];
+        result.composite = isComposite(row);
+        result.calories = calorieColumn[row];
+        result.nutrients = nutrientColumn[row];
+        result.keywords.assign(keywords(row).begin(), keywords(row).end());
+        ColumnRange<uint32_t> ids = ingredients(row);
+        ColumnRange<int32_t> amounts = servings(row);
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            result.ingredients.emplace_back(ids[i], amounts[i]);
+        }
+        return result;
+    }
+};
+
+// One food read from an import file, with its name, keywords and ingredient
+// names already normalized (trimmed, inner whitespace collapsed, lowercase).
+// Rows with ingredients are composite foods; their calories are computed
+// from the ingredients when the batch is resolved.
+struct ImportRow
+{
+    string name;
+    int calories = 0;
+    Nutrients nutrients;
+    vector<string> keywords;
+    vector<pair<string, int>> ingredients;
+    size_t line = 0; // where the row starts in its file, for messages
+};
+
+// Outcome of an import, filled by the parser and then by FoodDatabase::importFoods
+struct ImportReport
+{
+    static constexpr size_t MaxMessages = 20;
+
+    size_t rowsRead = 0;
+    size_t basicAdded = 0;
+    size_t compositeAdded = 0;
+    size_t duplicatesInFile = 0;  // later rows repeating an earlier name
+    size_t alreadyInDatabase = 0; // names the catalog already has, skipped
+    size_t rejected = 0;          // malformed rows and unresolvable composites
+    vector<string> messages;      // the first few problems, "file:line: reason"
+    double parseSeconds = 0;
+    double resolveSeconds = 0;
+
+    void print(ostream &out) const
+    {
+        out << "Rows read: " << rowsRead << "\n"
+            << "Basic foods added: " << basicAdded << "\n"
+            << "Composite foods added: " << compositeAdded << "\n"
+            << "Already in database (skipped): " << alreadyInDatabase << "\n"
+            << "Repeated in file (skipped): " << duplicatesInFile << "\n"
+            << "Rejected: " << rejected << "\n";
+        for (const string &message : messages)
+        {
+            out << "  " << message << "\n";
+        }
+        StreamFormatGuard format(out);
+        out << fixed << setprecision(3) << "Parsed in " << parseSeconds << " s, resolved in " << resolveSeconds << " s\n";
+    }
+
+    void reject(const string &file, size_t line, const string &reason)
+    {
+        rejected++;
+        note(file, line, reason);
+    }
+
+    void note(const string &file, size_t line, const string &reason)
+    {
+        if (messages.size() < MaxMessages)
+        {
+            messages.push_back(file + ":" + to_string(line) + ": " + reason);
+        }
+    }
+};
+
+// Reads CSV and NDJSON nutrition tables into ImportRows. The file is read
+// whole, cut into one chunk per hardware thread at record boundaries, and
+// the chunks are parsed in parallel; rows come back in file order.
+//
+// CSV needs a header row. Recognized columns (any order, others ignored):
+// name/food/description, calories/kcal/energy, keywords/tags, ingredients
+// and one column per nutrient named as in Nutrients (protein, fat, ...).
+// Lists are separated by ';' or '|', ingredients are written
+// "name:servings". Fields may be quoted RFC 4180 style.
+//
+// NDJSON has one object per line with the members "name", "calories",
+// "keywords" (array of strings), "ingredients" (object of name -> servings)
+// and "nutrients" (object of nutrient -> amount). Composites get their
+// calories and nutrients from their ingredients.
+class FoodImporter
+{
+public:
+    enum class Format { Csv, Ndjson, Unknown };
+
+    static Format formatOf(const string &path)
+    {
+        size_t dot = path.rfind('.');
+        string extension = dot == string::npos ? "" : path.substr(dot + 1);
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == "csv")
+            return Format::Csv;
+        if (extension == "ndjson" || extension == "jsonl")
+            return Format::Ndjson;
+        return Format::Unknown;
+    }
+
+    // Parses a whole file; false (with a message in the report) if it cannot be read
+    static bool read(const string &path, vector<ImportRow> &rows, ImportReport &report)
+    {
+        TRACE_SPAN("importParse", "import");
+        auto start = chrono::steady_clock::now();
+        Format format = formatOf(path);
+        if (format == Format::Unknown)
+        {
+            report.messages.push_back(path + ": unknown format (expected .csv, .ndjson or .jsonl)");
+            return false;
+        }
+
+        FastJson::Buffer buffer;
+        if (!FastJson::readFile(path, buffer))
+        {
+            report.messages.push_back(path + ": cannot open file");
+            return false;
+        }
+        string_view text(buffer.data.data(), buffer.length);
+
+        Columns columns;
+        size_t bodyStart = 0, bodyLine = 1;
+        if (format == Format::Csv)
+        {
+            string error;
+            if (!readHeader(text, columns, bodyStart, error))
+            {
+                report.messages.push_back(path + ": " + error);
+                return false;
+            }
+            bodyLine = 1 + static_cast<size_t>(count(text.begin(), text.begin() + bodyStart, '\n'));
+        }
+
+        vector<Chunk> chunks = split(text, bodyStart, bodyLine, format == Format::Csv);
+        vector<thread> workers;
+        for (size_t i = 1; i < chunks.size(); i++)
+        {
+            workers.emplace_back([&, i]() {
+                TraceRecorder::instance().setThreadName("import");
+                parseChunk(text, chunks[i], format, columns);
+            });
+        }
+        parseChunk(text, chunks[0], format, columns);
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+
+        size_t total = rows.size();
+        for (const Chunk &chunk : chunks)
+        {
+            total += chunk.rows.size();
+        }
+        rows.reserve(total);
+        for (Chunk &chunk : chunks)
+        {
+            report.rowsRead += chunk.rows.size() + chunk.errors.size();
+            for (const auto &[line, reason] : chunk.errors)
+            {
+                report.reject(path, line, reason);
+            }
+            move(chunk.rows.begin(), chunk.rows.end(), back_inserter(rows));
+        }
+        report.parseSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // Trims, collapses runs of whitespace to one space and lowercases
+    static void normalize(string_view text, string &out)
+    {
+        out.clear();
+        bool space = false;
+        for (char c : text)
+        {
+            if (isspace(static_cast<unsigned char>(c)))
+            {
+                space = !out.empty();
+                continue;
+            }
+            if (space)
+            {
+                out.push_back(' ');
+                space = false;
+            }
+            out.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+        }
+    }
+
+private:
+    static constexpr size_t MinChunkBytes = 1 << 20;
+
+    // Field positions of the recognized CSV columns, npos when absent
+    struct Columns
+    {
+        size_t name = string::npos;
+        size_t calories = string::npos;
+        size_t keywords = string::npos;
+        size_t ingredients = string::npos;
+        size_t nutrients[Nutrients::Count] = {string::npos, string::npos, string::npos, string::npos,
+                                              string::npos, string::npos, string::npos, string::npos};
+    };
+
+    struct Chunk
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        size_t firstLine = 1;
+        vector<ImportRow> rows;
+        vector<pair<size_t, string>> errors;
+    };
+
+    // Reads one CSV record starting at pos into fields; pos ends past its newline
+    static void readRecord(string_view text, size_t &pos, vector<string> &fields, size_t &lines)
+    {
+        fields.clear();
+        fields.emplace_back();
+        while (pos < text.size())
+        {
+            char c = text[pos++];
+            if (c == '"')
+            {
+                // Quoted section: commas and newlines are data, "" is a quote
+                while (pos < text.size())
+                {
+                    char q = text[pos++];
+                    if (q == '"')
+                    {
+                        if (pos < text.size() && text[pos] == '"')
+                        {
+                            fields.back().push_back('"');
+                            pos++;
+                            continue;
+                        }
+                        break;
+                    }
+                    if (q == '\n')
+                        lines++;
+                    fields.back().push_back(q);
+                }
+            }
+            else if (c == ',')
+            {
+                fields.emplace_back();
+            }
+            else if (c == '\n')
+            {
+                lines++;
+                break;
+            }
+            else if (c != '\r')
+            {
+                fields.back().push_back(c);
+            }
+        }
+    }
+
+    static bool readHeader(string_view text, Columns &columns, size_t &bodyStart, string &error)
+    {
+        vector<string> fields;
+        size_t lines = 0;
+        size_t pos = 0;
+        readRecord(text, pos, fields, lines);
+        bodyStart = pos;
+
+        string column;
+        for (size_t i = 0; i < fields.size(); i++)
+        {
+            normalize(fields[i], column);
+            if (column == "name" || column == "food" || column == "description")
+                columns.name = i;
+            else if (column == "calories" || column == "kcal" || column == "energy")
+                columns.calories = i;
+            else if (column == "keywords" || column == "tags")
+                columns.keywords = i;
+            else if (column == "ingredients")
+                columns.ingredients = i;
+            else
+            {
+                // Header cells are lowercased, so match the nutrient names the same way
+                for (size_t n = 0; n < Nutrients::Count; n++)
+                {
+                    string_view name = Nutrients::names[n];
+                    if (column.size() == name.size() &&
+                        equal(name.begin(), name.end(), column.begin(), [](char a, char b) { return tolower(a) == b; }))
+                        columns.nutrients[n] = i;
+                }
+            }
+        }
+        if (columns.name == string::npos)
+        {
+            error = "header has no name column";
+            return false;
+        }
+        return true;
+    }
+
+    // Cuts the body into chunks that each start at the beginning of a record.
+    // For CSV a newline only ends a record outside quotes, so the scan keeps
+    // the quote parity; line numbers are counted on the same pass.
+    static vector<Chunk> split(string_view text, size_t bodyStart, size_t bodyLine, bool csv)
+    {
+        size_t bodySize = text.size() - bodyStart;
+        size_t threads = max(1u, thread::hardware_concurrency());
+        size_t count = max<size_t>(1, min(threads, bodySize / MinChunkBytes));
+
+        vector<Chunk> chunks(count);
+        size_t pos = bodyStart, line = bodyLine;
+        bool quoted = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            chunks[i].begin = pos;
+            chunks[i].firstLine = line;
+            if (i + 1 == count)
+            {
+                pos = text.size();
+            }
+            size_t target = bodyStart + bodySize * (i + 1) / count;
+            while (pos < text.size())
+            {
+                char c = text[pos++];
+                if (c == '"' && csv)
+                {
+                    quoted = !quoted;
+                }
+                else if (c == '\n')
+                {
+                    line++;
+                    if (!quoted && pos >= target)
+                        break;
+                }
+            }
+            chunks[i].end = pos;
+        }
+        return chunks;
+    }
+
+    // Splits a list field on ';' or '|'
+    template <typename Visit>
+    static void forEachItem(const string &field, Visit visit)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i <= field.size(); i++)
+        {
+            if (i == field.size() || field[i] == ';' || field[i] == '|')
+            {
+                visit(string_view(field).substr(start, i - start));
+                start = i + 1;
+            }
+        }
+    }
+
+    static bool parseInt(string_view text, int &value)
+    {
+        string_view digits = text;
+        while (!digits.empty() && isspace(static_cast<unsigned char>(digits.front())))
+            digits.remove_prefix(1);
+        while (!digits.empty() && isspace(static_cast<unsigned char>(digits.back())))
+            digits.remove_suffix(1);
+        if (digits.empty())
+            return false;
+
+        // Tables often carry decimals ("52.0"); those round to whole calories
+        double number = 0;
+        string copy(digits);
+        char *end = nullptr;
+        number = strtod(copy.c_str(), &end);
+        if (end != copy.c_str() + copy.size() || !(number >= 0) || number > numeric_limits<int>::max())
+            return false;
+        value = static_cast<int>(lround(number));
+        return true;
+    }
+
+    static bool parseAmount(const string &text, float &amount)
+    {
+        char *end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        while (end && isspace(static_cast<unsigned char>(*end)))
+            end++;
+        if (end != text.c_str() + text.size() || !Nutrients::validAmount(value))
+            return false;
+        amount = Nutrients::round(value);
+        return true;
+    }
+
+    static void addKeyword(ImportRow &row, string_view keyword, string &scratch)
+    {
+        normalize(keyword, scratch);
+        if (!scratch.empty() && find(row.keywords.begin(), row.keywords.end(), scratch) == row.keywords.end())
+        {
+            row.keywords.push_back(scratch);
+        }
+    }
+
+    // Repeated ingredients within a row add up
+    static void addIngredient(ImportRow &row, const string &name, int servings)
+    {
+        for (auto &ingredient : row.ingredients)
+        {
+            if (ingredient.first == name)
+            {
+                ingredient.second += servings;
+                return;
+            }
+        }
+        row.ingredients.emplace_back(name, servings);
+    }
+
+    // Checks a finished row; returns the reason it is rejected, or empty
+    static const char *validate(const ImportRow &row, bool hasCalories)
+    {
+        if (row.name.empty())
+            return "missing name";
+        if (row.ingredients.empty() && (!hasCalories || row.calories <= 0))
+            return "basic food needs a positive calorie value";
+        return nullptr;
+    }
+
+    static void parseCsvChunk(string_view text, Chunk &chunk, const Columns &columns)
+    {
+        vector<string> fields;
+        string scratch;
+        size_t pos = chunk.begin, line = chunk.firstLine;
+        while (pos < chunk.end)
+        {
+            size_t recordLine = line;
+            readRecord(text.substr(0, chunk.end), pos, fields, line);
+            if (fields.size() == 1 && fields[0].find_first_not_of(" \t") == string::npos)
+            {
+                continue; // blank line
+            }
+
+            ImportRow row;
+            row.line = recordLine;
+            auto field = [&](size_t column) -> const string * {
+                return column < fields.size() ? &fields[column] : nullptr;
+            };
+
+            const char *error = nullptr;
+            if (const string *name = field(columns.name))
+                normalize(*name, row.name);
+
+            bool hasCalories = false;
+            const string *calories = field(columns.calories);
+            if (calories && calories->find_first_not_of(" \t") != string::npos)
+            {
+                hasCalories = parseInt(*calories, row.calories);
+                if (!hasCalories)
+                    error = "calories is not a number";
+            }
+            if (const string *keywords = field(columns.keywords))
+            {
+                forEachItem(*keywords, [&](string_view keyword) { addKeyword(row, keyword, scratch); });
+            }
+            if (const string *ingredients = field(columns.ingredients))
+            {
+                forEachItem(*ingredients, [&](string_view item) {
+                    if (error || item.find_first_not_of(" \t") == string_view::npos)
+                        return;
+                    size_t colon = item.rfind(':');
+                    int servings = 0;
+                    if (colon == string_view::npos || !parseInt(item.substr(colon + 1), servings) || servings <= 0)
+                    {
+                        error = "ingredients must be written name:servings with positive servings";
+                        return;
+                    }
+                    normalize(item.substr(0, colon), scratch);
+                    if (scratch.empty())
+                    {
+                        error = "ingredient without a name";
+                        return;
+                    }
+                    addIngredient(row, scratch, servings);
+                });
+            }
+            for (size_t n = 0; n < Nutrients::Count && !error; n++)
+            {
+                const string *amount = field(columns.nutrients[n]);
+                if (amount && amount->find_first_not_of(" \t") != string::npos && !parseAmount(*amount, row.nutrients[n]))
+                    error = "nutrient amount is not a number";
+            }
+
+            if (!error)
+                error = validate(row, hasCalories);
+            if (error)
+                chunk.errors.emplace_back(recordLine, error);
+            else
+                chunk.rows.push_back(move(row));
+        }
+    }
+
+    // SAX handler for one NDJSON line
+    class RowSax
+    {
+    public:
+        ImportRow row;
+        bool hasCalories = false;
+        std::string error;
+
+    private:
+        enum class Member { Other, Name, Calories, Keywords, Ingredients, Nutrients };
+        int depth = 0;
+        Member member = Member::Other;
+        int skipDepth = 0;
+        std::string pendingIngredient;
+        int pendingNutrient = -1;
+        std::string scratch;
+
+        bool fail(const char *message)
+        {
+            error = message;
+            return false;
+        }
+
+        // Consumes a value belonging to an unknown member
+        bool skipped()
+        {
+            return skipDepth > 0 || (depth == 1 && member == Member::Other);
+        }
+
+        bool number(double value)
+        {
+            if (skipped())
+                return true;
+            if (depth == 1 && member == Member::Calories)
+            {
+                if (!(value >= 0) || value > numeric_limits<int>::max())
+                    return fail("calories is out of range");
+                row.calories = static_cast<int>(lround(value));
+                hasCalories = true;
+                return true;
+            }
+            if (depth == 2 && member == Member::Ingredients)
+            {
+                if (!(value > 0) || value > numeric_limits<int>::max())
+                    return fail("ingredient servings must be positive");
+                normalize(pendingIngredient, scratch);
+                if (scratch.empty())
+                    return fail("ingredient without a name");
+                addIngredient(row, scratch, static_cast<int>(lround(value)));
+                return true;
+            }
+            if (depth == 2 && member == Member::Nutrients)
+            {
+                if (!Nutrients::validAmount(value))
+                    return fail("nutrient amount is out of range");
+                if (pendingNutrient >= 0)
+                    row.nutrients[pendingNutrient] = Nutrients::round(value);
+                return true;
+            }
+            return fail("unexpected number");
+        }
+
+        bool scalar()
+        {
+            return skipped() ? true : fail("unexpected value");
+        }
+
+    public:
+        void reset(size_t line)
+        {
+            row = ImportRow();
+            row.line = line;
+            hasCalories = false;
+            error.clear();
+            depth = 0;
+            member = Member::Other;
+            skipDepth = 0;
+        }
+
+        bool null() { return scalar(); }
+        bool boolean(bool) { return scalar(); }
+        bool number_integer(json::number_integer_t value) { return number(static_cast<double>(value)); }
+        bool number_unsigned(json::number_unsigned_t value) { return number(static_cast<double>(value)); }
+        bool number_float(json::number_float_t value, const std::string &) { return number(value); }
+        bool binary(json::binary_t &) { return scalar(); }
+
+        bool string(std::string &value)
+        {
+            if (skipped())
+                return true;
+            if (depth == 1 && member == Member::Name)
+            {
+                normalize(value, row.name);
+                return true;
+            }
+            if (depth == 2 && member == Member::Keywords)
+            {
+                addKeyword(row, value, scratch);
+                return true;
+            }
+            return fail("unexpected string");
+        }
+
+        bool key(std::string &value)
+        {
+            if (skipDepth > 0)
+                return true;
+            if (depth == 1)
+            {
+                member = value == "name" ? Member::Name
+                         : value == "calories" ? Member::Calories
+                         : value == "keywords" ? Member::Keywords
+                         : value == "ingredients" ? Member::Ingredients
+                         : value == "nutrients" ? Member::Nutrients
+                                                  : Member::Other;
+            }
+            else if (depth == 2 && member == Member::Ingredients)
+            {
+                pendingIngredient = value;
+            }
+            else if (depth == 2 && member == Member::Nutrients)
+            {
+                pendingNutrient = Nutrients::indexOf(value); // unknown nutrients are ignored
+            }
+            return true;
+        }
+
+        bool start_object(size_t)
+        {
+            if (skipped())
+            {
+                skipDepth++;
+                return true;
+            }
+            depth++;
+            if (depth == 1 || (depth == 2 && (member == Member::Ingredients || member == Member::Nutrients)))
+                return true;
+            return fail("unexpected object");
+        }
+
+        bool end_object()
+        {
+            if (skipDepth > 0)
+            {
+                skipDepth--;
+                return true;
+            }
+            depth--;
+            if (depth == 1)
+                member = Member::Other;
+            return true;
+        }
+
+        bool start_array(size_t)
+        {
+            if (skipped())
+            {
+                skipDepth++;
+                return true;
+            }
+            depth++;
+            if (depth == 2 && member == Member::Keywords)
+                return true;
+            return fail("unexpected array");
+        }
+
+        bool end_array()
+        {
+            if (skipDepth > 0)
+            {
+                skipDepth--;
+                return true;
+            }
+            depth--;
+            member = Member::Other;
+            return true;
+        }
+
+        bool parse_error(size_t, const std::string &, const nlohmann::detail::exception &ex)
+        {
+            error = ex.what();
+            return false;
+        }
+    };
+
+    static void parseNdjsonChunk(string_view text, Chunk &chunk)
+    {
+        FastJson::Buffer line;
+        vector<uint32_t> structurals;
+        RowSax sax;
+        size_t pos = chunk.begin, lineNumber = chunk.firstLine;
+        while (pos < chunk.end)
+        {
+            size_t end = text.find('\n', pos);
+            end = end == string_view::npos || end > chunk.end ? chunk.end : end;
+            string_view content = text.substr(pos, end - pos);
+            size_t current = lineNumber++;
+            pos = end + 1;
+            if (content.find_first_not_of(" \t\r") == string_view::npos)
+            {
+                continue;
+            }
+
+            // Each line is its own document; buffer and index storage are reused
+            line.data.assign(content.data(), content.size());
+            line.data.append(FastJson::Padding, ' ');
+            line.length = content.size();
+            sax.reset(current);
+            string error;
+            if (!FastJson::parse(line, sax, error, structurals))
+            {
+                chunk.errors.emplace_back(current, sax.error.empty() ? error : sax.error);
+                continue;
+            }
+            if (const char *invalid = validate(sax.row, sax.hasCalories))
+            {
+                chunk.errors.emplace_back(current, invalid);
+                continue;
+            }
+            chunk.rows.push_back(move(sax.row));
+        }
+    }
+
+    static void parseChunk(string_view text, Chunk &chunk, Format format, const Columns &columns)
+    {
+        TRACE_SPAN("importChunk", "import");
+        if (format == Format::Csv)
+            parseCsvChunk(text, chunk, columns);
+        else
+            parseNdjsonChunk(text, chunk);
+    }
+};
+
+// Fills a calorie target with servings of candidate foods: a bounded knapsack
+// where only the reachable totals matter. Totals are bits of a bitset and a
+// food of c calories with up to k servings is split into pieces of 1, 2, 4, ...
+// servings, each of which shifts the bitset once, so the solve costs about
+// pieces * target / 64 word operations. The first piece to reach a total is
+// remembered for it, and pieces go in order of preference, so the foods
+// logged most often are the ones a plan is built from when they can be.
+class MealPlanner
+{
+public:
+    struct Candidate
+    {
+        uint32_t name;       // as stored in the catalog
+        bool composite;
+        int calories;
+        uint32_t frequency;  // times logged
+    };
+
+    struct Portion
+    {
+        uint32_t name;
+        bool composite;
+        int calories;        // per serving
+        int servings;
+    };
+
+    struct Plan
+    {
+        bool found = false;
+        int calories = 0;
+        vector<Portion> portions; // most calories first
+        size_t candidates = 0;    // left after pruning
+        size_t pieces = 0;
+    };
+
+    static Plan solve(const vector<Candidate> &candidates, int target, int tolerance, int maxServings)
+    {
+        Plan plan;
+        int limit = target + tolerance;
+        if (target <= 0 || maxServings <= 0)
+        {
+            return plan;
+        }
+
+        // Only calories matter to the knapsack, so of the foods with the same
+        // calories it is enough to keep as many of the favourites as could
+        // ever be used together. Bucketing by calories keeps this linear.
+        vector<vector<uint32_t>> buckets(static_cast<size_t>(limit) + 1);
+        for (uint32_t i = 0; i < candidates.size(); i++)
+        {
+            if (candidates[i].calories > 0 && candidates[i].calories <= limit)
+            {
+                buckets[candidates[i].calories].push_back(i);
+            }
+        }
+        vector<Candidate> kept;
+        for (int calories = 1; calories <= limit; calories++)
+        {
+            vector<uint32_t> &bucket = buckets[calories];
+            size_t useful = min(bucket.size(), static_cast<size_t>((limit / calories + maxServings - 1) / maxServings));
+            partial_sort(bucket.begin(), bucket.begin() + useful, bucket.end(), [&](uint32_t a, uint32_t b) {
+                return candidates[a].frequency != candidates[b].frequency ? candidates[a].frequency > candidates[b].frequency : a < b;
+            });
+            for (size_t i = 0; i < useful; i++)
+            {
+                kept.push_back(candidates[bucket[i]]);
+            }
+        }
+        stable_sort(kept.begin(), kept.end(), [](const Candidate &a, const Candidate &b) {
+            return a.frequency != b.frequency ? a.frequency > b.frequency : a.calories > b.calories;
+        });
+        plan.candidates = kept.size();
+
+        // Binary split into pieces; more servings than fit in the limit never help
+        struct Piece
+        {
+            uint32_t candidate;
+            int servings;
+        };
+        vector<Piece> pieces;
+        for (uint32_t i = 0; i < kept.size(); i++)
+        {
+            int left = min(maxServings, limit / kept[i].calories);
+            for (int size = 1; left > 0; size *= 2)
+            {
+                int take = min(size, left);
+                pieces.push_back({i, take});
+                left -= take;
+            }
+        }
+        plan.pieces = pieces.size();
+
+        const size_t words = static_cast<size_t>(limit) / 64 + 1;
+        vector<uint64_t> reachable(words, 0), shifted(words);
+        vector<uint32_t> reachedBy(static_cast<size_t>(limit) + 1, numeric_limits<uint32_t>::max());
+        reachable[0] = 1;
+        for (uint32_t p = 0; p < pieces.size(); p++)
+        {
+            size_t weight = static_cast<size_t>(kept[pieces[p].candidate].calories) * pieces[p].servings;
+            size_t wordShift = weight / 64, bitShift = weight % 64;
+            for (size_t w = words; w-- > 0;)
+            {
+                uint64_t value = 0;
+                if (w >= wordShift)
+                {
+                    value = reachable[w - wordShift] << bitShift;
+                    if (bitShift && w > wordShift)
+                    {
+                        value |= reachable[w - wordShift - 1] >> (64 - bitShift);
+                    }
+                }
+                shifted[w] = value;
+            }
+            for (size_t w = 0; w < words; w++)
+            {
+                uint64_t fresh = shifted[w] & ~reachable[w];
+                reachable[w] |= fresh;
+                for (; fresh; fresh &= fresh - 1)
+                {
+                    size_t total = w * 64 + __builtin_ctzll(fresh);
+                    if (total <= static_cast<size_t>(limit))
+                    {
+                        reachedBy[total] = p;
+                    }
+                }
+            }
+            if (reachable[target / 64] >> (target % 64) & 1)
+            {
+                break; // an exact fit cannot be improved on
+            }
+        }
+
+        // The reachable total nearest the target, under it on a tie
+        int best = -1;
+        for (int d = 0; d <= tolerance && best < 0; d++)
+        {
+            for (int total : {target - d, target + d})
+            {
+                if (total > 0 && total <= limit && reachedBy[total] != numeric_limits<uint32_t>::max())
+                {
+                    best = total;
+                    break;
+                }
+            }
+        }
+        if (best < 0)
+        {
+            return plan;
+        }
+
+        // Walk back: each piece was added to a total reached by earlier pieces only
+        vector<int> servings(kept.size(), 0);
+        for (int total = best; total > 0;)
+        {
+            const Piece &piece = pieces[reachedBy[total]];
+            servings[piece.candidate] += piece.servings;
+            total -= kept[piece.candidate].calories * piece.servings;
+        }
+        for (size_t i = 0; i < kept.size(); i++)
+        {
+            if (servings[i] > 0)
+            {
+                plan.portions.push_back({kept[i].name, kept[i].composite, kept[i].calories, servings[i]});
+            }
+        }
+        sort(plan.portions.begin(), plan.portions.end(), [](const Portion &a, const Portion &b) {
+            return a.calories * a.servings > b.calories * b.servings;
+        });
+        plan.found = true;
+        plan.calories = best;
+        return plan;
+    }
+
+    // Shares portions out over the meals of a day, each portion going to the
+    // meal furthest below its share of the plan's calories
+    static vector<vector<Portion>> splitIntoMeals(const Plan &plan, const vector<double> &shares)
+    {
+        vector<vector<Portion>> meals(shares.size());
+        vector<double> room(shares.size());
+        for (size_t m = 0; m < shares.size(); m++)
+        {
+            room[m] = shares[m] * plan.calories;
+        }
+        for (const Portion &portion : plan.portions)
+        {
+            size_t m = max_element(room.begin(), room.end()) - room.begin();
+            meals[m].push_back(portion);
+            room[m] -= portion.calories * portion.servings;
+        }
+        return meals;
+    }
+};
+
+// Catalog filter language, parsed once into a flat postfix program:
+//
+//   query  := or
+//   or     := and ("OR" and)*
+//   and    := unary (["AND"] unary)*
+//   unary  := "NOT" unary | "(" query ")" | term
+//   term   := "calories" ("<" | "<=" | ">" | ">=" | "=" | "!=" | ":") NUMBER
+//           | ("keyword" | "name" | "ingredient" | "contains") (":" | "=") TEXT
+//           | "category" (":" | "=") ("basic" | "composite")
+//
+// "ingredient" looks at a composite's own ingredient list; "contains" at the
+// basic foods it is made of however deeply nested, and at a basic food's
+// own name, so NOT contains:peanut* leaves out anything with peanuts.
+//
+// Words are case-insensitive and TEXT may be quoted. A TEXT with a leading or
+// trailing '*' matches as a suffix, prefix or (with both) substring, else the
+// whole string must match. For example:
+//   calories < 200 AND keyword:fruit AND NOT keyword:sweet AND category:basic
+class FoodQuery
+{
+public:
+    enum class Op : uint8_t { Calories, Category, Keyword, Name, Ingredient, Contains, And, Or, Not };
+    enum class Compare : uint8_t { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+    enum class Match : uint8_t { Exact, Prefix, Suffix, Contains };
+
+    struct Instruction
+    {
+        Op op;
+        Compare compare = Compare::Equal; // Calories
+        Match match = Match::Exact;       // Keyword, Name, Ingredient, Contains
+        int value = 0;                    // Calories: the number, Category: 1 for composite
+        string text{};                    // lowercase, without the '*'
+    };
+
+    vector<Instruction> program;
+
+    static bool matches(string_view text, const Instruction &instruction)
+    {
+        const string &pattern = instruction.text;
+        switch (instruction.match)
+        {
+        case Match::Exact:
+            return text == pattern;
+        case Match::Prefix:
+            return text.substr(0, pattern.size()) == pattern;
+        case Match::Suffix:
+            return text.size() >= pattern.size() && text.substr(text.size() - pattern.size()) == pattern;
+        default:
+            return text.find(pattern) != string_view::npos;
+        }
+    }
+
+    static bool compile(const string &source, FoodQuery &query, string &error)
+    {
+        Parser parser{source};
+        query.program.clear();
+        parser.next();
+        if (!parser.parseOr(query.program) || !parser.expectEnd())
+        {
+            error = parser.error;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Parser
+    {
+        const string &source;
+        size_t pos = 0;
+        enum class Kind { End, Word, Text, Symbol } kind = Kind::End;
+        string token{};       // words lowercased, quoted text as written
+        size_t tokenStart = 0;
+        string error{};
+
+        bool fail(const string &message)
+        {
+            if (error.empty())
+            {
+                error = message + " at position " + to_string(tokenStart + 1);
+            }
+            return false;
+        }
+
+        void next()
+        {
+            while (pos < source.size() && isspace(static_cast<unsigned char>(source[pos])))
+            {
+                pos++;
+            }
+            tokenStart = pos;
+            token.clear();
+            if (pos == source.size())
+            {
+                kind = Kind::End;
+                return;
+            }
+            char c = source[pos];
+            if (c == '"')
+            {
+                size_t close = source.find('"', pos + 1);
+                if (close == string::npos)
+                {
+                    kind = Kind::End;
+                    fail("unterminated quote");
+                    pos = source.size();
+                    return;
+                }
+                kind = Kind::Text;
+                token = source.substr(pos + 1, close - pos - 1);
+                pos = close + 1;
+            }
+            else if (strchr("()<>=!:", c))
+            {
+                kind = Kind::Symbol;
+                token = c;
+                pos++;
+                if ((c == '<' || c == '>' || c == '!') && pos < source.size() && source[pos] == '=')
+                {
+                    token += '=';
+                    pos++;
+                }
+            }
+            else
+            {
+                kind = Kind::Word;
+                while (pos < source.size() && !isspace(static_cast<unsigned char>(source[pos])) && !strchr("()<>=!:\"", source[pos]))
+                {
+                    token += static_cast<char>(tolower(static_cast<unsigned char>(source[pos++])));
+                }
+            }
+        }
+
+        bool isWord(const char *word) const
+        {
+            return kind == Kind::Word && token == word;
+        }
+
+        bool expectEnd()
+        {
+            return kind == Kind::End ? error.empty() : fail("unexpected '" + token + "'");
+        }
+
+        bool parseOr(vector<Instruction> &program)
+        {
+            if (!parseAnd(program))
+                return false;
+            while (isWord("or"))
+            {
+                next();
+                if (!parseAnd(program))
+                    return false;
+                program.push_back({Op::Or});
+            }
+            return true;
+        }
+
+        bool parseAnd(vector<Instruction> &program)
+        {
+            if (!parseUnary(program))
+                return false;
+            while (kind != Kind::End && !isWord("or") && !(kind == Kind::Symbol && token == ")"))
+            {
+                if (isWord("and"))
+                    next();
+                if (!parseUnary(program))
+                    return false;
+                program.push_back({Op::And});
+            }
+            return true;
+        }
+
+        bool parseUnary(vector<Instruction> &program)
+        {
+            if (isWord("not"))
+            {
+                next();
+                if (!parseUnary(program))
+                    return false;
+                program.push_back({Op::Not});
+                return true;
+            }
+            if (kind == Kind::Symbol && token == "(")
+            {
+                next();
+                if (!parseOr(program))
+                    return false;
+                if (!(kind == Kind::Symbol && token == ")"))
+                    return fail("expected ')'");
+                next();
+                return true;
+            }
+            return parseTerm(program);
+        }
+
+        bool parseTerm(vector<Instruction> &program)
+        {
+            if (kind != Kind::Word)
+                return fail(kind == Kind::End ? "expected a condition" : "expected a field name, not '" + token + "'");
+            string field = token;
+            if (field != "calories" && field != "category" && field != "keyword" && field != "name" && field != "ingredient" &&
+                field != "contains")
+                return fail("unknown field '" + field + "'");
+            next();
+            if (kind != Kind::Symbol || token == "(" || token == ")")
+                return fail("expected an operator after '" + field + "'");
+            string symbol = token;
+            next();
+
+            Instruction instruction;
+            if (field == "calories")
+            {
+                static const pair<const char *, Compare> operators[] = {
+                    {"<", Compare::Less}, {"<=", Compare::LessEqual}, {">", Compare::Greater},
+                    {">=", Compare::GreaterEqual}, {"=", Compare::Equal}, {":", Compare::Equal}, {"!=", Compare::NotEqual}};
+                auto found = find_if(begin(operators), end(operators), [&](const auto &entry) { return symbol == entry.first; });
+                if (found == end(operators))
+                    return fail("unknown operator '" + symbol + "'");
+                int value;
+                auto [end, status] = from_chars(token.data(), token.data() + token.size(), value);
+                if (kind != Kind::Word || status != errc() || end != token.data() + token.size())
+                    return fail("expected a number");
+                instruction = {Op::Calories, found->second, Match::Exact, value};
+            }
+            else
+            {
+                if (symbol != ":" && symbol != "=")
+                    return fail("'" + field + "' takes ':' or '='");
+                if (kind != Kind::Word && kind != Kind::Text)
+                    return fail("expected a value for '" + field + "'");
+                string value = token;
+                transform(value.begin(), value.end(), value.begin(), ::tolower);
+                if (field == "category")
+                {
+                    if (value != "basic" && value != "composite")
+                        return fail("category is 'basic' or 'composite'");
+                    instruction = {Op::Category, Compare::Equal, Match::Exact, value == "composite"};
+                }
+                else
+                {
+                    bool leading = !value.empty() && value.front() == '*';
+                    bool trailing = value.size() > leading && value.back() == '*';
+                    value = value.substr(leading, value.size() - leading - trailing);
+                    Match match = leading && trailing ? Match::Contains : leading ? Match::Suffix : trailing ? Match::Prefix : Match::Exact;
+                    Op op = field == "keyword" ? Op::Keyword
+                            : field == "name"  ? Op::Name
+                            : field == "contains" ? Op::Contains
+                                               : Op::Ingredient;
+                    instruction = {op, Compare::Equal, match, 0, value};
+                }
+            }
+            program.push_back(move(instruction));
+            next();
+            return true;
+        }
+    };
+};
+
+// Least-recently-used cache of search results, as the matching catalog rows.
+// An entry remembers the catalog version it was computed at and only counts
+// as a hit at that same version, so a change to the catalog invalidates every
+// cached result at once without having to find them (and rows, which move
+// when foods are erased, are only reused while they are still right). Bounded
+// by entries and by the rows they hold together, since one broad search can
+// match most of the catalog.
+class SearchCache
+{
+public:
+    struct Match
+    {
+        uint32_t row;
+        int score; // relevance before the logging boost, 0 where unranked
+    };
+    using Matches = vector<Match>;
+
+    explicit SearchCache(size_t maxEntries = 64, size_t maxRows = 1 << 20)
+        : maxEntries(maxEntries), maxRows(maxRows)
+    {
+    }
+
+    // Lowercase terms in sorted order with duplicates dropped, so the same
+    // search typed differently shares an entry; kind tells searches apart
+    static string keyOf(char kind, vector<string> terms, bool matchAll)
+    {
+        string key{kind, matchAll ? '&' : '|'};
+        for (auto &term : terms)
+        {
+            transform(term.begin(), term.end(), term.begin(), ::tolower);
+        }
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        for (const auto &term : terms)
+        {
+            key += term;
+            key += '\0';
+        }
+        return key;
+    }
+
+    shared_ptr<const Matches> find(const string &key, uint64_t version)
+    {
+        auto it = byKey.find(key);
+        if (it == byKey.end() || it->second->version != version)
+        {
+            PERF_ADD(SearchCacheMisses, 1);
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        PERF_ADD(SearchCacheHits, 1);
+        return it->second->matches;
+    }
+
+    void insert(const string &key, uint64_t version, shared_ptr<const Matches> matches)
+    {
+        if (matches->size() > maxRows)
+        {
+            return;
+        }
+        auto it = byKey.find(key);
+        if (it != byKey.end())
+        {
+            rows -= it->second->matches->size();
+            entries.erase(it->second);
+            byKey.erase(it);
+        }
+        rows += matches->size();
+        entries.push_front({key, version, move(matches)});
+        byKey[key] = entries.begin();
+
+        while (entries.size() > maxEntries || rows > maxRows)
+        {
+            rows -= entries.back().matches->size();
+            byKey.erase(entries.back().key);
+            entries.pop_back();
+            PERF_ADD(SearchCacheEvictions, 1);
+        }
+        PERF_SET(SearchCacheEntries, entries.size());
+    }
+
+private:
+    struct Entry
+    {
+        string key;
+        uint64_t version;
+        shared_ptr<const Matches> matches;
+    };
+
+    size_t maxEntries, maxRows;
+    size_t rows = 0;
+    list<Entry> entries; // most recently used first
+    unordered_map<string, list<Entry>::iterator> byKey;
+};
+
+// Composite foods flattened to basic ones: for a composite, every basic food
+// reached through its ingredients and theirs, with how many servings of it
+// one serving holds. Expansions are made on demand and kept until a food
+// they went through changes. Each remembers the names along its chain
+// (missing ingredients included, so adding one later counts), and touch()
+// drops exactly the expansions whose chain has the name, leaving the rest.
+// Back-links from a name to the expansions using it are not removed when an
+// expansion goes; touch() checks each against the current chain instead.
+// Expansions cut short by a cycle are never stored here.
+class ExpansionCache
+{
+public:
+    struct Part
+    {
+        uint32_t food;    // folded name ID of a basic food
+        int64_t servings; // in one serving of the composite
+    };
+
+    struct Expansion
+    {
+        vector<Part> parts;     // by food ID
+        vector<uint32_t> chain; // folded names it depends on, itself included, sorted
+        bool complete = true;   // false if an ingredient is missing or leads back to itself
+        bool cut = false;       // stopped at a composite further up; depends on the path, so not cached
+
+        // Servings of a basic food in one serving, 0 if it is not in there
+        int64_t servingsOf(uint32_t food) const
+        {
+            auto it = lower_bound(parts.begin(), parts.end(), food, [](const Part &part, uint32_t id) { return part.food < id; });
+            return it != parts.end() && it->food == food ? it->servings : 0;
+        }
+    };
+
+    const Expansion *find(uint32_t composite) const
+    {
+        auto it = entries.find(composite);
+        if (it == entries.end())
+        {
+            PERF_ADD(ExpansionCacheMisses, 1);
+            return nullptr;
+        }
+        PERF_ADD(ExpansionCacheHits, 1);
+        return &it->second;
+    }
+
+    const Expansion &insert(uint32_t composite, Expansion expansion)
+    {
+        for (uint32_t name : expansion.chain)
+        {
+            dependents[name].push_back(composite);
+        }
+        const Expansion &stored = entries[composite] = move(expansion);
+        PERF_SET(ExpansionCacheEntries, entries.size());
+        return stored;
+    }
+
+    // Forgets every expansion that went through this food name
+    void touch(uint32_t name)
+    {
+        auto it = dependents.find(name);
+        if (it == dependents.end())
+        {
+            return;
+        }
+        vector<uint32_t> users = move(it->second);
+        dependents.erase(it);
+        for (uint32_t composite : users)
+        {
+            auto entry = entries.find(composite);
+            const vector<uint32_t> *chain = entry == entries.end() ? nullptr : &entry->second.chain;
+            if (chain && binary_search(chain->begin(), chain->end(), name))
+            {
+                entries.erase(entry);
+                PERF_ADD(ExpansionCacheDrops, 1);
+            }
+        }
+        PERF_SET(ExpansionCacheEntries, entries.size());
+    }
+
+    void clear()
+    {
+        entries.clear();
+        dependents.clear();
+        PERF_SET(ExpansionCacheEntries, 0);
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    unordered_map<uint32_t, Expansion> entries;           // composite folded name -> expansion
+    unordered_map<uint32_t, vector<uint32_t>> dependents; // folded name -> composites whose chain has it
+};
+
+// Composites by the folded names of their ingredients, so the foods using
+// one are found without walking the catalog. Built by the first lookup and
+// then kept exact: replacing or erasing a composite removes the links of its
+// old ingredient list before the new one is added.
+class IngredientIndex
+{
+    unordered_map<uint32_t, vector<uint32_t>> users; // ingredient folded name -> composites listing it
+    bool built = false;
+
+public:
+    bool isBuilt() const
+    {
+        return built;
+    }
+
+    void markBuilt()
+    {
+        built = true;
+    }
+
+    void add(uint32_t ingredient, uint32_t composite)
+    {
+        users[ingredient].push_back(composite);
+    }
+
+    void remove(uint32_t ingredient, uint32_t composite)
+    {
+        auto it = users.find(ingredient);
+        if (it == users.end())
+        {
+            return;
+        }
+        vector<uint32_t> &composites = it->second;
+        auto found = std::find(composites.begin(), composites.end(), composite);
+        if (found != composites.end())
+        {
+            *found = composites.back();
+            composites.pop_back();
+        }
+        if (composites.empty())
+        {
+            users.erase(it);
+        }
+    }
+
+    // Composites listing this ingredient, in no particular order, or nullptr
+    const vector<uint32_t> *find(uint32_t ingredient) const
+    {
+        auto it = users.find(ingredient);
+        return it == users.end() ? nullptr : &it->second;
+    }
+
+    void clear()
+    {
+        users.clear();
+        built = false;
+    }
+};
+
+class FoodDatabase
+{
+protected:
+    string filename;
+    StringInterner &strings; // the constructor's interner, by default the global one the food log also uses
+    FoodCatalog catalog;
+    CommandManager commandManager;
+    DeferredSave pendingSave{[this]() { saveDatabase(); }};
+    string foldBuffer;
+    FuzzyIndex nameIndex; // folded names, built by the first suggestFoods
+    mutable PrefixIndex prefixIndex; // folded names, built by the first completeFoods or listing
+    CalorieIndex calorieIndex; // foods by calories, built by the first foodsWithin
+    uint64_t version = 0;      // bumped by every change to the catalog
+    SearchCache searchCache;
+    ExpansionCache expansions; // composites flattened to basic foods, made by expandComposite
+    IngredientIndex ingredientIndex; // composites by ingredient, built by the first compositesUsing
+    deque<ExpansionCache::Expansion> uncachedExpansions; // ones cut at a cycle, kept for one expandComposite
+
+    static string toLower(string text)
+    {
+        transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    }
+
+    uint32_t foldedId(uint32_t nameId)
+    {
+        // Reuses one buffer so loading a catalog does not allocate per name
+        string_view name = strings.str(nameId);
+        foldBuffer.assign(name.begin(), name.end());
+        transform(foldBuffer.begin(), foldBuffer.end(), foldBuffer.begin(), ::tolower);
+        return strings.intern(foldBuffer);
+    }
+
+    // Row of the food with this lowercase name, or FoodCatalog::npos
+    uint32_t findRow(bool composite, const string &lowerName) const
+    {
+        uint32_t id = strings.find(lowerName);
+        return id == StringInterner::npos ? FoodCatalog::npos : catalog.find(composite, id);
+    }
+
+    // Inserts a record, replacing any food of the same category and name
+    void putRecord(const FoodRecord &record)
+    {
+        uint32_t folded = foldedId(record.name);
+        uint32_t previous = catalog.find(record.composite, folded);
+        if (previous != FoodCatalog::npos)
+        {
+            indexIngredients(previous, false);
+        }
+        catalog.upsert(record, folded);
+        indexIngredients(catalog.find(record.composite, folded), true);
+        version++;
+        if (!nameIndex.empty())
+        {
+            nameIndex.insert(folded, strings);
+        }
+        prefixIndex.touch(folded);
+        calorieIndex.touch(folded, record.composite);
+        expansions.touch(folded);
+    }
+
+    void eraseRow(uint32_t row)
+    {
+        prefixIndex.touch(catalog.foldedName(row));
+        calorieIndex.touch(catalog.foldedName(row), catalog.isComposite(row));
+        expansions.touch(catalog.foldedName(row));
+        indexIngredients(row, false);
+        catalog.erase(row);
+        version++;
+    }
+
+    // Adds or removes a composite's links in the ingredient index, once it is built
+    void indexIngredients(uint32_t row, bool add)
+    {
+        if (!ingredientIndex.isBuilt() || !catalog.isComposite(row))
+        {
+            return;
+        }
+        uint32_t composite = catalog.foldedName(row);
+        for (uint32_t ingredient : catalog.ingredients(row))
+        {
+            if (add)
+                ingredientIndex.add(foldedId(ingredient), composite);
+            else
+                ingredientIndex.remove(foldedId(ingredient), composite);
+        }
+    }
+
+    // Flattens a composite, reusing the cached expansions of composites it
+    // uses. Ingredients resolve like findFood, basic foods first; visiting
+    // holds the composites being expanded further up, to catch cycles. An
+    // expansion cut at a cycle goes to uncachedExpansions instead of the cache.
+    const ExpansionCache::Expansion &expand(uint32_t composite, vector<uint32_t> &visiting)
+    {
+        if (const ExpansionCache::Expansion *cached = expansions.find(composite))
+        {
+            return *cached;
+        }
+
+        ExpansionCache::Expansion result;
+        result.chain.push_back(composite);
+        visiting.push_back(composite);
+        uint32_t row = catalog.find(true, composite);
+        ColumnRange<uint32_t> ingredients = catalog.ingredients(row);
+        ColumnRange<int32_t> servings = catalog.servings(row);
+        for (size_t i = 0; i < ingredients.size(); i++)
+        {
+            uint32_t name = foldedId(ingredients[i]);
+            result.chain.push_back(name);
+            if (catalog.find(false, name) != FoodCatalog::npos)
+            {
+                result.parts.push_back({name, servings[i]});
+            }
+            else if (catalog.find(true, name) == FoodCatalog::npos)
+            {
+                result.complete = false;
+            }
+            else if (find(visiting.begin(), visiting.end(), name) != visiting.end())
+            {
+                result.complete = false;
+                result.cut = true;
+            }
+            else
+            {
+                const ExpansionCache::Expansion &inner = expand(name, visiting);
+                for (const ExpansionCache::Part &part : inner.parts)
+                {
+                    result.parts.push_back({part.food, part.servings * servings[i]});
+                }
+                result.chain.insert(result.chain.end(), inner.chain.begin(), inner.chain.end());
+                result.complete = result.complete && inner.complete;
+                result.cut = result.cut || inner.cut;
+            }
+        }
+        visiting.pop_back();
+
+        // One part per basic food, however many paths lead to it
+        sort(result.parts.begin(), result.parts.end(), [](const auto &a, const auto &b) { return a.food < b.food; });
+        size_t kept = 0;
+        for (size_t i = 0; i < result.parts.size(); i++)
+        {
+            if (kept > 0 && result.parts[kept - 1].food == result.parts[i].food)
+                result.parts[kept - 1].servings += result.parts[i].servings;
+            else
+                result.parts[kept++] = result.parts[i];
+        }
+        result.parts.resize(kept);
+        sort(result.chain.begin(), result.chain.end());
+        result.chain.erase(unique(result.chain.begin(), result.chain.end()), result.chain.end());
+        if (result.cut)
+        {
+            return uncachedExpansions.emplace_back(move(result));
+        }
+        return expansions.insert(composite, move(result));
+    }
+
+    void eraseRecord(bool composite, const string &lowerName)
+    {
+        uint32_t row = findRow(composite, lowerName);
+        if (row != FoodCatalog::npos)
+        {
+            eraseRow(row);
+        }
+    }
+
+    FoodRecord makeRecord(const string &name, bool composite, const vector<string> &keywords, int calories,
+                          const Nutrients &nutrients, const unordered_map<string, int> &ingredients = {})
+    {
+        FoodRecord record;
+        record.name = strings.intern(name);
+        record.composite = composite;
+        record.calories = calories;
+        record.nutrients = nutrients;
+        for (const auto &keyword : keywords)
+        {
+            record.keywords.push_back(strings.intern(keyword));
+        }
+        for (const auto &[ingredient, servings] : ingredients)
+        {
+            record.ingredients.emplace_back(strings.intern(ingredient), servings);
+        }
+        return record;
+    }
+
+    // The JSON shape of a food as stored in food_db.json and embedded in log entries
+    json toJson(uint32_t row) const
+    {
+        json keywords = json::array();
+        for (uint32_t keyword : catalog.keywords(row))
+        {
+            keywords.push_back(string(strings.str(keyword)));
+        }
+
+        json details = {
+            {"keywords", keywords},
+            {"calories", catalog.calories(row)}};
+
+        if (catalog.isComposite(row))
+        {
+            details["ingredients"] = json::object();
+            ColumnRange<uint32_t> ingredients = catalog.ingredients(row);
+            ColumnRange<int32_t> servings = catalog.servings(row);
+            for (size_t i = 0; i < ingredients.size(); i++)
+            {
+                details["ingredients"][string(strings.str(ingredients[i]))] = servings[i];
+            }
+        }
+        catalog.nutrients(row).addTo(details);
+        return details;
+    }
+
+    void addRowToJson(json &results, uint32_t row) const
+    {
+        results[catalog.isComposite(row) ? "composite" : "basic"][string(strings.str(catalog.name(row)))] = toJson(row);
+    }
+
+public:
+    size_t countFoods(bool composite) const
+    {
+        return catalog.count(composite);
+    }
+
+    // Read-only view of one food, pointing into the catalog and the string
+    // table instead of copying out of them; valid until the catalog changes
+    class FoodView
+    {
+        const FoodCatalog *catalog;
+        const StringInterner *strings;
+        uint32_t at;
+
+    public:
+        FoodView(const FoodCatalog &catalog, const StringInterner &strings, uint32_t row)
+            : catalog(&catalog), strings(&strings), at(row)
+        {
+        }
+
+        uint32_t row() const { return at; }
+        string_view name() const { return strings->str(catalog->name(at)); }
+        bool composite() const { return catalog->isComposite(at); }
+        int calories() const { return catalog->calories(at); }
+        InternedRange keywords() const { return {catalog->keywords(at), *strings}; }
+        InternedRange ingredients() const { return {catalog->ingredients(at), *strings}; }
+        ColumnRange<int32_t> servings() const { return catalog->servings(at); }
+    };
+
+    // The foods of one category in name order, walked along the prefix index
+    // so listing them copies and allocates nothing once the index exists
+    class FoodRange
+    {
+        const FoodDatabase *db;
+        bool composite;
+
+    public:
+        class iterator
+        {
+            const FoodDatabase *db;
+            bool composite;
+            size_t position;
+
+            void skipAbsent()
+            {
+                const vector<uint32_t> &names = db->prefixIndex.sorted();
+                while (position < names.size() && db->catalog.find(composite, names[position]) == FoodCatalog::npos)
+                {
+                    position++;
+                }
+            }
+
+        public:
+            using iterator_category = forward_iterator_tag;
+            using value_type = FoodView;
+            using difference_type = ptrdiff_t;
+            using pointer = const FoodView *;
+            using reference = FoodView;
+
+            iterator(const FoodDatabase *db, bool composite, size_t position) : db(db), composite(composite), position(position)
+            {
+                skipAbsent();
+            }
+            FoodView operator*() const
+            {
+                return {db->catalog, db->strings, db->catalog.find(composite, db->prefixIndex.sorted()[position])};
+            }
+            iterator &operator++()
+            {
+                position++;
+                skipAbsent();
+                return *this;
+            }
+            bool operator==(const iterator &other) const { return position == other.position; }
+            bool operator!=(const iterator &other) const { return position != other.position; }
+        };
+
+        FoodRange(const FoodDatabase *db, bool composite) : db(db), composite(composite) {}
+        iterator begin() const { return {db, composite, 0}; }
+        iterator end() const { return {db, composite, db->prefixIndex.sorted().size()}; }
+    };
+
+    FoodRange foods(bool composite) const
+    {
+        preparePrefixIndex();
+        return {this, composite};
+    }
+
+    FoodView view(uint32_t row) const
+    {
+        return {catalog, strings, row};
+    }
+
+    enum class FoodOrder
+    {
+        Category, // basic foods, then composite ones, each by name
+        Name,
+        Calories  // fewest first, then by name
+    };
+
+    // Catalog rows in the given order, for paging through with view(); the
+    // name orders come straight off the prefix index, so only sorting by
+    // calories compares anything. Valid until the catalog changes.
+    vector<uint32_t> orderFoods(FoodOrder order) const
+    {
+        PERF_SCOPE(SortFoods);
+        TRACE_SPAN("orderFoods", "search");
+        preparePrefixIndex();
+        vector<uint32_t> rows;
+        rows.reserve(catalog.size());
+        if (order == FoodOrder::Category)
+        {
+            for (bool composite : {false, true})
+            {
+                for (const FoodView &food : foods(composite))
+                {
+                    rows.push_back(food.row());
+                }
+            }
+            return rows;
+        }
+
+        for (uint32_t id : prefixIndex.sorted())
+        {
+            for (bool composite : {false, true})
+            {
+                uint32_t row = catalog.find(composite, id);
+                if (row != FoodCatalog::npos)
+                {
+                    rows.push_back(row);
+                }
+            }
+        }
+        if (order == FoodOrder::Calories)
+        {
+            stable_sort(rows.begin(), rows.end(), [this](uint32_t a, uint32_t b) {
+                return catalog.calories(a) < catalog.calories(b);
+            });
+        }
+        return rows;
+    }
+
+    bool canUndo() const
+    {
+        return commandManager.canUndo();
+    }
+
+    bool canRedo() const
+    {
+        return commandManager.canRedo();
+    }
+
+    void undo()
+    {
+        commandManager.undo();
+    }
+
+    void redo()
+    {
+        commandManager.redo();
+    }
+
+    // Groups the following mutations into one step: saved once on commit,
+    // undone and redone as a unit, or rolled back entirely by abort
+    void beginTransaction()
+    {
+        commandManager.beginGroup();
+        pendingSave.hold();
+    }
+
+    void commitTransaction()
+    {
+        commandManager.commitGroup([this](const function<void()> &steps) { pendingSave.around(steps); });
+        pendingSave.release();
+    }
+
+    void abortTransaction()
+    {
+        commandManager.abortGroup();
+        pendingSave.release(false);
+    }
+
+    FoodDatabase(const string &file = "food_db.json", StringInterner &interner = StringInterner::global())
+        : filename(file), strings(interner)
+    {
+        loadDatabase();
+    }
+
+    // Pending saves point into the interner, so they must land first
+    virtual ~FoodDatabase()
+    {
+        BackgroundWriter::instance().flush();
+    }
+
+    virtual void loadDatabase()
+    {
+        PERF_SCOPE(LoadDatabase);
+        TRACE_SPAN("loadDatabase", "io");
+        catalog.clear();
+        version++;
+        nameIndex.clear();
+        prefixIndex.clear();
+        calorieIndex.clear();
+        expansions.clear();
+        ingredientIndex.clear();
+
+        FastJson::Buffer buffer;
+        if (FastJson::readFile(filename, buffer))
+        {
+            // Straight from the structural index into the catalog, no DOM in between
+            FoodRecordSax handler(strings, [this](const FoodRecord &record) { putRecord(record); });
+            string error;
+            if (!FastJson::parse(buffer, handler, error))
+            {
+                throw runtime_error(filename + ": " + error);
+            }
+        }
+        updateSizeStats();
+    }
+
+    virtual void saveDatabase()
+    {
+        if (pendingSave.defer())
+        {
+            return;
+        }
+        PERF_SCOPE(SaveDatabase);
+        TRACE_SPAN("saveDatabase", "io");
+        // Only the copy happens here; serializing and writing is the writer thread's job
+        shared_ptr<const CatalogSnapshot> snapshot = catalog.snapshot(strings);
+        BackgroundWriter::instance().submit(filename, PerfCounter::DatabaseBytesWritten,
+                                            [snapshot](string &out) { snapshot->serialize(out); });
+        updateSizeStats();
+    }
+
+    void updateSizeStats()
+    {
+        PERF_SET(CatalogBasicFoods, countFoods(false));
+        PERF_SET(CatalogCompositeFoods, countFoods(true));
+    }
+
+    void countStringReferences(StringReferences &references) const
+    {
+        for (uint32_t row = 0; row < catalog.size(); row++)
+        {
+            references.add(strings.str(catalog.name(row)));
+            for (uint32_t keyword : catalog.keywords(row))
+            {
+                references.add(strings.str(keyword));
+            }
+            for (uint32_t ingredient : catalog.ingredients(row))
+            {
+                references.add(strings.str(ingredient));
+            }
+        }
+    }
+
+    // Looks a food up by lowercase name, basic foods first, then composites
+    bool findFood(const string &lowerName, string &matchedName, int &calories)
+    {
+        PERF_SCOPE(IngredientLookup);
+        TRACE_SPAN("findFood", "search");
+        for (bool composite : {false, true})
+        {
+            uint32_t row = findRow(composite, lowerName);
+            if (row != FoodCatalog::npos)
+            {
+                matchedName = lowerName;
+                calories = catalog.calories(row);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Names of foods within a few typing mistakes of the given name, nearest
+    // first. Erased foods stay in the index, so hits are checked against the
+    // catalog, which keeps the suggestions right through undo and redo.
+    vector<string> suggestFoods(const string &name, size_t limit = 5)
+    {
+        PERF_SCOPE(FuzzyLookup);
+        TRACE_SPAN("suggestFoods", "search");
+        if (nameIndex.empty())
+        {
+            for (uint32_t row = 0; row < catalog.size(); row++)
+            {
+                nameIndex.insert(catalog.foldedName(row), strings);
+            }
+        }
+
+        string lowerName = toLower(name);
+        int maxDistance = lowerName.size() <= 4 ? 1 : 2;
+        vector<string> suggestions;
+        for (const auto &match : nameIndex.find(lowerName, maxDistance, numeric_limits<size_t>::max(), strings))
+        {
+            if (catalog.find(false, match.id) != FoodCatalog::npos || catalog.find(true, match.id) != FoodCatalog::npos)
+            {
+                suggestions.emplace_back(strings.str(match.id));
+                if (suggestions.size() == limit)
+                {
+                    break;
+                }
+            }
+        }
+        return suggestions;
+    }
+
+    void addBasicFood(const string& name, const vector<string>& keywords, int calories, const Nutrients &nutrients = {}) {
+        TRACE_SPAN("addBasicFood", "command");
+        // Convert name to lowercase for consistent storage
+        string lowerName = name;
+        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+    
+        // Save the current state for undo
+        uint32_t existing = findRow(false, lowerName);
+        optional<FoodRecord> previousState;
+        if (existing != FoodCatalog::npos)
+            previousState = catalog.record(existing);
+    
+        // Check if food already exists (case insensitive)
+        if (existing != FoodCatalog::npos) {
+            cout << "Food '" << lowerName << "' already exists with "
+                 << catalog.calories(existing) << " calories.\n"
+                 << "Do you want to update it? (1 = Yes, 0 = No): ";
+    
+            int choice;
+            while (!(cin >> choice) || (choice != 0 && choice != 1)) {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter 1 to update, 0 to cancel: ";
+            }
+            cin.ignore();
+    
+            if (choice == 0) {
+                cout << "Food not updated.\n";
+                return;
+            }
+        }
+    
+        // Create the do command
+        auto doCmd = [this, lowerName, keywords, calories, nutrients]() {
+            putRecord(makeRecord(lowerName, false, keywords, calories, nutrients));
+            saveDatabase();
+            cout << "Basic food '" << lowerName << "' added/updated successfully!\n";
+        };
+    
+        // Create the undo command
+        auto undoCmd = [this, lowerName, previousState]() {
+            if (!previousState) {
+                // If the food was newly added, remove it from the database
+                eraseRecord(false, lowerName);
+            } else {
+                // If the food existed before, restore its previous state
+                putRecord(*previousState);
+            }
+            saveDatabase();
+            cout << "Undo: Basic food '" << lowerName << "' removed or restored to its previous state.\n";
+        };
+    
+        // Execute the command
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    void addBasicFoodUI()
+    {
+        string name;
+        vector<string> keywords;
+        int calories, keywordCount;
+
+        cout << "Enter food name: ";
+        getline(cin, name);
+
+        // Ask user for the number of keywords
+        cout << "Enter the number of keywords: ";
+        while (!(cin >> keywordCount) || keywordCount < 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a non-negative number: ";
+        }
+        cin.ignore();
+
+        keywords.resize(keywordCount);
+        for (int i = 0; i < keywordCount; ++i)
+        {
+            cout << "Enter keyword " << i + 1 << ": ";
+            getline(cin, keywords[i]);
+        }
+
+        // Get calorie value
+        cout << "Enter calories: ";
+        while (!(cin >> calories) || calories <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive calorie value: ";
+        }
+        cin.ignore();
+
+        // Optional nutrients per serving
+        string line, error;
+        Nutrients nutrients;
+        cout << "Enter nutrients per serving, e.g. protein=3.5 fat=1 (empty for none): ";
+        while (getline(cin, line) && !Nutrients::parse(line, nutrients, error))
+        {
+            cout << "Invalid input! " << error << ". Nutrients are";
+            for (const char *nutrient : Nutrients::names)
+            {
+                cout << " " << nutrient;
+            }
+            cout << ": ";
+        }
+
+        addBasicFood(name, keywords, calories, nutrients);
+    }
+
+    void addCompositeFood(const string &name, const vector<string> &keywords, unordered_map<string, int> &ingredients)
+    {
+        TRACE_SPAN("addCompositeFood", "command");
+        string lowerName = name;
+        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+
+        int totalCalories = 0;
+        unordered_map<string, int> finalIngredients;
+
+        for (auto &[ingredientName, servings] : ingredients)
+        {
+            string lowerIngredientName = ingredientName;
+            transform(lowerIngredientName.begin(), lowerIngredientName.end(), lowerIngredientName.begin(), ::tolower);
+
+            string matchedName;
+            int calories = 0;
+
+            // Search "basic" first, then "composite"
+            bool found = findFood(lowerIngredientName, matchedName, calories);
+            if (found)
+            {
+                totalCalories += calories * servings;
+                finalIngredients[matchedName] = servings;
+            }
+
+            // If ingredient is not found, prompt user for a valid one
+            string attempt = lowerIngredientName;
+            while (!found)
+            {
+                cout << "Error: Ingredient '" << ingredientName << "' not found.\n";
+                vector<string> suggestions = suggestFoods(attempt);
+                if (!suggestions.empty())
+                {
+                    cout << "Did you mean:\n";
+                    for (size_t i = 0; i < suggestions.size(); i++)
+                    {
+                        cout << "  " << i + 1 << ". " << suggestions[i] << "\n";
+                    }
+                    cout << "Enter a valid ingredient name or a suggestion number: ";
+                }
+                else
+                {
+                    cout << "Enter a valid ingredient name: ";
+                }
+                string newIngredientName; // FIX: Separate input variable
+                getline(cin, newIngredientName);
+                transform(newIngredientName.begin(), newIngredientName.end(), newIngredientName.begin(), ::tolower);
+
+                // A number picks a suggestion, unless a food is called that
+                string matched;
+                int known;
+                size_t choice = 0;
+                auto [end, error] = from_chars(newIngredientName.data(), newIngredientName.data() + newIngredientName.size(), choice);
+                if (error == errc() && end == newIngredientName.data() + newIngredientName.size() && choice >= 1 &&
+                    choice <= suggestions.size() && !findFood(newIngredientName, matched, known))
+                {
+                    newIngredientName = suggestions[choice - 1];
+                }
+                attempt = newIngredientName;
+
+                // Recheck ingredient
+                found = findFood(newIngredientName, matchedName, calories);
+                if (found)
+                {
+                    totalCalories += calories * servings;
+                    finalIngredients[matchedName] = servings;
+                }
+            }
+        }
+        uint32_t existing = findRow(true, lowerName);
+        optional<FoodRecord> previousState;
+        if (existing != FoodCatalog::npos)
+            previousState = catalog.record(existing);
+
+        // Check if composite food exists
+        if (existing != FoodCatalog::npos)
+        {
+            cout << "Composite food '" << lowerName << "' already exists with "
+                 << catalog.calories(existing) << " calories.\n"
+                 << "Do you want to update it? (1 = Yes, 0 = No): ";
+
+            int choice;
+            while (!(cin >> choice) || (choice != 0 && choice != 1))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter 1 to update, 0 to cancel: ";
+            }
+            cin.ignore();
+
+            if (choice == 0)
+            {
+                cout << "Composite food not updated.\n";
+                return;
+            }
+        }
+
+        // Nutrients add up over the ingredients like calories, found the way findFood finds them
+        Nutrients totalNutrients;
+        for (const auto &[ingredient, servings] : finalIngredients)
+        {
+            uint32_t row = findRow(false, ingredient);
+            if (row == FoodCatalog::npos)
+                row = findRow(true, ingredient);
+            totalNutrients.addScaled(catalog.nutrients(row), static_cast<float>(servings));
+        }
+
+        auto doCmd = [this, lowerName, keywords, finalIngredients, totalCalories, totalNutrients]() {
+            PERF_SCOPE(AddCompositeFood);
+            TRACE_SPAN("addCompositeFood.commit", "command");
+            putRecord(makeRecord(lowerName, true, keywords, totalCalories, totalNutrients, finalIngredients));
+            saveDatabase();
+            cout << "Composite food '" << lowerName << "' added/updated successfully!\n";
+        };
+    
+        // Create the undo command
+        auto undoCmd = [this, lowerName, previousState]() {
+            if (!previousState) {
+                // If the food was newly added, remove it from the database
+                eraseRecord(true, lowerName);
+            } else {
+                // If the food existed before, restore its previous state
+                putRecord(*previousState);
+            }
+            saveDatabase();
+            cout << "Undo: Composite food '" << lowerName << "' removed or restored to its previous state.\n";
+        };
+        // Execute the command
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    void addCompositeFoodUI()
+    {
+        string name;
+        vector<string> keywords;
+        unordered_map<string, int> ingredients;
+        int keywordCount, ingredientCount;
+
+        cout << "Enter composite food name: ";
+        getline(cin, name); // Removed the unnecessary cin.ignore()
+
+        // Ask user for number of keywords
+        cout << "Enter number of keywords: ";
+        while (!(cin >> keywordCount) || keywordCount < 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a non-negative number: ";
+        }
+        cin.ignore(); // Correct usage after cin >>
+
+        keywords.resize(keywordCount);
+        for (int i = 0; i < keywordCount; ++i)
+        {
+            cout << "Enter keyword " << i + 1 << ": ";
+            getline(cin, keywords[i]);
+        }
+
+        // Ask user for number of ingredients
+        cout << "Enter number of ingredients: ";
+        while (!(cin >> ingredientCount) || ingredientCount <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+        cin.ignore(); // Correct usage after cin >>
+
+        for (int i = 0; i < ingredientCount; ++i)
+        {
+            string ingredientName;
+            int servings;
+            cout << "Enter ingredient name: ";
+            getline(cin, ingredientName);
+            cout << "Enter number of servings: ";
+            while (!(cin >> servings) || servings <= 0)
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter a positive number: ";
+            }
+            cin.ignore(); // Correct usage after cin >>
+            ingredients[ingredientName] = servings;
+        }
+
+        addCompositeFood(name, keywords, ingredients);
+    }
+
+    // Adds a parsed batch as one undoable step with a single save. Names the
+    // catalog already has are skipped, the first of repeated names wins, and
+    // composites are resolved in dependency order, so they may use foods that
+    // appear later in the same file. Ingredients resolve like findFood: basic
+    // foods first, then composites.
+    void importFoods(const vector<ImportRow> &rows, const string &source, ImportReport &report)
+    {
+        PERF_SCOPE(ImportFoods);
+        TRACE_SPAN("importFoods", "import");
+        auto start = chrono::steady_clock::now();
+
+        enum State : uint8_t { Skipped, Pending, Resolved, Failed };
+        vector<uint8_t> state(rows.size(), Skipped);
+
+        // Accepted rows by name, per category
+        unordered_map<string_view, uint32_t> accepted[2];
+        for (uint32_t i = 0; i < rows.size(); i++)
+        {
+            const ImportRow &row = rows[i];
+            if (findRow(false, row.name) != FoodCatalog::npos || findRow(true, row.name) != FoodCatalog::npos)
+            {
+                report.alreadyInDatabase++;
+                continue;
+            }
+            if (accepted[0].count(row.name) || accepted[1].count(row.name))
+            {
+                report.duplicatesInFile++;
+                report.note(source, row.line, "'" + row.name + "' repeats an earlier row, skipped");
+                continue;
+            }
+            accepted[!row.ingredients.empty()].emplace(row.name, i);
+            state[i] = Pending;
+        }
+
+        vector<int> calories(rows.size(), 0);
+        vector<Nutrients> nutrients(rows.size());
+        auto fail = [&](uint32_t i, const string &reason) {
+            state[i] = Failed;
+            report.reject(source, rows[i].line, "'" + rows[i].name + "' " + reason);
+        };
+
+        // Where an ingredient comes from: a catalog row, a basic row of this
+        // batch (ready now) or a composite row of this batch (ready once resolved)
+        struct Source
+        {
+            uint32_t catalogRow = FoodCatalog::npos;
+            uint32_t batchRow = FoodCatalog::npos;
+        };
+        auto locate = [&](const string &name) {
+            Source found;
+            if ((found.catalogRow = findRow(false, name)) != FoodCatalog::npos)
+                return found;
+            auto basic = accepted[0].find(name);
+            if (basic != accepted[0].end())
+            {
+                found.batchRow = basic->second;
+                return found;
+            }
+            if ((found.catalogRow = findRow(true, name)) != FoodCatalog::npos)
+                return found;
+            auto composite = accepted[1].find(name);
+            if (composite != accepted[1].end())
+                found.batchRow = composite->second;
+            return found;
+        };
+
+        for (uint32_t i = 0; i < rows.size(); i++)
+        {
+            if (state[i] == Pending && rows[i].ingredients.empty())
+            {
+                calories[i] = rows[i].calories;
+                nutrients[i] = rows[i].nutrients;
+                state[i] = Resolved;
+            }
+        }
+
+        // Kahn's algorithm over composite -> composite edges within the batch,
+        // taking ready rows in file order
+        vector<uint32_t> waiting(rows.size(), 0);
+        unordered_map<uint32_t, vector<uint32_t>> dependents;
+        deque<uint32_t> ready;
+        for (uint32_t i = 0; i < rows.size(); i++)
+        {
+            if (state[i] != Pending)
+                continue;
+            for (const auto &[ingredient, servings] : rows[i].ingredients)
+            {
+                Source found = locate(ingredient);
+                if (found.catalogRow == FoodCatalog::npos && found.batchRow == FoodCatalog::npos)
+                {
+                    if (state[i] != Failed)
+                        fail(i, "uses unknown ingredient '" + ingredient + "'");
+                }
+                else if (found.batchRow != FoodCatalog::npos && state[found.batchRow] != Resolved)
+                {
+                    waiting[i]++;
+                    dependents[found.batchRow].push_back(i);
+                }
+            }
+            if (waiting[i] == 0)
+                ready.push_back(i);
+        }
+
+        while (!ready.empty())
+        {
+            uint32_t i = ready.front();
+            ready.pop_front();
+            if (state[i] == Pending)
+            {
+                int64_t total = 0;
+                for (const auto &[ingredient, servings] : rows[i].ingredients)
+                {
+                    Source found = locate(ingredient);
+                    if (found.batchRow != FoodCatalog::npos && state[found.batchRow] == Failed)
+                    {
+                        fail(i, "uses rejected ingredient '" + ingredient + "'");
+                        break;
+                    }
+                    bool inBatch = found.batchRow != FoodCatalog::npos;
+                    int each = inBatch ? calories[found.batchRow] : catalog.calories(found.catalogRow);
+                    total += static_cast<int64_t>(each) * servings;
+                    nutrients[i].addScaled(inBatch ? nutrients[found.batchRow] : catalog.nutrients(found.catalogRow),
+                                           static_cast<float>(servings));
+                }
+                if (state[i] == Pending && total > numeric_limits<int>::max())
+                    fail(i, "has more calories than can be stored");
+                if (state[i] == Pending)
+                {
+                    calories[i] = static_cast<int>(total);
+                    state[i] = Resolved;
+                }
+            }
+            auto waiters = dependents.find(i);
+            if (waiters != dependents.end())
+            {
+                for (uint32_t dependent : waiters->second)
+                {
+                    if (--waiting[dependent] == 0)
+                        ready.push_back(dependent);
+                }
+            }
+        }
+        for (uint32_t i = 0; i < rows.size(); i++)
+        {
+            if (state[i] == Pending)
+                fail(i, "is part of a circular ingredient list");
+        }
+
+        // Resolved rows, in file order
+        auto records = make_shared<vector<FoodRecord>>();
+        for (uint32_t i = 0; i < rows.size(); i++)
+        {
+            if (state[i] != Resolved)
+                continue;
+            const ImportRow &row = rows[i];
+            FoodRecord record;
+            record.name = strings.intern(row.name);
+            record.composite = !row.ingredients.empty();
+            record.calories = calories[i];
+            record.nutrients = nutrients[i];
+            for (const string &keyword : row.keywords)
+            {
+                record.keywords.push_back(strings.intern(keyword));
+            }
+            for (const auto &[ingredient, servings] : row.ingredients)
+            {
+                record.ingredients.emplace_back(strings.intern(ingredient), servings);
+            }
+            (record.composite ? report.compositeAdded : report.basicAdded)++;
+            records->push_back(move(record));
+        }
+        report.resolveSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (records->empty())
+        {
+            return;
+        }
+
+        auto doCmd = [this, records]()
+        {
+            for (const FoodRecord &record : *records)
+            {
+                putRecord(record);
+            }
+            saveDatabase();
+        };
+
+        // None of the names existed before the import, so undoing removes them all.
+        // Imported names are already lowercase, which makes them their own catalog key.
+        auto undoCmd = [this, records]()
+        {
+            for (const FoodRecord &record : *records)
+            {
+                uint32_t row = catalog.find(record.composite, record.name);
+                if (row != FoodCatalog::npos)
+                {
+                    eraseRow(row);
+                }
+            }
+            saveDatabase();
+        };
+
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    void importFoodsUI()
+    {
+        string path;
+        cout << "Enter path of a .csv or .ndjson file to import: ";
+        getline(cin, path);
+
+        vector<ImportRow> rows;
+        ImportReport report;
+        if (FoodImporter::read(path, rows, report))
+        {
+            importFoods(rows, path, report);
+        }
+        report.print(cout);
+    }
+
+    json searchFood(const vector<string> &keywords, bool matchAll = true)
+    {
+        PERF_SCOPE(SearchFood);
+        TRACE_SPAN("searchFood", "search");
+        json results;
+        results["basic"] = json::object();
+        results["composite"] = json::object();
+
+        // Deduplicated lowercase search terms
+        vector<string> terms;
+        for (const auto &keyword : keywords)
+        {
+            string lowerKeyword = toLower(keyword);
+            if (find(terms.begin(), terms.end(), lowerKeyword) == terms.end())
+            {
+                terms.push_back(lowerKeyword);
+            }
+        }
+
+        string cacheKey = SearchCache::keyOf('k', terms, matchAll);
+        shared_ptr<const SearchCache::Matches> cached = searchCache.find(cacheKey, version);
+        if (cached)
+        {
+            for (const auto &match : *cached)
+            {
+                addRowToJson(results, match.row);
+            }
+            return results;
+        }
+
+        // Which terms each distinct keyword satisfies, as a bitmask over the
+        // terms. Filled lazily per keyword ID, so every stored keyword string is
+        // lowercased and substring-searched at most once per query and the row
+        // scan itself only ORs integers. Only keywords the scan meets get a
+        // mask; the interner also holds log strings, so no table spans it.
+        const size_t words = max<size_t>(1, (terms.size() + 63) / 64);
+        pmr::monotonic_buffer_resource scratch; // the map's nodes, freed at once
+        pmr::unordered_map<uint32_t, size_t> maskAt(&scratch); // keyword ID -> offset in keywordMasks
+        vector<uint64_t> keywordMasks;
+
+        auto maskFor = [&](uint32_t keyword) {
+            auto [it, added] = maskAt.try_emplace(keyword, keywordMasks.size());
+            if (added)
+            {
+                keywordMasks.resize(keywordMasks.size() + words, 0);
+                uint64_t *mask = &keywordMasks[it->second];
+                string lowerFoodKeyword = toLower(string(strings.str(keyword)));
+                for (size_t t = 0; t < terms.size(); t++)
+                {
+                    if (lowerFoodKeyword.find(terms[t]) != string::npos)
+                    {
+                        mask[t / 64] |= 1ULL << (t % 64);
+                    }
+                }
+            }
+            return it->second;
+        };
+
+        vector<uint64_t> required(words, 0);
+        for (size_t t = 0; t < terms.size(); t++)
+        {
+            required[t / 64] |= 1ULL << (t % 64);
+        }
+
+        auto found = make_shared<SearchCache::Matches>();
+        vector<uint64_t> rowMask(words);
+        for (uint32_t row = 0; row < catalog.size(); row++)
+        {
+            fill(rowMask.begin(), rowMask.end(), 0);
+            for (uint32_t keyword : catalog.keywords(row))
+            {
+                size_t mask = maskFor(keyword);
+                for (size_t w = 0; w < words; w++)
+                {
+                    rowMask[w] |= keywordMasks[mask + w];
+                }
+            }
+
+            // All: every term matched some keyword. Any: at least one did.
+            bool matches = matchAll;
+            for (size_t w = 0; w < words; w++)
+            {
+                if (matchAll && (rowMask[w] & required[w]) != required[w])
+                {
+                    matches = false;
+                    break;
+                }
+                if (!matchAll && rowMask[w] != 0)
+                {
+                    matches = true;
+                    break;
+                }
+            }
+
+            if (matches)
+            {
+                addRowToJson(results, row);
+                found->push_back({row, 0});
+            }
+        }
+        searchCache.insert(cacheKey, version, move(found));
+
+        return results;
+    }
+
+    struct SearchHit
+    {
+        int score;
+        uint32_t name;
+        bool composite;
+        int calories;
+    };
+
+    // Relevance of one term against one string, 0 when it does not occur
+    static int matchScore(string_view text, string_view term, int exact, int prefix, int substring)
+    {
+        if (text == term)
+            return exact;
+        size_t at = text.find(term);
+        if (at == string_view::npos)
+            return 0;
+        // Prefix of the string or of one of its words
+        return at == 0 || text[at - 1] == ' ' ? prefix : substring;
+    }
+
+    // Ranks foods against the search terms and returns the hits at
+    // [offset, offset + limit) of the ranking, best first. A term scores by
+    // its best match among the food's keywords (exact, prefix, substring) or
+    // its name (weighted higher); foods logged often get a boost from
+    // frequencies (log counts by name ID, as the catalog spells the name, the
+    // way DailyFoodLog::foodFrequencies keys them). Only the best
+    // offset + limit foods are kept, in a bounded heap, whatever the number of
+    // matches, which is returned in totalMatches.
+    vector<SearchHit> rankedSearch(const vector<string> &keywords, bool matchAll, size_t offset, size_t limit,
+                                   size_t &totalMatches, const unordered_map<uint32_t, uint32_t> *frequencies = nullptr)
+    {
+        PERF_SCOPE(SearchFood);
+        TRACE_SPAN("rankedSearch", "search");
+        totalMatches = 0;
+
+        vector<string> terms;
+        for (const auto &keyword : keywords)
+        {
+            string lowerKeyword = toLower(keyword);
+            if (!lowerKeyword.empty() && find(terms.begin(), terms.end(), lowerKeyword) == terms.end())
+            {
+                terms.push_back(lowerKeyword);
+            }
+        }
+        if (terms.empty() || limit == 0)
+        {
+            return {};
+        }
+
+        // The matching rows and their relevance do not depend on the page or
+        // the logging boost, so they are what is cached
+        string cacheKey = SearchCache::keyOf('r', terms, matchAll);
+        shared_ptr<const SearchCache::Matches> matches = searchCache.find(cacheKey, version);
+        if (!matches)
+        {
+            matches = scoreRows(terms, matchAll);
+            searchCache.insert(cacheKey, version, matches);
+        }
+        totalMatches = matches->size();
+
+        // Min-heap on relevance: the root is the weakest of the kept hits
+        auto better = [this](const SearchHit &a, const SearchHit &b) {
+            if (a.score != b.score)
+                return a.score > b.score;
+            return strings.str(a.name) < strings.str(b.name);
+        };
+        const size_t keep = offset + limit;
+        vector<SearchHit> heap;
+        heap.reserve(min<size_t>(keep, matches->size()));
+
+        for (const auto &match : *matches)
+        {
+            uint32_t row = match.row;
+            int total = match.score;
+            if (frequencies)
+            {
+                auto logged = frequencies->find(catalog.name(row));
+                if (logged != frequencies->end())
+                {
+                    // 5 points per doubling of how often the food was logged
+                    total += 5 * static_cast<int>(log2(1.0 + logged->second));
+                }
+            }
+
+            SearchHit hit{total, catalog.name(row), catalog.isComposite(row), catalog.calories(row)};
+            if (heap.size() < keep)
+            {
+                heap.push_back(hit);
+                push_heap(heap.begin(), heap.end(), better);
+            }
+            else if (better(hit, heap.front()))
+            {
+                pop_heap(heap.begin(), heap.end(), better);
+                heap.back() = hit;
+                push_heap(heap.begin(), heap.end(), better);
+            }
+        }
+
+        sort_heap(heap.begin(), heap.end(), better);
+        if (offset >= heap.size())
+        {
+            return {};
+        }
+        return vector<SearchHit>(heap.begin() + offset, heap.end());
+    }
+
+    // Every row matching the terms with its relevance, in catalog order
+    shared_ptr<SearchCache::Matches> scoreRows(const vector<string> &terms, bool matchAll)
+    {
+        auto matches = make_shared<SearchCache::Matches>();
+
+        // A keyword's score against each term, filled lazily like searchFood's
+        // masks and only for the keywords the scan meets
+        const size_t termCount = terms.size();
+        pmr::monotonic_buffer_resource scratch; // the map's nodes, freed at once
+        pmr::unordered_map<uint32_t, size_t> scoresAt(&scratch); // keyword ID -> offset in keywordScores
+        vector<uint8_t> keywordScores;
+        auto scoresFor = [&](uint32_t keyword) {
+            auto [it, added] = scoresAt.try_emplace(keyword, keywordScores.size());
+            if (added)
+            {
+                string lowerFoodKeyword = toLower(string(strings.str(keyword)));
+                for (size_t t = 0; t < termCount; t++)
+                {
+                    keywordScores.push_back(static_cast<uint8_t>(matchScore(lowerFoodKeyword, terms[t], 30, 20, 10)));
+                }
+            }
+            return it->second;
+        };
+
+        vector<int> best(termCount);
+        for (uint32_t row = 0; row < catalog.size(); row++)
+        {
+            string_view name = strings.str(catalog.foldedName(row));
+            for (size_t t = 0; t < termCount; t++)
+            {
+                best[t] = matchScore(name, terms[t], 40, 25, 12);
+            }
+            for (uint32_t keyword : catalog.keywords(row))
+            {
+                size_t scores = scoresFor(keyword);
+                for (size_t t = 0; t < termCount; t++)
+                {
+                    best[t] = max<int>(best[t], keywordScores[scores + t]);
+                }
+            }
+            int total = 0;
+            size_t matched = 0;
+            for (size_t t = 0; t < termCount; t++)
+            {
+                total += best[t];
+                matched += best[t] > 0;
+            }
+            if (matched == 0 || (matchAll && matched < termCount))
+            {
+                continue;
+            }
+            matches->push_back({row, total});
+        }
+        return matches;
+    }
+
+    // Foods whose name starts with the given text, alphabetically, a page at a
+    // time; a name used by both a basic and a composite food gives two hits
+    vector<SearchHit> completeFoods(const string &prefix, size_t offset, size_t limit, size_t &totalNames)
+    {
+        PERF_SCOPE(PrefixLookup);
+        TRACE_SPAN("completeFoods", "search");
+        preparePrefixIndex();
+
+        vector<SearchHit> hits;
+        for (uint32_t id : prefixIndex.complete(toLower(prefix), offset, limit, totalNames, strings))
+        {
+            for (bool composite : {false, true})
+            {
+                uint32_t row = catalog.find(composite, id);
+                if (row != FoodCatalog::npos)
+                {
+                    hits.push_back({0, catalog.name(row), composite, catalog.calories(row)});
+                }
+            }
+        }
+        return hits;
+    }
+
+    // Builds the prefix index on first use and merges the changes queued since
+    void preparePrefixIndex() const
+    {
+        auto present = [this](uint32_t id) {
+            return catalog.find(false, id) != FoodCatalog::npos || catalog.find(true, id) != FoodCatalog::npos;
+        };
+        if (!prefixIndex.isBuilt())
+        {
+            vector<uint32_t> names(catalog.size());
+            for (uint32_t row = 0; row < catalog.size(); row++)
+            {
+                names[row] = catalog.foldedName(row);
+            }
+            prefixIndex.build(move(names), strings);
+        }
+        prefixIndex.refresh(present, strings);
+    }
+
+    // Rows a query selected, one bit per catalog row, and how far a caller
+    // paging through them has got. Only valid until the catalog changes.
+    struct Selection
+    {
+        vector<uint64_t> rows;
+        size_t count = 0;
+        size_t position = 0; // next row to look at
+    };
+
+    // Sets the bit of every row whose value in column passes test, 64 rows per
+    // word, in a branch-free loop the compiler can vectorize
+    template <typename T, typename Test>
+    static void scanColumn(const pmr::vector<T> &column, vector<uint64_t> &bits, Test test)
+    {
+        for (size_t base = 0; base < column.size(); base += 64)
+        {
+            size_t count = min<size_t>(64, column.size() - base);
+            uint64_t word = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                word |= static_cast<uint64_t>(test(column[base + i])) << i;
+            }
+            bits[base / 64] = word;
+        }
+    }
+
+    // Runs a compiled query. Each condition becomes a bitset on a stack and
+    // AND, OR and NOT combine the top ones a word at a time. Whole names and
+    // name prefixes are looked up in the name and prefix indexes; the other
+    // conditions scan a column.
+    Selection selectFoods(const FoodQuery &query)
+    {
+        PERF_SCOPE(Query);
+        TRACE_SPAN("selectFoods", "search");
+        const size_t rows = catalog.size(), words = (rows + 63) / 64;
+        const uint64_t tailMask = rows % 64 ? (1ULL << (rows % 64)) - 1 : ~0ULL;
+        vector<vector<uint64_t>> stack;
+
+        auto setRow = [](vector<uint64_t> &bits, uint32_t row) { bits[row / 64] |= 1ULL << (row % 64); };
+        auto setNamed = [&](vector<uint64_t> &bits, uint32_t foldedName) {
+            for (bool composite : {false, true})
+            {
+                uint32_t row = catalog.find(composite, foldedName);
+                if (row != FoodCatalog::npos)
+                    setRow(bits, row);
+            }
+        };
+
+        for (const auto &instruction : query.program)
+        {
+            if (instruction.op == FoodQuery::Op::And || instruction.op == FoodQuery::Op::Or)
+            {
+                vector<uint64_t> right = move(stack.back());
+                stack.pop_back();
+                vector<uint64_t> &left = stack.back();
+                for (size_t w = 0; w < words; w++)
+                    left[w] = instruction.op == FoodQuery::Op::And ? left[w] & right[w] : left[w] | right[w];
+                continue;
+            }
+            if (instruction.op == FoodQuery::Op::Not)
+            {
+                vector<uint64_t> &operand = stack.back();
+                for (size_t w = 0; w < words; w++)
+                    operand[w] = ~operand[w];
+                if (words)
+                    operand.back() &= tailMask;
+                continue;
+            }
+
+            stack.emplace_back(words, 0);
+            vector<uint64_t> &bits = stack.back();
+            int value = instruction.value;
+            switch (instruction.op)
+            {
+            case FoodQuery::Op::Calories:
+            {
+                const auto &calories = catalog.calorieValues();
+                switch (instruction.compare)
+                {
+                case FoodQuery::Compare::Less: scanColumn(calories, bits, [value](int32_t c) { return c < value; }); break;
+                case FoodQuery::Compare::LessEqual: scanColumn(calories, bits, [value](int32_t c) { return c <= value; }); break;
+                case FoodQuery::Compare::Greater: scanColumn(calories, bits, [value](int32_t c) { return c > value; }); break;
+                case FoodQuery::Compare::GreaterEqual: scanColumn(calories, bits, [value](int32_t c) { return c >= value; }); break;
+                case FoodQuery::Compare::Equal: scanColumn(calories, bits, [value](int32_t c) { return c == value; }); break;
+                case FoodQuery::Compare::NotEqual: scanColumn(calories, bits, [value](int32_t c) { return c != value; }); break;
+                }
+                break;
+            }
+            case FoodQuery::Op::Category:
+                scanColumn(catalog.compositeFlags(), bits, [value](uint8_t composite) { return composite == value; });
+                break;
+            case FoodQuery::Op::Name:
+                if (instruction.match == FoodQuery::Match::Exact)
+                {
+                    uint32_t id = strings.find(instruction.text);
+                    if (id != StringInterner::npos)
+                        setNamed(bits, id);
+                }
+                else if (instruction.match == FoodQuery::Match::Prefix)
+                {
+                    preparePrefixIndex();
+                    size_t total;
+                    for (uint32_t id : prefixIndex.complete(instruction.text, 0, numeric_limits<size_t>::max(), total, strings))
+                        setNamed(bits, id);
+                }
+                else
+                {
+                    for (uint32_t row = 0; row < rows; row++)
+                        if (FoodQuery::matches(strings.str(catalog.foldedName(row)), instruction))
+                            setRow(bits, row);
+                }
+                break;
+            case FoodQuery::Op::Contains:
+            {
+                // Composites are flattened once and the expansions kept for later queries
+                vector<uint8_t> verdict(strings.size(), 0); // by basic food name, 0 unknown, 1 no, 2 yes
+                auto matchesFood = [&](uint32_t food) {
+                    if (food >= verdict.size())
+                        verdict.resize(food + 1, 0);
+                    if (!verdict[food])
+                        verdict[food] = 1 + FoodQuery::matches(strings.str(food), instruction);
+                    return verdict[food] == 2;
+                };
+                for (uint32_t row = 0; row < rows; row++)
+                {
+                    if (!catalog.isComposite(row))
+                    {
+                        if (matchesFood(catalog.foldedName(row)))
+                            setRow(bits, row);
+                        continue;
+                    }
+                    const vector<ExpansionCache::Part> &parts = expandComposite(catalog.foldedName(row))->parts;
+                    if (any_of(parts.begin(), parts.end(), [&](const ExpansionCache::Part &part) { return matchesFood(part.food); }))
+                        setRow(bits, row);
+                }
+                break;
+            }
+            default:
+            {
+                // Keywords and ingredient names are shared by many foods, so each
+                // distinct one is lowercased and matched once
+                vector<uint8_t> verdict(strings.size(), 0); // 0 unknown, 1 no, 2 yes
+                auto matchesId = [&](uint32_t id) {
+                    if (!verdict[id])
+                        verdict[id] = 1 + FoodQuery::matches(toLower(string(strings.str(id))), instruction);
+                    return verdict[id] == 2;
+                };
+                bool keyword = instruction.op == FoodQuery::Op::Keyword;
+                for (uint32_t row = 0; row < rows; row++)
+                {
+                    ColumnRange<uint32_t> ids = keyword ? catalog.keywords(row) : catalog.ingredients(row);
+                    if (any_of(ids.begin(), ids.end(), matchesId))
+                        setRow(bits, row);
+                }
+                break;
+            }
+            }
+        }
+
+        Selection selection;
+        selection.rows = move(stack.back());
+        for (uint64_t word : selection.rows)
+        {
+            selection.count += __builtin_popcountll(word);
+        }
+        return selection;
+    }
+
+    // A composite flattened to the basic foods it is made of, or nullptr if no
+    // composite has this folded name. Valid until the next call.
+    const ExpansionCache::Expansion *expandComposite(uint32_t foldedName)
+    {
+        if (catalog.find(true, foldedName) == FoodCatalog::npos)
+        {
+            return nullptr;
+        }
+        uncachedExpansions.clear();
+        vector<uint32_t> visiting;
+        return &expand(foldedName, visiting);
+    }
+
+    // Composites using the food with this folded name, directly or through
+    // other composites, nearest first. Ingredient names resolve basic foods
+    // first, so a composite shadowed by a basic food passes nothing on.
+    vector<uint32_t> compositesUsing(uint32_t food)
+    {
+        if (!ingredientIndex.isBuilt())
+        {
+            ingredientIndex.markBuilt();
+            for (uint32_t row = 0; row < catalog.size(); row++)
+            {
+                indexIngredients(row, true);
+            }
+        }
+        vector<uint32_t> found;
+        unordered_set<uint32_t> seen{food};
+        auto addUsers = [&](uint32_t name) {
+            if (const vector<uint32_t> *users = ingredientIndex.find(name))
+            {
+                for (uint32_t composite : *users)
+                {
+                    if (seen.insert(composite).second)
+                        found.push_back(composite);
+                }
+            }
+        };
+        addUsers(food);
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            if (catalog.find(false, found[i]) == FoodCatalog::npos)
+            {
+                addUsers(found[i]);
+            }
+        }
+        return found;
+    }
+
+    // Name as entered of the composite with this folded name
+    string_view compositeName(uint32_t foldedName) const
+    {
+        return strings.str(catalog.name(catalog.find(true, foldedName)));
+    }
+
+    // Folded name ID of the basic food with this name, or StringInterner::npos
+    uint32_t basicFoodId(string_view name) const
+    {
+        uint32_t id = strings.find(toLower(string(name)));
+        return id != StringInterner::npos && catalog.find(false, id) != FoodCatalog::npos ? id : StringInterner::npos;
+    }
+
+    // The next page of a selection, in catalog order
+    vector<SearchHit> nextPage(Selection &selection, size_t limit) const
+    {
+        vector<SearchHit> hits;
+        size_t rows = min(catalog.size(), selection.rows.size() * 64);
+        for (; selection.position < rows && hits.size() < limit; selection.position++)
+        {
+            uint32_t row = static_cast<uint32_t>(selection.position);
+            if (selection.rows[row / 64] >> (row % 64) & 1)
+            {
+                hits.push_back({0, catalog.name(row), catalog.isComposite(row), catalog.calories(row)});
+            }
+        }
+        return hits;
+    }
+
+    // Foods of at most budget calories per serving (and at least 0), the
+    // largest first, a page at a time. With a keyword only foods having a
+    // keyword that contains it count; totalMatches receives how many there are.
+    vector<SearchHit> foodsWithin(int budget, const string &keyword, size_t offset, size_t limit, size_t &totalMatches)
+    {
+        PERF_SCOPE(CalorieRange);
+        TRACE_SPAN("foodsWithin", "search");
+        if (!calorieIndex.isBuilt())
+        {
+            vector<CalorieIndex::Entry> entries(catalog.size());
+            for (uint32_t row = 0; row < catalog.size(); row++)
+            {
+                entries[row] = {catalog.calories(row), catalog.foldedName(row), catalog.isComposite(row)};
+            }
+            calorieIndex.build(move(entries));
+        }
+        calorieIndex.refresh([this](uint32_t name, bool composite, int &calories) {
+            uint32_t row = catalog.find(composite, name);
+            if (row == FoodCatalog::npos)
+            {
+                return false;
+            }
+            calories = catalog.calories(row);
+            return true;
+        });
+
+        vector<SearchHit> hits;
+        auto [first, last] = calorieIndex.range(0, budget);
+        auto hitAt = [&](size_t i) -> SearchHit {
+            CalorieIndex::Entry entry = calorieIndex[i];
+            return {0, catalog.name(catalog.find(entry.composite, entry.name)), entry.composite, entry.calories};
+        };
+
+        string term = toLower(keyword);
+        if (term.empty())
+        {
+            totalMatches = last - first;
+            for (size_t i = offset; i < totalMatches && hits.size() < limit; i++)
+            {
+                hits.push_back(hitAt(last - 1 - i));
+            }
+            return hits;
+        }
+
+        // Whether each distinct keyword contains the term, worked out once per keyword
+        unordered_map<uint32_t, bool> keywordMatches;
+        auto matches = [&](uint32_t keywordId) {
+            auto [it, inserted] = keywordMatches.try_emplace(keywordId, false);
+            if (inserted)
+            {
+                it->second = toLower(string(strings.str(keywordId))).find(term) != string::npos;
+            }
+            return it->second;
+        };
+
+        totalMatches = 0;
+        for (size_t i = last; i-- > first;)
+        {
+            CalorieIndex::Entry entry = calorieIndex[i];
+            uint32_t row = catalog.find(entry.composite, entry.name);
+            ColumnRange<uint32_t> keywords = catalog.keywords(row);
+            if (any_of(keywords.begin(), keywords.end(), matches))
+            {
+                if (totalMatches >= offset && hits.size() < limit)
+                {
+                    hits.push_back(hitAt(i));
+                }
+                totalMatches++;
+            }
+        }
+        return hits;
+    }
+
+    // Foods a meal plan may use: with a keyword containing one of the include
+    // terms (any food if there are none) and none containing an exclude term.
+    // The catalog is scanned in slices on several threads; each keeps its own
+    // cache of which keywords match, since that is what the scan mostly does.
+    vector<MealPlanner::Candidate> planCandidates(const vector<string> &include, const vector<string> &exclude,
+                                                  const unordered_map<uint32_t, uint32_t> &frequencies) const
+    {
+        const size_t MinSliceRows = 16384;
+        vector<string> includeTerms, excludeTerms;
+        for (const auto &term : include)
+            includeTerms.push_back(toLower(term));
+        for (const auto &term : exclude)
+            excludeTerms.push_back(toLower(term));
+
+        size_t threads = max(1u, thread::hardware_concurrency());
+        size_t slices = max<size_t>(1, min(threads, catalog.size() / MinSliceRows));
+        vector<vector<MealPlanner::Candidate>> found(slices);
+
+        auto scan = [&](size_t slice) {
+            enum : uint8_t { Included = 1, Excluded = 2 };
+            unordered_map<uint32_t, uint8_t> keywordFlags;
+            auto flagsOf = [&](uint32_t keyword) {
+                auto [it, inserted] = keywordFlags.try_emplace(keyword, 0);
+                if (inserted)
+                {
+                    string text = toLower(string(strings.str(keyword)));
+                    for (const auto &term : includeTerms)
+                        if (text.find(term) != string::npos)
+                            it->second |= Included;
+                    for (const auto &term : excludeTerms)
+                        if (text.find(term) != string::npos)
+                            it->second |= Excluded;
+                }
+                return it->second;
+            };
+
+            size_t begin = catalog.size() * slice / slices, end = catalog.size() * (slice + 1) / slices;
+            for (uint32_t row = static_cast<uint32_t>(begin); row < end; row++)
+            {
+                uint8_t flags = 0;
+                for (uint32_t keyword : catalog.keywords(row))
+                {
+                    flags |= flagsOf(keyword);
+                }
+                if ((flags & Excluded) || (!includeTerms.empty() && !(flags & Included)))
+                {
+                    continue;
+                }
+                auto frequency = frequencies.find(catalog.name(row));
+                found[slice].push_back({catalog.name(row), catalog.isComposite(row), catalog.calories(row),
+                                        frequency == frequencies.end() ? 0 : frequency->second});
+            }
+        };
+
+        vector<thread> workers;
+        for (size_t slice = 1; slice < slices; slice++)
+        {
+            workers.emplace_back([&, slice]() {
+                TraceRecorder::instance().setThreadName("plan");
+                scan(slice);
+            });
+        }
+        scan(0);
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+
+        vector<MealPlanner::Candidate> candidates;
+        for (auto &slice : found)
+        {
+            candidates.insert(candidates.end(), slice.begin(), slice.end());
+        }
+        return candidates;
+    }
+
+    string_view nameOf(const SearchHit &hit) const
+    {
+        return strings.str(hit.name);
+    }
+
+    string_view nameOf(const MealPlanner::Portion &portion) const
+    {
+        return strings.str(portion.name);
+    }
+
+    // One food in the JSON shape getAllFoods uses, or null if there is none;
+    // the name matches in any case, as pickers pass the catalog's spelling
+    json getFood(const string &name, bool composite) const
+    {
+        uint32_t row = findRow(composite, toLower(name));
+        return row == FoodCatalog::npos ? json() : toJson(row);
+    }
+
+    json getFood(const FoodView &food) const
+    {
+        return toJson(food.row());
+    }
+
+    json getAllFoods()
+    {
+        json results;
+        results["basic"] = json::object();
+        results["composite"] = json::object();
+        for (uint32_t row = 0; row < catalog.size(); row++)
+        {
+            addRowToJson(results, row);
+        }
+        return results;
+    }
+};
+
+// Typed in-memory form of one daily_food_log.json entry. The details are a
+// snapshot of the food taken when it was logged, so they are stored inline
+// instead of pointing into the catalog. The type is allocator-aware: entries
+// kept in a FoodLogStore put their lists in the store's pool.
+struct LogEntry
+{
+    using allocator_type = pmr::polymorphic_allocator<char>;
+
+    uint32_t name = StringInterner::npos;
+    int32_t servings = 0;
+    int32_t calories = 0;
+    bool composite = false; // details carry an "ingredients" member
+    bool hasId = false;
+    string_view id;         // bytes live in the owning store's arena
+    Nutrients nutrients;    // per serving
+    pmr::vector<uint32_t> keywords;
+    pmr::vector<pair<uint32_t, int32_t>> ingredients; // (ingredient name ID, servings)
+    // Members this version does not read, kept to be written back: compact JSON
+    // {"details": {...}, "entry": {...}, "nutrients": {...}} with only the
+    // levels that have some, or empty. Bytes live in the store's arena.
+    string_view unknown;
+
+    explicit LogEntry(const allocator_type &alloc = {}) : keywords(alloc), ingredients(alloc) {}
+
+    LogEntry(const LogEntry &other, const allocator_type &alloc = {})
+        : name(other.name), servings(other.servings), calories(other.calories), composite(other.composite),
+          hasId(other.hasId), id(other.id), nutrients(other.nutrients), keywords(other.keywords, alloc),
+          ingredients(other.ingredients, alloc), unknown(other.unknown) {}
+
+    LogEntry(LogEntry &&other) = default;
+
+    LogEntry(LogEntry &&other, const allocator_type &alloc)
+        : name(other.name), servings(other.servings), calories(other.calories), composite(other.composite),
+          hasId(other.hasId), id(other.id), nutrients(other.nutrients), keywords(move(other.keywords), alloc),
+          ingredients(move(other.ingredients), alloc), unknown(other.unknown) {}
+
+    LogEntry &operator=(const LogEntry &) = default;
+    LogEntry &operator=(LogEntry &&) = default;
+};
+
+// The whole food log in typed form: date -> entries in the order they were
+// logged. Days, entries and their lists draw from memory owned by the store,
+// so loading years of entries costs a handful of large allocations and
+// dropping the store returns them in bulk. Strings go to the interner the
+// store is given, the one shared with the catalog unless stated otherwise.
+//
+// Each day is also a partition of the saved file: its serialized text is
+// cached and only days handed out for editing are serialized again, so a
+// snapshot for the background writer costs one day, not the whole log.
+class FoodLogStore
+{
+public:
+    using Day = pmr::vector<LogEntry>;
+    using Snapshot = vector<shared_ptr<const string>>; // day fragments in file order
+    static constexpr const char *BinaryMagic = "DMLOG001";
+
+    // Whether text is a real calendar date written YYYY-MM-DD
+    static bool isDate(string_view date)
+    {
+        int64_t days;
+        return dayNumber(date, days);
+    }
+
+private:
+    pmr::unsynchronized_pool_resource memory;
+    StringInterner &strings;                  // food names, keywords, dates, entry IDs
+    pmr::map<string_view, Day> days{&memory}; // keys view the interner, sorted like the file
+    pmr::map<string_view, shared_ptr<const string>> dayText{&memory};
+    pmr::set<string_view> dirtyDays{&memory};
+    pmr::set<string_view> changedDays{&memory}; // since takeChangedDays, for indexes kept outside the store
+
+    // Binary encoding helpers: LEB128 varints, zigzag for signed values
+    static void putVarint(string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static bool getVarint(string_view data, size_t &pos, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < data.size(); shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(data[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Days since 1970-01-01 of a canonical "YYYY-MM-DD" date (civil calendar)
+    static bool dayNumber(string_view date, int64_t &days)
+    {
+        if (date.size() != 10 || date[4] != '-' || date[7] != '-')
+        {
+            return false;
+        }
+        int parts[3] = {0, 0, 0};
+        for (size_t i = 0, part = 0; i < date.size(); i++)
+        {
+            if (i == 4 || i == 7)
+            {
+                part++;
+                continue;
+            }
+            if (!isdigit(static_cast<unsigned char>(date[i])))
+                return false;
+            parts[part] = parts[part] * 10 + (date[i] - '0');
+        }
+        int64_t year = parts[0] - (parts[1] <= 2);
+        int64_t era = year / 400;
+        int64_t yearOfEra = year - era * 400;
+        int64_t dayOfYear = (153 * (parts[1] + (parts[1] > 2 ? -3 : 9)) + 2) / 5 + parts[2] - 1;
+        int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        days = era * 146097 + dayOfEra - 719468;
+        // Out-of-range months and days do not survive the round trip
+        return dateText(days) == date;
+    }
+
+    static string dateText(int64_t days)
+    {
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t dayOfEra = days - era * 146097;
+        int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+        int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+        int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+        int64_t year = yearOfEra + era * 400 + (month <= 2);
+        if (year < 0 || year > 9999)
+        {
+            return {};
+        }
+        char text[40]; // room for any int, so -Wformat-truncation cannot fire
+        snprintf(text, sizeof(text), "%04d-%02d-%02d", static_cast<int>(year), static_cast<int>(month), static_cast<int>(day));
+        return text;
+    }
+
+    // Entry IDs as addFoodToLog makes them, "<seconds>_<number>", in canonical form
+    static bool numericId(string_view id, uint64_t &seconds, uint64_t &number)
+    {
+        size_t split = id.find('_');
+        if (split == string_view::npos)
+        {
+            return false;
+        }
+        auto parse = [](string_view digits, uint64_t &value) {
+            if (digits.empty() || (digits.size() > 1 && digits[0] == '0'))
+                return false;
+            auto [end, error] = from_chars(digits.data(), digits.data() + digits.size(), value);
+            return error == errc() && end == digits.data() + digits.size();
+        };
+        return parse(id.substr(0, split), seconds) && parse(id.substr(split + 1), number);
+    }
+
+    // One `"date": [...]` member at the indentation it has inside the file
+    shared_ptr<const string> serializeDay(string_view date, const Day &entries) const
+    {
+        auto text = make_shared<string>(4, ' ');
+        JsonWriter writer(*text, 1);
+        vector<pair<string_view, int32_t>> ingredients;
+        writer.key(date);
+        writer.beginArray();
+        static const json none = json::object();
+        json kept;
+        for (const LogEntry &entry : entries)
+        {
+            // Members from a newer version go back where dump(4) would put them
+            if (!entry.unknown.empty())
+            {
+                kept = json::parse(entry.unknown);
+            }
+            const json &entryKept = entry.unknown.empty() || !kept.contains("entry") ? none : kept["entry"];
+            const json &detailsKept = entry.unknown.empty() || !kept.contains("details") ? none : kept["details"];
+            const json &nutrientsKept = entry.unknown.empty() || !kept.contains("nutrients") ? none : kept["nutrients"];
+            auto entryMember = entryKept.begin();
+            auto detailsMember = detailsKept.begin();
+
+            writer.beginObject();
+            writer.membersBefore(entryMember, entryKept.end(), "details");
+            writer.key("details");
+            writer.beginObject();
+            writer.membersBefore(detailsMember, detailsKept.end(), "calories");
+            writer.key("calories");
+            writer.value(entry.calories);
+            if (entry.composite)
+            {
+                writer.membersBefore(detailsMember, detailsKept.end(), "ingredients");
+                ingredients.clear();
+                for (const auto &[ingredient, servings] : entry.ingredients)
+                {
+                    ingredients.emplace_back(strings.str(ingredient), servings);
+                }
+                sort(ingredients.begin(), ingredients.end());
+                writer.key("ingredients");
+                writer.beginObject();
+                for (const auto &[ingredient, servings] : ingredients)
+                {
+                    writer.key(ingredient);
+                    writer.value(servings);
+                }
+                writer.endObject();
+            }
+            writer.membersBefore(detailsMember, detailsKept.end(), "keywords");
+            writer.key("keywords");
+            writer.beginArray();
+            for (uint32_t keyword : entry.keywords)
+            {
+                writer.value(strings.str(keyword));
+            }
+            writer.endArray();
+            if (!entry.nutrients.empty() || !nutrientsKept.empty())
+            {
+                writer.membersBefore(detailsMember, detailsKept.end(), "nutrients");
+                entry.nutrients.write(writer, nutrientsKept);
+            }
+            writer.membersBefore(detailsMember, detailsKept.end(), {});
+            writer.endObject();
+            if (entry.hasId)
+            {
+                writer.membersBefore(entryMember, entryKept.end(), "id");
+                writer.key("id");
+                writer.value(entry.id);
+            }
+            writer.membersBefore(entryMember, entryKept.end(), "name");
+            writer.key("name");
+            writer.value(strings.str(entry.name));
+            writer.membersBefore(entryMember, entryKept.end(), "servings");
+            writer.key("servings");
+            writer.value(entry.servings);
+            writer.membersBefore(entryMember, entryKept.end(), {});
+            writer.endObject();
+        }
+        writer.endArray();
+        return text;
+    }
+
+public:
+    explicit FoodLogStore(StringInterner &interner = StringInterner::global()) : strings(interner) {}
+
+    StringInterner &names() { return strings; }
+    const StringInterner &names() const { return strings; }
+
+    // Entries of a date for changing them, or nullptr if nothing was ever logged on it
+    Day *edit(string_view date)
+    {
+        auto it = days.find(date);
+        if (it == days.end())
+        {
+            return nullptr;
+        }
+        dirtyDays.insert(it->first);
+        changedDays.insert(it->first);
+        return &it->second;
+    }
+
+    const Day *find(string_view date) const
+    {
+        auto it = days.find(date);
+        return it == days.end() ? nullptr : &it->second;
+    }
+
+    // Entries of a date for changing them, starting an empty day if needed
+    Day &day(string_view date)
+    {
+        auto it = days.find(date);
+        if (it == days.end())
+        {
+            it = days.try_emplace(strings.str(strings.intern(date))).first;
+        }
+        dirtyDays.insert(it->first);
+        changedDays.insert(it->first);
+        return it->second;
+    }
+
+    // Visits the days dated from..to inclusive, in date order; an empty bound is open
+    template <typename Visit>
+    void forEachDay(string_view from, string_view to, Visit visit) const
+    {
+        auto it = from.empty() ? days.begin() : days.lower_bound(from);
+        for (; it != days.end() && (to.empty() || it->first <= to); ++it)
+        {
+            visit(it->first, it->second);
+        }
+    }
+
+    size_t dateCount() const
+    {
+        return days.size();
+    }
+
+    void countStringReferences(StringReferences &references) const
+    {
+        for (const auto &[date, entries] : days)
+        {
+            references.add(date);
+            for (const LogEntry &entry : entries)
+            {
+                references.add(strings.str(entry.name));
+                if (entry.hasId)
+                {
+                    references.add(entry.id);
+                }
+                for (uint32_t keyword : entry.keywords)
+                {
+                    references.add(strings.str(keyword));
+                }
+                for (const auto &ingredient : entry.ingredients)
+                {
+                    references.add(strings.str(ingredient.first));
+                }
+                if (!entry.unknown.empty())
+                {
+                    references.add(entry.unknown);
+                }
+            }
+        }
+    }
+
+    size_t entryCount() const
+    {
+        size_t entries = 0;
+        for (const auto &day : days)
+        {
+            entries += day.second.size();
+        }
+        return entries;
+    }
+
+    void clear()
+    {
+        // Dates keep their interned text, so indexes can still be told they emptied
+        for (const auto &day : days)
+        {
+            changedDays.insert(day.first);
+        }
+        days.clear();
+        dayText.clear();
+        dirtyDays.clear();
+    }
+
+    // Visits the dates that may have changed since the last call, with their
+    // entries now, or nullptr for a date the store no longer has
+    template <typename Visit>
+    void takeChangedDays(Visit visit)
+    {
+        for (string_view date : changedDays)
+        {
+            auto it = days.find(date);
+            visit(date, it == days.end() ? nullptr : &it->second);
+        }
+        changedDays.clear();
+    }
+
+    // The JSON shape of an entry as stored in daily_food_log.json
+    json toJson(const LogEntry &entry) const
+    {
+        json keywords = json::array();
+        for (uint32_t keyword : entry.keywords)
+        {
+            keywords.push_back(string(strings.str(keyword)));
+        }
+        json details = {
+            {"keywords", keywords},
+            {"calories", entry.calories}};
+        if (entry.composite)
+        {
+            details["ingredients"] = json::object();
+            for (const auto &[ingredient, servings] : entry.ingredients)
+            {
+                details["ingredients"][string(strings.str(ingredient))] = servings;
+            }
+        }
+        entry.nutrients.addTo(details);
+
+        json result = {
+            {"name", string(strings.str(entry.name))},
+            {"servings", entry.servings},
+            {"details", details}};
+        if (entry.hasId)
+        {
+            result["id"] = string(entry.id);
+        }
+        if (!entry.unknown.empty())
+        {
+            json kept = json::parse(entry.unknown);
+            for (const auto &[level, members] : kept.items())
+            {
+                json &target = level == "entry" ? result : level == "details" ? result["details"] : result["details"]["nutrients"];
+                target.update(members);
+            }
+        }
+        return result;
+    }
+
+    // Brings the cached text of edited days up to date and returns all of them
+    shared_ptr<const Snapshot> snapshot()
+    {
+        for (string_view date : dirtyDays)
+        {
+            dayText[date] = serializeDay(date, days.find(date)->second);
+        }
+        dirtyDays.clear();
+
+        auto result = make_shared<Snapshot>();
+        result->reserve(dayText.size());
+        for (const auto &day : dayText)
+        {
+            result->push_back(day.second);
+        }
+        return result;
+    }
+
+    // Compact binary form of the log (.dmlog). All numbers are LEB128 varints,
+    // signed ones zigzag-encoded:
+    //   "DMLOG001"
+    //   strings:  count, then length + bytes each
+    //   foods:    count, then per distinct food snapshot: name string,
+    //             calories, flags (1 composite, 2 has nutrients, 4 has
+    //             unknown members), keyword count + strings, for composites
+    //             ingredient count + (string, servings) and, if flagged,
+    //             every nutrient amount in hundredths and the unknown
+    //             members' JSON as length + bytes
+    //   days:     count, then per day a date tag, the entry count and entries
+    //             of food index, servings and ID
+    // A date tag is (day delta << 1 | 1) from the previous canonical
+    // YYYY-MM-DD date, or (string << 1) for any other key. An ID is 0 (none),
+    // 1 followed by the seconds delta from the previous numeric ID and the
+    // number after the underscore, or 2 followed by length + bytes.
+    void encodeBinary(string &out) const
+    {
+        vector<uint32_t> fileIds(strings.size(), StringInterner::npos);
+        vector<string_view> dictionary;
+        auto reference = [&](uint32_t id) {
+            uint32_t &fileId = fileIds[id];
+            if (fileId == StringInterner::npos)
+            {
+                fileId = static_cast<uint32_t>(dictionary.size());
+                dictionary.push_back(strings.str(id));
+            }
+            return fileId;
+        };
+
+        // Entries repeat the snapshot of the same food, so each distinct one is stored once
+        unordered_map<string, uint32_t> foodIndex;
+        string foods, food, body;
+        int64_t previousDay = 0;
+        uint64_t previousSeconds = 0;
+        putVarint(body, days.size());
+        for (const auto &[date, entries] : days)
+        {
+            int64_t day;
+            if (dayNumber(date, day))
+            {
+                putVarint(body, zigzag(day - previousDay) << 1 | 1);
+                previousDay = day;
+            }
+            else
+            {
+                putVarint(body, static_cast<uint64_t>(reference(strings.find(date))) << 1);
+            }
+
+            putVarint(body, entries.size());
+            for (const LogEntry &entry : entries)
+            {
+                food.clear();
+                putVarint(food, reference(entry.name));
+                putVarint(food, zigzag(entry.calories));
+                bool hasNutrients = !entry.nutrients.empty();
+                bool hasUnknown = !entry.unknown.empty();
+                putVarint(food, entry.composite | hasNutrients << 1 | hasUnknown << 2);
+                putVarint(food, entry.keywords.size());
+                for (uint32_t keyword : entry.keywords)
+                {
+                    putVarint(food, reference(keyword));
+                }
+                if (entry.composite)
+                {
+                    putVarint(food, entry.ingredients.size());
+                    for (const auto &[ingredient, servings] : entry.ingredients)
+                    {
+                        putVarint(food, reference(ingredient));
+                        putVarint(food, zigzag(servings));
+                    }
+                }
+                if (hasNutrients)
+                {
+                    for (float amount : entry.nutrients.amounts)
+                    {
+                        putVarint(food, static_cast<uint64_t>(llround(Nutrients::written(amount) * 100)));
+                    }
+                }
+                if (hasUnknown)
+                {
+                    putVarint(food, entry.unknown.size());
+                    food += entry.unknown;
+                }
+                auto [known, added] = foodIndex.try_emplace(food, static_cast<uint32_t>(foodIndex.size()));
+                if (added)
+                {
+                    foods += food;
+                }
+                putVarint(body, known->second);
+                putVarint(body, zigzag(entry.servings));
+
+                uint64_t seconds, number;
+                if (!entry.hasId)
+                {
+                    putVarint(body, 0);
+                }
+                else if (numericId(entry.id, seconds, number))
+                {
+                    putVarint(body, 1);
+                    putVarint(body, zigzag(static_cast<int64_t>(seconds - previousSeconds)));
+                    putVarint(body, number);
+                    previousSeconds = seconds;
+                }
+                else
+                {
+                    putVarint(body, 2);
+                    putVarint(body, entry.id.size());
+                    body += entry.id;
+                }
+            }
+        }
+
+        out.append(BinaryMagic, 8);
+        putVarint(out, dictionary.size());
+        for (string_view text : dictionary)
+        {
+            putVarint(out, text.size());
+            out += text;
+        }
+        putVarint(out, foodIndex.size());
+        out += foods;
+        out += body;
+    }
+
+    // Adds the days of a .dmlog image to the store; false with a message if it is malformed
+    bool decodeBinary(string_view data, string &error)
+    {
+        size_t pos = 0;
+        uint64_t count = 0;
+        auto fail = [&](const char *message) {
+            error = message;
+            return false;
+        };
+        auto next = [&](uint64_t &value) { return getVarint(data, pos, value); };
+        auto signedNext = [&](int32_t &value) {
+            uint64_t raw;
+            if (!next(raw))
+                return false;
+            value = static_cast<int32_t>(unzigzag(raw));
+            return true;
+        };
+
+        if (data.substr(0, 8) != string_view(BinaryMagic, 8))
+        {
+            return fail("not a binary food log");
+        }
+        pos = 8;
+
+        vector<uint32_t> ids;
+        if (!next(count) || count > data.size())
+            return fail("truncated string table");
+        ids.reserve(count);
+        for (uint64_t i = 0; i < count; i++)
+        {
+            uint64_t length;
+            if (!next(length) || length > data.size() - pos)
+                return fail("truncated string table");
+            ids.push_back(strings.intern(data.substr(pos, length)));
+            pos += length;
+        }
+        auto idAt = [&](uint32_t &id) {
+            uint64_t index;
+            if (!next(index) || index >= ids.size())
+                return false;
+            id = ids[index];
+            return true;
+        };
+
+        vector<LogEntry> foods;
+        if (!next(count) || count > data.size())
+            return fail("truncated food table");
+        foods.reserve(count);
+        for (uint64_t i = 0; i < count; i++)
+        {
+            LogEntry &food = foods.emplace_back();
+            uint64_t composite, keywords, ingredients;
+            if (!idAt(food.name) || !signedNext(food.calories) || !next(composite) || !next(keywords) || keywords > data.size())
+                return fail("truncated food table");
+            food.composite = (composite & 1) != 0;
+            food.keywords.resize(keywords);
+            for (uint32_t &keyword : food.keywords)
+            {
+                if (!idAt(keyword))
+                    return fail("truncated food table");
+            }
+            if (food.composite)
+            {
+                if (!next(ingredients) || ingredients > data.size())
+                    return fail("truncated food table");
+                food.ingredients.resize(ingredients);
+                for (auto &[ingredient, servings] : food.ingredients)
+                {
+                    if (!idAt(ingredient) || !signedNext(servings))
+                        return fail("truncated food table");
+                }
+            }
+            if (composite & 2)
+            {
+                for (float &amount : food.nutrients.amounts)
+                {
+                    uint64_t hundredths;
+                    if (!next(hundredths))
+                        return fail("truncated food table");
+                    if (!Nutrients::validAmount(hundredths / 100.0))
+                        return fail("nutrient amount out of range");
+                    amount = static_cast<float>(hundredths / 100.0);
+                }
+            }
+            if (composite & 4)
+            {
+                uint64_t length;
+                if (!next(length) || length > data.size() - pos)
+                    return fail("truncated food table");
+                if (!json::accept(data.substr(pos, length)))
+                    return fail("malformed unknown members");
+                food.unknown = strings.copy(data.substr(pos, length));
+                pos += length;
+            }
+        }
+
+        int64_t previousDay = 0;
+        uint64_t previousSeconds = 0;
+        uint64_t dayCount;
+        char idText[48];
+        if (!next(dayCount))
+            return fail("truncated day list");
+        for (uint64_t d = 0; d < dayCount; d++)
+        {
+            uint64_t tag, entryCount;
+            string date;
+            if (!next(tag))
+                return fail("truncated day list");
+            if (tag & 1)
+            {
+                previousDay += unzigzag(tag >> 1);
+                date = dateText(previousDay);
+                if (date.empty())
+                    return fail("date out of range");
+            }
+            else if (tag >> 1 < ids.size())
+            {
+                date = string(strings.str(ids[tag >> 1]));
+            }
+            else
+            {
+                return fail("bad date reference");
+            }
+            if (!next(entryCount) || entryCount > data.size())
+                return fail("truncated day");
+
+            Day &entries = day(date);
+            entries.reserve(entries.size() + entryCount);
+            for (uint64_t e = 0; e < entryCount; e++)
+            {
+                uint64_t foodIndex, idKind;
+                if (!next(foodIndex) || foodIndex >= foods.size())
+                    return fail("bad food reference");
+                LogEntry &entry = entries.emplace_back(foods[foodIndex]);
+                if (!signedNext(entry.servings) || !next(idKind))
+                    return fail("truncated entry");
+                if (idKind == 1)
+                {
+                    uint64_t delta, number;
+                    if (!next(delta) || !next(number))
+                        return fail("truncated entry");
+                    previousSeconds += static_cast<uint64_t>(unzigzag(delta));
+                    // Two 20-digit numbers and the underscore always fit
+                    char *const last = idText + sizeof(idText);
+                    auto seconds = to_chars(idText, last, previousSeconds);
+                    if (seconds.ec != errc() || seconds.ptr == last)
+                        return fail("bad entry ID");
+                    *seconds.ptr = '_';
+                    auto tail = to_chars(seconds.ptr + 1, last, number);
+                    if (tail.ec != errc())
+                        return fail("bad entry ID");
+                    entry.id = strings.copy(string_view(idText, tail.ptr - idText));
+                    entry.hasId = true;
+                }
+                else if (idKind == 2)
+                {
+                    uint64_t length;
+                    if (!next(length) || length > data.size() - pos)
+                        return fail("truncated entry");
+                    entry.id = strings.copy(data.substr(pos, length));
+                    entry.hasId = true;
+                    pos += length;
+                }
+                else if (idKind != 0)
+                {
+                    return fail("bad entry ID");
+                }
+            }
+        }
+        return pos == data.size() || fail("trailing bytes after the last day");
+    }
+
+    // Joins day fragments into the file, laid out exactly as json::dump(4) would
+    static void assemble(const Snapshot &fragments, string &out)
+    {
+        if (fragments.empty())
+        {
+            out += "{}";
+            return;
+        }
+        out += "{\n";
+        for (size_t i = 0; i < fragments.size(); i++)
+        {
+            if (i > 0)
+            {
+                out += ",\n";
+            }
+            out += *fragments[i];
+        }
+        out += "\n}";
+    }
+
+    void write(string &out)
+    {
+        assemble(*snapshot(), out);
+    }
+};
+
+// SAX handler that reads daily_food_log.json into a FoodLogStore, checking the
+// shape every reader of the log relies on as it goes. Entries are assembled
+// in one reused LogEntry and copied into the store's pool when they close.
+// Members the loader does not know about, such as ones a newer version wrote,
+// are captured through a JsonDomBuilder and kept on the entry as JSON text,
+// so saving writes them back.
+class FoodLogSax
+{
+public:
+    std::string error;
+
+private:
+    enum class Member { Other, Name, Servings, Id, Details, Calories, Keywords, Ingredients, Nutrients };
+
+    FoodLogStore &store;
+    StringInterner &strings;
+    int depth = 0;
+    int skipDepth = 0; // > 0 while inside a container that is being skipped
+    bool skipValue = false;
+
+    std::string date;                // last key at the top level
+    FoodLogStore::Day *day = nullptr; // while inside a date's array
+    Member entryMember = Member::Other;
+    Member detailMember = Member::Other;
+    uint32_t pendingIngredient = StringInterner::npos;
+    int pendingNutrient = -1;
+    LogEntry current;
+    bool hasName = false, hasServings = false, hasCalories = false;
+    json unknown;                     // the current entry's unknown members, by level
+    optional<JsonDomBuilder> capture; // builds the value of the one being read
+
+    bool fail(const std::string &message)
+    {
+        error = message;
+        return false;
+    }
+
+    // True when the value about to arrive belongs to an unknown member and
+    // goes to the capture; the first event of the value clears skipValue
+    bool skipping()
+    {
+        if (skipDepth > 0)
+        {
+            return true;
+        }
+        if (skipValue)
+        {
+            skipValue = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Starts keeping the value of an unknown member at a level of the entry
+    void keep(const char *level, const std::string &name)
+    {
+        if (unknown.is_null())
+        {
+            unknown = json::object();
+        }
+        capture.emplace(unknown[level][name]);
+        skipValue = true;
+    }
+
+    // After a scalar or closing bracket of a kept value; the capture ends with the value
+    bool captured()
+    {
+        if (skipDepth == 0)
+        {
+            capture.reset();
+        }
+        return true;
+    }
+
+    std::string where() const
+    {
+        return "entry " + to_string(day ? day->size() + 1 : 0) + " of " + date;
+    }
+
+    // Reports a value of the wrong type for the position it appeared in
+    bool mismatch()
+    {
+        switch (depth)
+        {
+        case 0:
+            return fail("food log must be a JSON object of dates");
+        case 1:
+            return fail("entries for " + date + " must be an array");
+        case 2:
+            return fail(where() + " needs a string 'name'");
+        case 3:
+            switch (entryMember)
+            {
+            case Member::Name: return fail(where() + " needs a string 'name'");
+            case Member::Servings: return fail(where() + " needs an integer 'servings'");
+            case Member::Id: return fail(where() + " needs a string 'id'");
+            default: return fail(where() + " needs 'details' with numeric 'calories'");
+            }
+        case 4:
+            switch (detailMember)
+            {
+            case Member::Keywords: return fail(where() + " needs an array of 'keywords'");
+            case Member::Ingredients: return fail(where() + " needs an object of 'ingredients'");
+            case Member::Nutrients: return fail(where() + " needs an object of 'nutrients'");
+            default: return fail(where() + " needs 'details' with numeric 'calories'");
+            }
+        default:
+            return fail(detailMember == Member::Keywords    ? where() + " needs string 'keywords'"
+                        : detailMember == Member::Nutrients ? where() + " needs numeric 'nutrients' amounts"
+                                                            : where() + " needs numeric 'ingredients' servings");
+        }
+    }
+
+    bool number(double value, bool integer)
+    {
+        if (depth == 3 && entryMember == Member::Servings && integer)
+        {
+            current.servings = static_cast<int32_t>(value);
+            hasServings = true;
+            return true;
+        }
+        if (depth == 4 && detailMember == Member::Calories)
+        {
+            current.calories = static_cast<int32_t>(value);
+            hasCalories = true;
+            return true;
+        }
+        if (depth == 5 && detailMember == Member::Ingredients)
+        {
+            current.ingredients.emplace_back(pendingIngredient, static_cast<int32_t>(value));
+            return true;
+        }
+        if (depth == 5 && detailMember == Member::Nutrients)
+        {
+            if (!Nutrients::validAmount(value))
+                return fail(where() + " has a nutrient amount out of range");
+            current.nutrients[pendingNutrient] = Nutrients::round(value);
+            return true;
+        }
+        return mismatch();
+    }
+
+public:
+    explicit FoodLogSax(FoodLogStore &target) : store(target), strings(target.names()) {}
+
+    bool null()
+    {
+        if (skipping())
+            return capture->null() && captured();
+        if (depth == 1)
+        {
+            return true; // dates left behind empty by older versions
+        }
+        return mismatch();
+    }
+
+    bool boolean(bool value) { return skipping() ? capture->boolean(value) && captured() : mismatch(); }
+
+    bool number_integer(json::number_integer_t value)
+    {
+        return skipping() ? capture->number_integer(value) && captured() : number(static_cast<double>(value), true);
+    }
+
+    bool number_unsigned(json::number_unsigned_t value)
+    {
+        return skipping() ? capture->number_unsigned(value) && captured() : number(static_cast<double>(value), true);
+    }
+
+    bool number_float(json::number_float_t value, const std::string &text)
+    {
+        return skipping() ? capture->number_float(value, text) && captured() : number(value, false);
+    }
+
+    bool binary(json::binary_t &value) { return skipping() ? capture->binary(value) && captured() : mismatch(); }
+
+    bool string(std::string &value)
+    {
+        if (skipping())
+            return capture->string(value) && captured();
+        if (depth == 3 && entryMember == Member::Name)
+        {
+            current.name = strings.intern(value);
+            hasName = true;
+            return true;
+        }
+        if (depth == 3 && entryMember == Member::Id)
+        {
+            current.id = strings.copy(value);
+            current.hasId = true;
+            return true;
+        }
+        if (depth == 5 && detailMember == Member::Keywords)
+        {
+            current.keywords.push_back(strings.intern(value));
+            return true;
+        }
+        return mismatch();
+    }
+
+    bool key(std::string &value)
+    {
+        if (skipDepth > 0)
+        {
+            return capture->key(value);
+        }
+
+        switch (depth)
+        {
+        case 1:
+            date = value;
+            break;
+        case 3:
+            entryMember = value == "name" ? Member::Name
+                          : value == "servings" ? Member::Servings
+                          : value == "id" ? Member::Id
+                          : value == "details" ? Member::Details
+                                               : Member::Other;
+            if (entryMember == Member::Other)
+            {
+                keep("entry", value);
+            }
+            break;
+        case 4:
+            detailMember = value == "calories" ? Member::Calories
+                           : value == "keywords" ? Member::Keywords
+                           : value == "ingredients" ? Member::Ingredients
+                           : value == "nutrients" ? Member::Nutrients
+                                                    : Member::Other;
+            if (detailMember == Member::Other)
+            {
+                keep("details", value);
+            }
+            break;
+        default:
+            if (detailMember == Member::Nutrients)
+            {
+                pendingNutrient = Nutrients::indexOf(value);
+                if (pendingNutrient < 0)
+                {
+                    keep("nutrients", value); // from a newer version, perhaps
+                }
+            }
+            else
+            {
+                pendingIngredient = strings.intern(value);
+            }
+            break;
+        }
+        return true;
+    }
+
+    bool start_object(size_t elements)
+    {
+        if (skipping())
+        {
+            skipDepth++;
+            return capture->start_object(elements);
+        }
+        bool expected = depth == 0 || depth == 2 || (depth == 3 && entryMember == Member::Details) ||
+                        (depth == 4 && (detailMember == Member::Ingredients || detailMember == Member::Nutrients));
+        if (!expected)
+        {
+            return mismatch();
+        }
+        depth++;
+        if (depth == 3)
+        {
+            current.name = StringInterner::npos;
+            current.servings = current.calories = 0;
+            current.composite = current.hasId = false;
+            current.id = {};
+            current.nutrients = {};
+            current.keywords.clear();
+            current.ingredients.clear();
+            current.unknown = {};
+            unknown = json();
+            hasName = hasServings = hasCalories = false;
+            entryMember = Member::Other;
+        }
+        else if (depth == 4)
+        {
+            detailMember = Member::Other;
+        }
+        else if (depth == 5 && detailMember == Member::Ingredients)
+        {
+            current.composite = true;
+        }
+        return true;
+    }
+
+    bool end_object()
+    {
+        if (skipDepth > 0)
+        {
+            skipDepth--;
+            return capture->end_object() && captured();
+        }
+        if (depth == 3)
+        {
+            if (!hasName)
+                return fail(where() + " needs a string 'name'");
+            if (!hasServings)
+                return fail(where() + " needs an integer 'servings'");
+            if (!hasCalories)
+                return fail(where() + " needs 'details' with numeric 'calories'");
+            if (!unknown.is_null())
+            {
+                current.unknown = strings.copy(unknown.dump());
+            }
+            day->push_back(current);
+        }
+        depth--;
+        return true;
+    }
+
+    bool start_array(size_t elements)
+    {
+        if (skipping())
+        {
+            skipDepth++;
+            return capture->start_array(elements);
+        }
+        if (depth == 1)
+        {
+            day = &store.day(date);
+        }
+        else if (!(depth == 4 && detailMember == Member::Keywords))
+        {
+            return mismatch();
+        }
+        depth++;
+        return true;
+    }
+
+    bool end_array()
+    {
+        if (skipDepth > 0)
+        {
+            skipDepth--;
+            return capture->end_array() && captured();
+        }
+        depth--;
+        if (depth == 1)
+        {
+            day = nullptr;
+        }
+        return true;
+    }
+
+    bool parse_error(size_t position, const std::string &, const nlohmann::detail::exception &ex)
+    {
+        return fail("syntax error at byte " + to_string(position) + ": " + ex.what());
+    }
+};
+
+// Where foods were logged: for each folded food name, the dates it appears on
+// in date order and what was logged under it there, so the days with a food
+// are found without reading every day. A basic entry counts toward its own
+// name and a composite entry toward each ingredient saved with it. A day is
+// re-indexed from scratch when the store reports it changed, dropping the
+// postings it had first, so edits, undo and redo need no bookkeeping here.
+class LogUsageIndex
+{
+public:
+    struct Usage
+    {
+        int64_t servings = 0;           // logged as a basic food
+        int64_t calories = 0;           // of those servings, as logged
+        int64_t ingredientServings = 0; // inside logged composites, per their saved ingredients
+    };
+
+private:
+    unordered_map<uint32_t, map<string_view, Usage>> byFood; // folded name ID -> dates
+    unordered_map<string_view, vector<uint32_t>> foodsOn;    // date -> folded names it is posted under
+    vector<uint32_t> folded; // name ID -> folded name ID, npos until first needed
+
+    uint32_t fold(uint32_t name, StringInterner &strings)
+    {
+        if (name >= folded.size())
+        {
+            folded.resize(max<size_t>(strings.size(), name + 1), StringInterner::npos);
+        }
+        if (folded[name] == StringInterner::npos)
+        {
+            string text(strings.str(name));
+            transform(text.begin(), text.end(), text.begin(), ::tolower);
+            folded[name] = strings.intern(text);
+        }
+        return folded[name];
+    }
+
+    Usage &post(uint32_t food, string_view date)
+    {
+        auto [it, added] = byFood[food].try_emplace(date);
+        if (added)
+        {
+            foodsOn[date].push_back(food);
+        }
+        return it->second;
+    }
+
+public:
+    // Replaces what is indexed for a date with its entries, or with nothing
+    void reindex(string_view date, const FoodLogStore::Day *entries, StringInterner &strings)
+    {
+        auto it = foodsOn.find(date);
+        if (it != foodsOn.end())
+        {
+            for (uint32_t food : it->second)
+            {
+                auto dates = byFood.find(food);
+                dates->second.erase(date);
+                if (dates->second.empty())
+                {
+                    byFood.erase(dates);
+                }
+            }
+            foodsOn.erase(it);
+        }
+        if (!entries)
+        {
+            return;
+        }
+        for (const LogEntry &entry : *entries)
+        {
+            if (!entry.composite)
+            {
+                Usage &usage = post(fold(entry.name, strings), date);
+                usage.servings += entry.servings;
+                usage.calories += static_cast<int64_t>(entry.servings) * entry.calories;
+            }
+            for (const auto &[ingredient, servings] : entry.ingredients)
+            {
+                post(fold(ingredient, strings), date).ingredientServings += static_cast<int64_t>(entry.servings) * servings;
+            }
+        }
+    }
+
+    // Visits the dates from..to inclusive with something under a folded name, in date order
+    template <typename Visit>
+    void forEachDate(uint32_t food, string_view from, string_view to, Visit visit) const
+    {
+        auto it = byFood.find(food);
+        if (it == byFood.end())
+        {
+            return;
+        }
+        for (auto date = it->second.lower_bound(from); date != it->second.end() && date->first <= to; ++date)
+        {
+            visit(date->first, date->second);
+        }
+    }
+};
+
+class DailyFoodLog
+{
+private:
+    string logFilename;
+    FoodLogStore store;
+    CommandManager commandManager;
+    LogUsageIndex usage; // brought up to date from the store's changed days by forEachUse
+    DeferredSave pendingSave{[this]() { saveLog(); }};
+
+    // Snapshots a catalog food, in the JSON shape getAllFoods returns, as a log entry
+    LogEntry makeEntry(const string &foodName, int servings, const json &details)
+    {
+        StringInterner &strings = store.names();
+        LogEntry entry;
+        entry.name = strings.intern(foodName);
+        entry.servings = servings;
+        entry.calories = details.at("calories").get<int>();
+        entry.nutrients = Nutrients::fromJson(details);
+        if (details.contains("keywords"))
+        {
+            for (const auto &keyword : details["keywords"])
+            {
+                entry.keywords.push_back(strings.intern(keyword.get<string>()));
+            }
+        }
+        if (details.contains("ingredients"))
+        {
+            entry.composite = true;
+            for (const auto &[ingredient, amount] : details["ingredients"].items())
+            {
+                entry.ingredients.emplace_back(strings.intern(ingredient), amount.get<int>());
+            }
+        }
+        return entry;
+    }
+
+    void setServings(const string &date, int index, int servings)
+    {
+        FoodLogStore::Day &entries = store.day(date);
+        if (index < static_cast<int>(entries.size()))
+        {
+            entries[index].servings = servings;
+        }
+    }
+
+    string getCurrentDate()
+    {
+        time_t now = time(0);
+        tm *ltm = localtime(&now);
+
+        stringstream ss;
+        ss << 1900 + ltm->tm_year << '-'
+           << setw(2) << setfill('0') << 1 + ltm->tm_mon << '-'
+           << setw(2) << setfill('0') << ltm->tm_mday;
+        return ss.str();
+    }
+
+public:
+    DailyFoodLog(const string &filename = "daily_food_log.json")
+        : logFilename(filename)
+    {
+        loadLog();
+    }
+
+    ~DailyFoodLog()
+    {
+        saveLog();
+        BackgroundWriter::instance().flush();
+    }
+
+    bool canUndo() const
+    {
+        return commandManager.canUndo();
+    }
+
+    bool canRedo() const
+    {
+        return commandManager.canRedo();
+    }
+
+    // Groups the following log changes into one step: saved once on commit,
+    // undone and redone as a unit, or rolled back entirely by abort
+    void beginTransaction()
+    {
+        commandManager.beginGroup();
+        pendingSave.hold();
+    }
+
+    void commitTransaction()
+    {
+        commandManager.commitGroup([this](const function<void()> &steps) { pendingSave.around(steps); });
+        pendingSave.release();
+    }
+
+    void abortTransaction()
+    {
+        commandManager.abortGroup();
+        pendingSave.release(false);
+    }
+
+    void saveLog()
+    {
+        if (pendingSave.defer())
+        {
+            return;
+        }
+        PERF_SCOPE(SaveLog);
+        TRACE_SPAN("saveLog", "io");
+        if (isBinaryLog(logFilename))
+        {
+            // The binary form is small and quick to build, so it is encoded here whole
+            auto image = make_shared<string>();
+            store.encodeBinary(*image);
+            BackgroundWriter::instance().submit(logFilename, PerfCounter::LogBytesWritten,
+                                                [image](string &out) { out += *image; });
+            updateSizeStats();
+            return;
+        }
+        // Re-serializes only the days edited since the last save; the writer
+        // thread joins the fragments and writes the file
+        shared_ptr<const FoodLogStore::Snapshot> snapshot = store.snapshot();
+        BackgroundWriter::instance().submit(logFilename, PerfCounter::LogBytesWritten,
+                                            [snapshot](string &out) { FoodLogStore::assemble(*snapshot, out); });
+        updateSizeStats();
+    }
+
+    void loadLog()
+    {
+        PERF_SCOPE(LoadLog);
+        TRACE_SPAN("loadLog", "io");
+        store.clear();
+        if (!readLog(logFilename, store) && isBinaryLog(logFilename))
+        {
+            // First run with a binary log: start from the JSON log next to it
+            readLog(logFilename.substr(0, logFilename.size() - 6) + ".json", store);
+        }
+        updateSizeStats();
+    }
+
+    // Logs named *.dmlog use the compact binary encoding, anything else is JSON
+    static bool isBinaryLog(const string &path)
+    {
+        return path.size() >= 6 && path.compare(path.size() - 6, 6, ".dmlog") == 0;
+    }
+
+    // Loads a log file into a store; false if there is no such file
+    static bool readLog(const string &path, FoodLogStore &store)
+    {
+        FastJson::Buffer buffer;
+        if (!FastJson::readFile(path, buffer))
+        {
+            return false;
+        }
+        string error;
+        if (isBinaryLog(path))
+        {
+            if (!store.decodeBinary(string_view(buffer.data.data(), buffer.length), error))
+            {
+                throw runtime_error(path + ": " + error);
+            }
+            return true;
+        }
+        // Straight into the typed store, checking the schema on the way
+        FoodLogSax handler(store);
+        if (!FastJson::parse(buffer, handler, error))
+        {
+            throw runtime_error(path + ": " + error);
+        }
+        return true;
+    }
+
+    // Serializes a store in the encoding its file name calls for
+    static void encodeLog(const string &path, FoodLogStore &store, string &out)
+    {
+        if (isBinaryLog(path))
+        {
+            store.encodeBinary(out);
+        }
+        else
+        {
+            store.write(out);
+        }
+    }
+
+    void updateSizeStats()
+    {
+#ifdef DIETMANAGER_STATS
+        PERF_SET(LogDates, store.dateCount());
+        PERF_SET(LogEntries, store.entryCount());
+#endif
+    }
+
+    void addFoodToLog(const string &date, const string &foodName, int servings, const json &foodDetails)
+    {
+        LogEntry entry = makeEntry(foodName, servings, foodDetails);
+
+        // A unique identifier, made once so every redo adds the same entry and
+        // undo (or aborting a meal) removes exactly that one
+        entry.id = store.names().copy(to_string(time(0)) + "_" + to_string(rand()));
+        entry.hasId = true;
+
+        // Create the do command
+        auto doCmd = [this, date, entry]()
+        {
+            store.day(date).push_back(entry);
+            saveLog();
+        };
+
+        // Create the undo command
+        auto undoCmd = [this, date, id = entry.id]()
+        {
+            if (FoodLogStore::Day *day = store.edit(date))
+            {
+                // The entry just added is the last one with the ID
+                for (auto it = day->rbegin(); it != day->rend(); ++it)
+                {
+                    if (it->hasId && it->id == id)
+                    {
+                        day->erase(next(it).base());
+                        break;
+                    }
+                }
+                saveLog();
+            }
+        };
+
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    void updateServingsInLog(const string &date, int index, int newServings)
+    {
+        const FoodLogStore::Day *day = store.find(date);
+        if (!day || index < 0 || index >= static_cast<int>(day->size()))
+        {
+            cout << "Invalid entry index!\n";
+            return;
+        }
+
+        // Store the old servings for undo functionality
+        int oldServings = (*day)[index].servings;
+        
+        // Create the do command
+        auto doCmd = [this, date, index, newServings]()
+        {
+            setServings(date, index, newServings);
+            saveLog();
+        };
+
+        // Create the undo command
+        auto undoCmd = [this, date, index, oldServings]()
+        {
+            setServings(date, index, oldServings);
+            saveLog();
+        };
+
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    void removeFoodFromLog()
+    {
+        // string date = userProfile.getDate();
+        // json dailyLog = foodLog.viewDailyLog(date);
+
+        // if (dailyLog.is_null() || dailyLog.empty())
+        // {
+        //     cout << "No food entries for " << date << "\n";
+        //     return;
+        // }
+
+        // // Display the food log with numbers
+        // cout << "\n===== Food Log for " << date << " =====\n";
+        // for (int i = 0; i < dailyLog.size(); i++)
+        // {
+        //     string foodName = dailyLog[i]["name"];
+        //     int servings = dailyLog[i]["servings"];
+        //     cout << (i + 1) << ". " << foodName << " (" << servings << " servings)\n";
+        // }
+
+        // // Ask for selection
+        // int selection;
+        // cout << "\nSelect entry to remove (enter number): ";
+        // while (!(cin >> selection) || selection < 1 || selection > dailyLog.size())
+        // {
+        //     cin.clear();
+        //     cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        //     cout << "Invalid input! Enter a number between 1 and " << dailyLog.size() << ": ";
+        // }
+        // cin.ignore();
+
+        // // Convert to zero-based index
+        // int arrayIndex = selection - 1;
+
+        // // Get the selected food entry
+        // string foodName = dailyLog[arrayIndex]["name"];
+        // int currentServings = dailyLog[arrayIndex]["servings"];
+
+        // // Ask for the number of servings to remove
+        // int servingsToRemove;
+        // cout << "Enter the number of servings to remove: ";
+        // while (!(cin >> servingsToRemove) || servingsToRemove <= 0)
+        // {
+        //     cin.clear();
+        //     cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        //     cout << "Invalid input! Enter a positive number: ";
+        // }
+        // cin.ignore();
+
+        // // Check if the servings to remove exceed the current servings
+        // if (servingsToRemove > currentServings)
+        // {
+        //     cout << "Error: Cannot remove more servings than currently present (" << currentServings << " servings).\n";
+        //     return;
+        // }
+
+        // // Update the servings in the log
+        // if (servingsToRemove == currentServings)
+        // {
+        //     // Remove the entry completely if all servings are removed
+        //     foodLog.removeFoodFromLogByIndex(date, arrayIndex);
+        //     cout << "Entry removed successfully.\n";
+        // }
+        // else
+        // {
+        //     // Update the servings in the log
+        //     dailyLog[arrayIndex]["servings"] = currentServings - servingsToRemove;
+        //     foodLog.saveLog();
+        //     cout << "Updated servings for " << foodName << " to " << (currentServings - servingsToRemove) << " servings.\n";
+        // }
+
+        // // Update the servings in the database
+        // json allFoods = foodDb.getAllFoods();
+        // if (allFoods["basic"].contains(foodName))
+        // {
+        //     // Update servings in the basic food category
+        //     allFoods["basic"][foodName]["servings"] = currentServings - servingsToRemove;
+        // }
+        // else if (allFoods["composite"].contains(foodName))
+        // {
+        //     // Update servings in the composite food category
+        //     allFoods["composite"][foodName]["servings"] = currentServings - servingsToRemove;
+        // }
+        // foodDb.saveDatabase();
+    }
+
+    void removeFoodFromLogByIndex(const string &date, int index)
+    {
+        const FoodLogStore::Day *day = store.find(date);
+        if (!day || index < 0 || index >= static_cast<int>(day->size()))
+        {
+            cout << "Invalid entry index!\n";
+            return;
+        }
+
+        // Store the entry for undo functionality
+        LogEntry entryToRemove = (*day)[index];
+
+        // Create the do command
+        auto doCmd = [this, date, index]()
+        {
+            FoodLogStore::Day &entries = store.day(date);
+            if (index < static_cast<int>(entries.size()))
+            {
+                entries.erase(entries.begin() + index);
+            }
+            saveLog();
+        };
+
+        // Create the undo command
+        auto undoCmd = [this, date, index, entryToRemove]()
+        {
+            // Insert back at the same position
+            FoodLogStore::Day &entries = store.day(date);
+            entries.insert(entries.begin() + min<size_t>(index, entries.size()), entryToRemove);
+            saveLog();
+        };
+
+        commandManager.executeCommand(doCmd, undoCmd);
+    }
+
+    // Entries for a date as they sit in the store, empty if the date has none
+    ColumnRange<LogEntry> entriesOn(const string &date) const
+    {
+        const FoodLogStore::Day *day = store.find(date);
+        if (!day)
+        {
+            return {nullptr, nullptr};
+        }
+        return {day->data(), day->data() + day->size()};
+    }
+
+    string_view nameOf(const LogEntry &entry) const
+    {
+        return store.names().str(entry.name);
+    }
+
+    // Visits the dates from..to inclusive on which a food was logged as a
+    // basic food or saved as an ingredient of a logged composite, in date
+    // order, with a LogUsageIndex::Usage; the name is matched ignoring case
+    template <typename Visit>
+    void forEachUse(string_view foodName, const string &from, const string &to, Visit visit)
+    {
+        StringInterner &strings = store.names();
+        store.takeChangedDays([&](string_view date, const FoodLogStore::Day *entries) {
+            usage.reindex(date, entries, strings);
+        });
+        string lowerName(foodName);
+        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+        uint32_t food = strings.find(lowerName);
+        if (food != StringInterner::npos)
+        {
+            usage.forEachDate(food, from, to, visit);
+        }
+    }
+
+    // Entries for a date in their JSON shape, or null if the date has none
+    json viewDailyLog(const string &date) const
+    {
+        const FoodLogStore::Day *day = store.find(date);
+        if (!day)
+        {
+            return json();
+        }
+        json entries = json::array();
+        for (const LogEntry &entry : *day)
+        {
+            entries.push_back(store.toJson(entry));
+        }
+        return entries;
+    }
+
+    void undo()
+    {
+        commandManager.undo();
+    }
+
+    void redo()
+    {
+        commandManager.redo();
+    }
+
+    int getDailyCalories(const string &date)
+    {
+        PERF_SCOPE(DailyCalories);
+        TRACE_SPAN("getDailyCalories", "calc");
+        int totalCalories = 0;
+
+        if (const FoodLogStore::Day *day = store.find(date))
+        {
+            for (const LogEntry &entry : *day)
+            {
+                totalCalories += entry.servings * entry.calories;
+            }
+        }
+
+        return totalCalories;
+    }
+
+    // Nutrients eaten on a date: every entry's amounts times its servings
+    Nutrients getDailyNutrients(const string &date) const
+    {
+        Nutrients total;
+        if (const FoodLogStore::Day *day = store.find(date))
+        {
+            for (const LogEntry &entry : *day)
+            {
+                total.addScaled(entry.nutrients, static_cast<float>(entry.servings));
+            }
+        }
+        return total;
+    }
+
+    // Nutrients eaten on the dates from..to inclusive; days receives how many
+    // of those dates have entries
+    Nutrients getNutrientsBetween(const string &from, const string &to, size_t &days) const
+    {
+        Nutrients total;
+        days = 0;
+        store.forEachDay(from, to, [&](string_view, const FoodLogStore::Day &entries) {
+            if (entries.empty())
+            {
+                return;
+            }
+            days++;
+            for (const LogEntry &entry : entries)
+            {
+                total.addScaled(entry.nutrients, static_cast<float>(entry.servings));
+            }
+        });
+        return total;
+    }
+
+    // How many times each food was logged, by name ID, for ranking search results
+    unordered_map<uint32_t, uint32_t> foodFrequencies() const
+    {
+        unordered_map<uint32_t, uint32_t> frequencies;
+        store.forEachDay({}, {}, [&](string_view, const FoodLogStore::Day &entries) {
+            for (const LogEntry &entry : entries)
+            {
+                frequencies[entry.name]++;
+            }
+        });
+        return frequencies;
+    }
+};
+
+// Streams food logs into a compact columnar file for analytics. Rows are
+// buffered per column and written out as row groups, so the exporter's own
+// memory does not grow with the export, and each group goes to disk on a
+// helper thread while the next one is being filled. The file is written
+// under a temporary name and takes its own only when finish() succeeds.
+//
+// Layout, all integers little-endian:
+//   "DMCOLS01"
+//   row groups, each:
+//     u32 rows, u32 new dictionary entries, per entry u32 length + bytes
+//     six column chunks, each u32 byte length + packed values:
+//       tenant u32, date i32 (yyyymmdd), food u32, servings i32, calories i32, total i64
+//   footer: u32 row groups, per group u64 offset, u32 rows, i32 first date, i32 last date
+//   u64 footer offset, "DMCOLS01"
+// Tenant and food are codes into one string dictionary that grows as the
+// groups are written: code n is the n-th entry the file introduced.
+class LogExporter
+{
+public:
+    static constexpr size_t RowGroupRows = 64 * 1024;
+    static constexpr const char *Magic = "DMCOLS01";
+
+    struct Result
+    {
+        size_t rows = 0;
+        size_t rowGroups = 0;
+        size_t dictionarySize = 0;
+        uint64_t bytes = 0;
+    };
+
+private:
+    struct GroupInfo
+    {
+        uint64_t offset;
+        uint32_t rows;
+        int32_t firstDate;
+        int32_t lastDate;
+    };
+
+    string path;
+    string temporary;
+    ofstream out;
+    bool finished = false; // renamed into place
+    Result totals;
+    vector<GroupInfo> groups;
+
+    // Columns of the row group being filled
+    vector<uint32_t> tenantColumn;
+    vector<int32_t> dateColumn;
+    vector<uint32_t> foodColumn;
+    vector<int32_t> servingsColumn;
+    vector<int32_t> calorieColumn;
+    vector<int64_t> totalColumn;
+
+    unordered_map<string, uint32_t> dictionary;
+    vector<string> newEntries; // dictionary entries the next group introduces
+
+    // Two blocks alternate: one is written out while the other is encoded
+    string blocks[2];
+    int currentBlock = 0;
+    future<bool> pendingWrite;
+
+    template <typename T>
+    static void put(string &block, T value)
+    {
+        auto bits = static_cast<make_unsigned_t<T>>(value);
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            block.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+        }
+    }
+
+    template <typename T>
+    static void putColumn(string &block, const vector<T> &column)
+    {
+        put(block, static_cast<uint32_t>(column.size() * sizeof(T)));
+        for (T value : column)
+        {
+            put(block, value);
+        }
+    }
+
+    static int32_t dateNumber(string_view date)
+    {
+        // "YYYY-MM-DD" -> YYYYMMDD; anything else is exported as 0
+        if (date.size() != 10 || date[4] != '-' || date[7] != '-')
+        {
+            return 0;
+        }
+        int32_t number = 0;
+        for (size_t i = 0; i < date.size(); i++)
+        {
+            if (i == 4 || i == 7)
+                continue;
+            if (!isdigit(static_cast<unsigned char>(date[i])))
+                return 0;
+            number = number * 10 + (date[i] - '0');
+        }
+        return number;
+    }
+
+    uint32_t code(string_view text)
+    {
+        auto [it, added] = dictionary.try_emplace(string(text), static_cast<uint32_t>(dictionary.size()));
+        if (added)
+        {
+            newEntries.push_back(it->first);
+        }
+        return it->second;
+    }
+
+    bool waitForWrite()
+    {
+        return !pendingWrite.valid() || pendingWrite.get();
+    }
+
+    // Encodes the buffered rows as a row group and hands it to the helper thread
+    bool flushGroup()
+    {
+        if (tenantColumn.empty())
+        {
+            return true;
+        }
+        string &block = blocks[currentBlock];
+        block.clear();
+        put(block, static_cast<uint32_t>(tenantColumn.size()));
+        put(block, static_cast<uint32_t>(newEntries.size()));
+        for (const string &entry : newEntries)
+        {
+            put(block, static_cast<uint32_t>(entry.size()));
+            block += entry;
+        }
+        putColumn(block, tenantColumn);
+        putColumn(block, dateColumn);
+        putColumn(block, foodColumn);
+        putColumn(block, servingsColumn);
+        putColumn(block, calorieColumn);
+        putColumn(block, totalColumn);
+
+        auto [first, last] = minmax_element(dateColumn.begin(), dateColumn.end());
+        groups.push_back({totals.bytes, static_cast<uint32_t>(tenantColumn.size()), *first, *last});
+        totals.rows += tenantColumn.size();
+        totals.bytes += block.size();
+
+        bool written = waitForWrite();
+        pendingWrite = async(launch::async, [this, &block]() {
+            out.write(block.data(), static_cast<streamsize>(block.size()));
+            return static_cast<bool>(out);
+        });
+        currentBlock ^= 1;
+
+        newEntries.clear();
+        tenantColumn.clear();
+        dateColumn.clear();
+        foodColumn.clear();
+        servingsColumn.clear();
+        calorieColumn.clear();
+        totalColumn.clear();
+        return written;
+    }
+
+public:
+    explicit LogExporter(const string &path)
+        : path(path), temporary(path + ".tmp"), out(temporary, ios::binary | ios::trunc)
+    {
+        if (out.is_open())
+        {
+            out.write(Magic, 8);
+            totals.bytes = 8;
+        }
+        for (auto *column : {&tenantColumn, &foodColumn})
+            column->reserve(RowGroupRows);
+        for (auto *column : {&dateColumn, &servingsColumn, &calorieColumn})
+            column->reserve(RowGroupRows);
+        totalColumn.reserve(RowGroupRows);
+    }
+
+    // An export that did not finish leaves no file behind
+    ~LogExporter()
+    {
+        waitForWrite();
+        if (!finished)
+        {
+            out.close();
+            ::unlink(temporary.c_str());
+        }
+    }
+
+    bool isOpen() const
+    {
+        return out.is_open();
+    }
+
+    // Appends one tenant's entries dated from..to inclusive; empty bounds are open
+    bool addTenant(const string &tenant, const FoodLogStore &store, const string &from, const string &to)
+    {
+        TRACE_SPAN("exportTenant", "io");
+        const StringInterner &strings = store.names();
+        uint32_t tenantCode = code(tenant);
+        vector<uint32_t> foodCodes(strings.size(), StringInterner::npos); // store name ID -> file code
+        bool written = true;
+
+        store.forEachDay(from, to, [&](string_view date, const FoodLogStore::Day &entries) {
+            int32_t dateValue = dateNumber(date);
+            for (const LogEntry &entry : entries)
+            {
+                uint32_t &food = foodCodes[entry.name];
+                if (food == StringInterner::npos)
+                {
+                    food = code(strings.str(entry.name));
+                }
+                tenantColumn.push_back(tenantCode);
+                dateColumn.push_back(dateValue);
+                foodColumn.push_back(food);
+                servingsColumn.push_back(entry.servings);
+                calorieColumn.push_back(entry.calories);
+                totalColumn.push_back(static_cast<int64_t>(entry.servings) * entry.calories);
+                if (tenantColumn.size() == RowGroupRows)
+                {
+                    written = flushGroup() && written;
+                }
+            }
+        });
+        return written;
+    }
+
+    // Writes the last group and the footer; false if any write failed
+    bool finish()
+    {
+        bool written = flushGroup();
+        written = waitForWrite() && written;
+
+        string &footer = blocks[currentBlock];
+        footer.clear();
+        put(footer, static_cast<uint32_t>(groups.size()));
+        for (const GroupInfo &group : groups)
+        {
+            put(footer, group.offset);
+            put(footer, group.rows);
+            put(footer, group.firstDate);
+            put(footer, group.lastDate);
+        }
+        put(footer, totals.bytes);
+        footer.append(Magic, 8);
+        out.write(footer.data(), static_cast<streamsize>(footer.size()));
+        out.close();
+
+        totals.bytes += footer.size();
+        totals.rowGroups = groups.size();
+        totals.dictionarySize = dictionary.size();
+        finished = written && !out.fail() && ::rename(temporary.c_str(), path.c_str()) == 0;
+        return finished;
+    }
+
+    const Result &result() const
+    {
+        return totals;
+    }
+};
+
+// Scoped transaction on a FoodDatabase or DailyFoodLog. It is aborted when the
+// scope ends unless commit() was called, so an exception or early return in
+// the middle of a batch leaves nothing half-applied.
+template <typename Store>
+class Transaction
+{
+private:
+    Store &store;
+    bool open = true;
+
+public:
+    explicit Transaction(Store &target) : store(target)
+    {
+        store.beginTransaction();
+    }
+
+    ~Transaction()
+    {
+        if (open)
+        {
+            store.abortTransaction();
+        }
+    }
+
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+
+    void commit()
+    {
+        open = false;
+        store.commitTransaction();
+    }
+
+    void abort()
+    {
+        open = false;
+        store.abortTransaction();
+    }
+};
+
+// Formats table rows into one reusable buffer and writes it out in large
+// chunks, instead of a stream insertion with setw for every cell. Columns
+// are left-aligned and padded to their width, at least their title's; a
+// cell that does not fit runs on into the next one, as setw does. widen()
+// sizes a column to its data.
+class TablePrinter
+{
+public:
+    struct Column
+    {
+        const char *title;
+        size_t width;
+    };
+
+private:
+    static constexpr size_t MaxWidth = 60;   // widen() stops here
+    static constexpr size_t FlushBytes = 1 << 16;
+
+    ostream &out;
+    vector<Column> columns;
+    string buffer;
+    size_t column = 0;
+    size_t cellStart = 0;
+
+    void pad(size_t length)
+    {
+        buffer.append(length, ' ');
+    }
+
+public:
+    TablePrinter(ostream &out, vector<Column> columns) : out(out), columns(move(columns))
+    {
+        for (Column &c : this->columns)
+        {
+            c.width = max(c.width, strlen(c.title) + 1);
+        }
+        buffer.reserve(FlushBytes + 4096);
+    }
+
+    ~TablePrinter()
+    {
+        flush();
+    }
+
+    // Makes a column wide enough for a value of this length and a space
+    void widen(size_t index, size_t length)
+    {
+        columns[index].width = max(columns[index].width, min(length + 1, MaxWidth));
+    }
+
+    size_t width() const
+    {
+        size_t total = 0;
+        for (const Column &c : columns)
+        {
+            total += c.width;
+        }
+        return total;
+    }
+
+    void title(string_view text)
+    {
+        buffer += "\n===== ";
+        buffer += text;
+        buffer += " =====\n";
+    }
+
+    // Column titles and a rule under them
+    void header()
+    {
+        for (const Column &c : columns)
+        {
+            cell(c.title);
+        }
+        endRow();
+        rule();
+    }
+
+    void rule()
+    {
+        buffer.append(max<size_t>(width(), 70), '-');
+        buffer += '\n';
+    }
+
+    void line(string_view text)
+    {
+        buffer += text;
+        buffer += '\n';
+        if (buffer.size() >= FlushBytes)
+        {
+            flush();
+        }
+    }
+
+    // A cell may be written in pieces between beginCell and endCell
+    void beginCell()
+    {
+        cellStart = buffer.size();
+    }
+
+    void append(string_view text)
+    {
+        buffer += text;
+    }
+
+    void append(int64_t number)
+    {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), number);
+        buffer.append(digits, result.ptr);
+    }
+
+    void endCell()
+    {
+        // The last column is left ragged rather than padded with trailing spaces
+        size_t length = buffer.size() - cellStart;
+        if (column + 1 < columns.size() && length < columns[column].width)
+        {
+            pad(columns[column].width - length);
+        }
+        column++;
+    }
+
+    template <typename T>
+    void cell(const T &value)
+    {
+        beginCell();
+        append(value);
+        endCell();
+    }
+
+    void endRow()
+    {
+        buffer += '\n';
+        column = 0;
+        if (buffer.size() >= FlushBytes)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (!buffer.empty())
+        {
+            out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+            buffer.clear();
+        }
+        out.flush();
+    }
+};
+
+class DietManagerApp
+{
+private:
+    // Declared first so the span covers loading every store at startup
+    optional<TraceSpan> startupSpan;
+    FoodDatabase foodDb;
+    DailyFoodLog foodLog;
+    UserProfile userProfile;
+    shared_ptr<DietCalculator> calculator;
+    string calculatorType;
+
+public:
+    explicit DietManagerApp(const string &logFile = "daily_food_log.json")
+        : startupSpan(in_place, "startup", "app"),
+          foodDb("food_db.json"),
+          foodLog(logFile),
+          userProfile("user_profile.json")
+    {
+        // Default to Harris-Benedict calculator
+        calculatorType = "harris-benedict";
+        calculator = DietCalculatorFactory::createCalculator(calculatorType);
+        userProfile.setCalculator(calculator);
+        startupSpan.reset();
+    }
+
+    ~DietManagerApp()
+    {
+        TRACE_SPAN("shutdown", "app");
+        // Save everything on exit and wait until it is durably on disk
+        foodDb.saveDatabase();
+        foodLog.saveLog();
+        BackgroundWriter::instance().flush(true);
+        // UserProfile saves in its destructor
+    }
+
+    void run()
+    {
+        int choice;
+
+        // Check if user profile exists
+        ifstream profileCheck("user_profile.json");
+        if (!profileCheck.good())
+        {
+            cout << "Welcome to Diet Manager! Let's set up your profile.\n";
+            userProfile.setupProfile();
+        }
+        profileCheck.close();
+        userProfile.startDailyData();
+
+        do
+        {
+            displayMainMenu();
+            while (!(cin >> choice))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Please enter a number: ";
+            }
+            cin.ignore();
+
+            processMenuChoice(choice);
+        } while (choice != 0);
+    }
+
+private:
+void displayMainMenu()
+{
+    cout << "\n===== Diet Manager Application =====\n";
+    cout << left << setw(5) << "1." << "Add Basic Food\n";
+    cout << left << setw(5) << "2." << "Add Composite Food\n";
+    cout << left << setw(5) << "3." << "View All Foods\n";
+    cout << left << setw(5) << "4." << "Add Food to Daily Log\n";
+    cout << left << setw(5) << "5." << "View Daily Food Log\n";
+    cout << left << setw(5) << "6." << "Remove Food from Log\n";
+    cout << left << setw(5) << "7." << "Update Profile Information\n";
+    cout << left << setw(5) << "8." << "Change Calorie Calculation Method\n";
+    cout << left << setw(5) << "9." << "View Calorie Summary\n";
+    cout << left << setw(5) << "10." << "Set Date\n";
+    cout << left << setw(5) << "11." << "Undo Last Action\n";
+    cout << left << setw(5) << "12." << "Redo Last Action\n";
+    cout << left << setw(5) << "13." << "Save Database\n";
+    cout << left << setw(5) << "14." << "View Performance Stats\n";
+    cout << left << setw(5) << "15." << "Log a Meal\n";
+    cout << left << setw(5) << "16." << "Import Foods from File\n";
+    cout << left << setw(5) << "17." << "Find Foods That Fit Remaining Calories\n";
+    cout << left << setw(5) << "18." << "Plan a Day of Meals\n";
+    cout << left << setw(5) << "19." << "Query Foods\n";
+    cout << left << setw(5) << "20." << "View Nutrient Summary\n";
+    cout << left << setw(5) << "21." << "Find Where a Food Is Used\n";
+    cout << left << setw(5) << "0." << "Exit\n";
+    cout << "Enter your choice: ";
+}
+
+    static const char *menuActionName(int choice)
+    {
+        static const char *names[] = {
+            "menu:exit", "menu:addBasicFood", "menu:addCompositeFood", "menu:viewAllFoods",
+            "menu:addFoodToLog", "menu:viewFoodLog", "menu:removeFoodFromLog", "menu:updateProfile",
+            "menu:changeCalorieCalculator", "menu:viewCalorieSummary", "menu:setDate", "menu:undo",
+            "menu:redo", "menu:saveDatabase", "menu:viewPerformanceStats", "menu:logMeal",
+            "menu:importFoods", "menu:findFoodsThatFit", "menu:planDay", "menu:queryFoods",
+            "menu:viewNutrientSummary", "menu:findWhereUsed"};
+        if (choice < 0 || choice >= static_cast<int>(sizeof(names) / sizeof(names[0])))
+        {
+            return "menu:invalid";
+        }
+        return names[choice];
+    }
+
+    void processMenuChoice(int choice)
+    {
+        TRACE_SPAN(menuActionName(choice), "menu");
+        switch (choice)
+        {
+        case 0:
+            cout << "Exiting program. Goodbye!\n";
+            break;
+        case 1:
+            foodDb.addBasicFoodUI();
+            break;
+        case 2:
+            foodDb.addCompositeFoodUI();
+            break;
+        case 3:
+            viewAllFoods();
+            break;
+        case 4:
+            addFoodToLog();
+            break;
+        case 5:
+            viewFoodLog();
+            break;
+        case 6:
+            removeFoodFromLog();
+            break;
+        case 7:
+            updateProfile();
+            break;
+        case 8:
+            changeCalorieCalculator();
+            break;
+        case 9:
+            viewCalorieSummary();
+            break;
+        case 10:
+            setDate();
+            break;
+        case 11:
+            if (foodLog.canUndo())
+            {
+                foodLog.undo();
+                cout << "Last action undone in Daily Food Log.\n";
+            }
+            else if (foodDb.canUndo())
+            {
+                foodDb.undo();
+                cout << "Last action undone in Food Database.\n";
+            }
+            else
+            {
+                cout << "Nothing to undo.\n";
+            }
+            break;
+
+        case 12:
+            if (foodLog.canRedo())
+            {
+                foodLog.redo();
+                cout << "Last action redone in Daily Food Log.\n";
+            }
+            else if (foodDb.canRedo())
+            {
+                foodDb.redo();
+                cout << "Last action redone in Food Database.\n";
+            }
+            else
+            {
+                cout << "Nothing to redo.\n";
+            }
+            break;
+        case 13:
+            foodDb.saveDatabase();
+            BackgroundWriter::instance().flush(true);
+            cout << "Database saved successfully.\n";
+            break;
+        case 14:
+            viewPerformanceStats();
+            break;
+        case 15:
+            logMeal();
+            break;
+        case 16:
+            foodDb.importFoodsUI();
+            break;
+        case 17:
+            findFoodsThatFit();
+            break;
+        case 18:
+            planDay();
+            break;
+        case 19:
+            queryFoods();
+            break;
+        case 20:
+            viewNutrientSummary();
+            break;
+        case 21:
+            findWhereUsed();
+            break;
+        default:
+            cout << "Invalid choice! Try again.\n";
+        }
+    }
+
+    // Asks whether to go on after a page of a table; 2 shows the rest at once
+    int askShowMore(size_t shown, size_t total)
+    {
+        int more;
+        cout << "\nShown " << shown << " of " << total << ". Show more? (1 = Yes, 0 = No, 2 = All): ";
+        while (!(cin >> more) || more < 0 || more > 2)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 1, 0 or 2: ";
+        }
+        cin.ignore();
+        return more;
+    }
+
+    // Lists the catalog a page at a time, by category, name or calories
+    void viewAllFoods()
+    {
+        const size_t PageSize = 25;
+        int choice;
+        cout << "Sort by (1 = Category, 2 = Name, 3 = Calories): ";
+        while (!(cin >> choice) || choice < 1 || choice > 3)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 1, 2 or 3: ";
+        }
+        cin.ignore();
+
+        using FoodOrder = FoodDatabase::FoodOrder;
+        FoodOrder order = choice == 1 ? FoodOrder::Category : choice == 2 ? FoodOrder::Name : FoodOrder::Calories;
+        vector<uint32_t> rows = foodDb.orderFoods(order);
+
+        // By category the table comes in two sections as before; otherwise
+        // the categories are mixed and a column tells them apart
+        bool sections = order == FoodOrder::Category;
+        size_t keywordColumn = sections ? 1 : 2;
+        TablePrinter table(cout, sections ? vector<TablePrinter::Column>{{"Name", 20}, {"Keywords", 40}, {"Calories", 10}}
+                                          : vector<TablePrinter::Column>{{"Name", 20}, {"Type", 11}, {"Keywords", 40}, {"Calories", 10}});
+        for (uint32_t row : rows)
+        {
+            FoodDatabase::FoodView food = foodDb.view(row);
+            InternedRange keywords = food.keywords();
+            size_t width = keywords.size() > 0 ? 2 * (keywords.size() - 1) : 0;
+            for (string_view keyword : keywords)
+            {
+                width += keyword.size();
+            }
+            table.widen(0, food.name().size());
+            table.widen(keywordColumn, width);
+        }
+
+        bool compositeHeader = false;
+        table.title(sections ? "Basic Foods" : choice == 2 ? "All Foods by Name" : "All Foods by Calories");
+        table.header();
+
+        size_t shown = 0;
+        size_t pageEnd = PageSize;
+        while (true)
+        {
+            for (; shown < rows.size() && shown < pageEnd; shown++)
+            {
+                FoodDatabase::FoodView food = foodDb.view(rows[shown]);
+                if (sections && food.composite() && !compositeHeader)
+                {
+                    table.title("Composite Foods");
+                    table.header();
+                    compositeHeader = true;
+                }
+
+                table.cell(food.name());
+                if (!sections)
+                {
+                    table.cell(food.composite() ? "composite" : "basic");
+                }
+                table.beginCell();
+                bool first = true;
+                for (string_view keyword : food.keywords())
+                {
+                    if (!first)
+                    {
+                        table.append(", ");
+                    }
+                    table.append(keyword);
+                    first = false;
+                }
+                table.endCell();
+                table.cell(food.calories());
+                table.endRow();
+            }
+            if (shown >= rows.size())
+            {
+                break;
+            }
+
+            table.flush();
+            int more = askShowMore(shown, rows.size());
+            if (more == 0)
+            {
+                return;
+            }
+            pageEnd = more == 2 ? rows.size() : shown + PageSize;
+        }
+
+        if (sections && !compositeHeader)
+        {
+            table.title("Composite Foods");
+            table.header();
+        }
+    }
+
+    // Lists every food by category and lets the user pick one by index
+    bool pickFromList(string &name, json &selectedFood)
+    {
+        // Display search results
+        size_t totalCount = foodDb.countFoods(false) + foodDb.countFoods(true);
+        if (totalCount == 0)
+        {
+            cout << "No foods found matching your criteria.\n";
+            return false;
+        }
+
+        cout << "\nSearch Results:\n";
+
+        // Display basic foods, then composite foods
+        int index = 1;
+        for (bool composite : {false, true})
+        {
+            if (foodDb.countFoods(composite) == 0)
+            {
+                continue;
+            }
+            cout << (composite ? "\n--- Composite Foods ---\n" : "\n--- Basic Foods ---\n");
+            for (const FoodDatabase::FoodView &food : foodDb.foods(composite))
+            {
+                cout << index << ". " << food.name() << " (" << food.calories() << " calories per serving)\n";
+                index++;
+            }
+        }
+
+        // Let user select a food
+        int selectedIndex;
+        cout << "\nSelect a food (enter index): ";
+
+        while (!(cin >> selectedIndex) || selectedIndex < 1 || selectedIndex >= index)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a number between 1 and " << (index - 1) << ": ";
+        }
+
+        // Walk the listing again to the chosen food instead of keeping an index map
+        int basicCount = static_cast<int>(foodDb.countFoods(false));
+        bool composite = selectedIndex > basicCount;
+        int skip = selectedIndex - 1 - (composite ? basicCount : 0);
+        for (const FoodDatabase::FoodView &food : foodDb.foods(composite))
+        {
+            if (skip-- == 0)
+            {
+                name = string(food.name());
+                selectedFood = foodDb.getFood(food);
+                break;
+            }
+        }
+        return true;
+    }
+
+    // After a search without results, offers the foods whose names are
+    // closest to what was typed, in case it was a misspelled name
+    bool pickSuggestion(const vector<string> &keywords, string &name, json &selectedFood)
+    {
+        string query;
+        for (const auto &keyword : keywords)
+        {
+            query += (query.empty() ? "" : " ") + keyword;
+        }
+        vector<string> suggestions = foodDb.suggestFoods(query);
+        if (suggestions.empty())
+        {
+            return false;
+        }
+
+        cout << "Did you mean:\n";
+        for (size_t i = 0; i < suggestions.size(); i++)
+        {
+            cout << i + 1 << ". " << suggestions[i] << "\n";
+        }
+        int selectedIndex;
+        cout << "\nSelect a food (enter index, 0 to cancel): ";
+        while (!(cin >> selectedIndex) || selectedIndex < 0 || selectedIndex > static_cast<int>(suggestions.size()))
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a number between 0 and " << suggestions.size() << ": ";
+        }
+        if (selectedIndex == 0)
+        {
+            return false;
+        }
+
+        // Basic foods first, like ingredient lookup
+        name = suggestions[selectedIndex - 1];
+        selectedFood = foodDb.getFood(name, false);
+        if (selectedFood.is_null())
+        {
+            selectedFood = foodDb.getFood(name, true);
+        }
+        return true;
+    }
+
+    // Shows ranked search results a page at a time; numbering continues
+    // across pages and 0 asks for the next page
+    bool pickRanked(const vector<string> &keywords, bool matchAll, string &name, json &selectedFood)
+    {
+        const size_t PageSize = 10;
+        unordered_map<uint32_t, uint32_t> frequencies = foodLog.foodFrequencies();
+        vector<FoodDatabase::SearchHit> shown;
+        size_t totalMatches = 0;
+
+        while (true)
+        {
+            vector<FoodDatabase::SearchHit> page = foodDb.rankedSearch(keywords, matchAll, shown.size(), PageSize, totalMatches, &frequencies);
+            if (totalMatches == 0)
+            {
+                cout << "No foods found matching your criteria.\n";
+                return pickSuggestion(keywords, name, selectedFood);
+            }
+
+            cout << "\nSearch Results (" << shown.size() + 1 << "-" << shown.size() + page.size() << " of " << totalMatches << "):\n";
+            for (const auto &hit : page)
+            {
+                shown.push_back(hit);
+                cout << shown.size() << ". " << foodDb.nameOf(hit) << " (" << hit.calories << " calories per serving"
+                     << (hit.composite ? ", composite" : "") << ")\n";
+            }
+
+            bool more = shown.size() < totalMatches;
+            int selectedIndex;
+            cout << "\nSelect a food (enter index" << (more ? ", 0 for more results" : "") << "): ";
+            while (!(cin >> selectedIndex) || selectedIndex < (more ? 0 : 1) || selectedIndex > static_cast<int>(shown.size()))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter a number between " << (more ? 0 : 1) << " and " << shown.size() << ": ";
+            }
+            if (selectedIndex == 0)
+            {
+                continue;
+            }
+
+            const auto &hit = shown[selectedIndex - 1];
+            name = string(foodDb.nameOf(hit));
+            selectedFood = foodDb.getFood(name, hit.composite);
+            return true;
+        }
+    }
+
+    // Completes a food name from its first letters. Each line typed extends
+    // the text so far, like further keystrokes; a number picks a completion,
+    // 0 pages on, and an empty line cancels
+    bool pickByPrefix(string &name, json &selectedFood)
+    {
+        const size_t PageSize = 10;
+        string prefix, line;
+        cout << "Name starts with (empty to cancel): ";
+        if (!getline(cin, line) || line.empty())
+        {
+            return false;
+        }
+        prefix = line;
+
+        vector<FoodDatabase::SearchHit> shown;
+        size_t namesShown = 0, totalNames = 0;
+        while (true)
+        {
+            vector<FoodDatabase::SearchHit> page = foodDb.completeFoods(prefix, namesShown, PageSize, totalNames);
+            namesShown = min(namesShown + PageSize, totalNames);
+            if (totalNames == 0)
+            {
+                cout << "No foods start with '" << prefix << "'.\n";
+                cout << "Name starts with (empty to cancel): ";
+                if (!getline(cin, line) || line.empty())
+                {
+                    return false;
+                }
+                prefix = line;
+                continue;
+            }
+
+            cout << "\nFoods starting with '" << prefix << "' (" << totalNames << " names):\n";
+            for (const auto &hit : page)
+            {
+                shown.push_back(hit);
+                cout << shown.size() << ". " << foodDb.nameOf(hit) << " (" << hit.calories << " calories per serving"
+                     << (hit.composite ? ", composite" : "") << ")\n";
+            }
+
+            bool more = namesShown < totalNames;
+            cout << "\nSelect a food (enter index" << (more ? ", 0 for more results" : "")
+                 << "), or keep typing the name: ";
+            if (!getline(cin, line) || line.empty())
+            {
+                return false;
+            }
+
+            // A number picks from what is shown; anything else is more of the name
+            int index;
+            auto [end, error] = from_chars(line.data(), line.data() + line.size(), index);
+            bool isIndex = error == errc() && end == line.data() + line.size() && index >= (more ? 0 : 1) &&
+                           index <= static_cast<int>(shown.size());
+            if (!isIndex)
+            {
+                prefix += line;
+                shown.clear();
+                namesShown = 0;
+                continue;
+            }
+            if (index == 0)
+            {
+                continue;
+            }
+
+            const auto &hit = shown[index - 1];
+            name = string(foodDb.nameOf(hit));
+            selectedFood = foodDb.getFood(name, hit.composite);
+            return true;
+        }
+    }
+
+    bool chooseFood(string &name, json &selectedFood, int &servings)
+    {
+        int selectionMethod;
+        cout << "Select food by:\n";
+        cout << "1. View all foods\n";
+        cout << "2. Search by keywords\n";
+        cout << "3. Type the start of the name\n";
+        cout << "Enter choice: ";
+
+        while (!(cin >> selectionMethod) || selectionMethod < 1 || selectionMethod > 3)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 1, 2 or 3: ";
+        }
+        cin.ignore();
+
+        if (selectionMethod == 1)
+        {
+            // Show all foods
+            if (!pickFromList(name, selectedFood))
+            {
+                return false;
+            }
+        }
+        else if (selectionMethod == 3)
+        {
+            if (!pickByPrefix(name, selectedFood))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            // Search by keywords
+            int keywordCount;
+            cout << "Enter number of keywords to search: ";
+            while (!(cin >> keywordCount) || keywordCount <= 0)
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter a positive number: ";
+            }
+            cin.ignore();
+
+            vector<string> keywords(keywordCount);
+            for (int i = 0; i < keywordCount; ++i)
+            {
+                cout << "Enter keyword " << i + 1 << ": ";
+                getline(cin, keywords[i]);
+            }
+
+            int matchOption;
+            cout << "Match:\n";
+            cout << "1. All keywords\n";
+            cout << "2. Any keyword\n";
+            cout << "Enter choice: ";
+
+            while (!(cin >> matchOption) || (matchOption != 1 && matchOption != 2))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter 1 or 2: ";
+            }
+            cin.ignore();
+
+            bool matchAll = (matchOption == 1);
+            if (!pickRanked(keywords, matchAll, name, selectedFood))
+            {
+                return false;
+            }
+        }
+
+        // Get number of servings
+        cout << "Enter number of servings: ";
+
+        while (!(cin >> servings) || servings <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+        cin.ignore();
+        return true;
+    }
+
+    void addFoodToLog()
+    {
+        string name;
+        json selectedFood;
+        int servings;
+        if (!chooseFood(name, selectedFood, servings))
+        {
+            return;
+        }
+
+        // Add food to log
+        string date = userProfile.getDate();
+        foodLog.addFoodToLog(date, name, servings, selectedFood);
+
+        cout << "Added " << servings << " serving(s) of " << name << " to your log for " << date << "\n";
+    }
+
+    // Logs several foods as one meal: a single save and a single undo step
+    void logMeal()
+    {
+        string date = userProfile.getDate();
+        Transaction<DailyFoodLog> meal(foodLog);
+        int items = 0;
+        int more;
+        do
+        {
+            string name;
+            json selectedFood;
+            int servings;
+            if (chooseFood(name, selectedFood, servings))
+            {
+                foodLog.addFoodToLog(date, name, servings, selectedFood);
+                cout << "Added " << servings << " serving(s) of " << name << " to the meal\n";
+                items++;
+            }
+
+            cout << "Add another food to this meal? (1 = Yes, 0 = No): ";
+            while (!(cin >> more) || (more != 0 && more != 1))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter 1 or 0: ";
+            }
+            cin.ignore();
+        } while (more == 1);
+
+        if (items == 0)
+        {
+            cout << "Nothing was logged.\n";
+            return;
+        }
+
+        int choice;
+        cout << "Log this meal of " << items << " item(s) for " << date << "? (1 = Yes, 0 = Discard): ";
+        while (!(cin >> choice) || (choice != 0 && choice != 1))
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 1 to log, 0 to discard: ";
+        }
+        cin.ignore();
+
+        if (choice == 1)
+        {
+            meal.commit();
+            cout << "Meal logged for " << date << ". Undo removes it as a whole.\n";
+        }
+        else
+        {
+            meal.abort();
+            cout << "Meal discarded.\n";
+        }
+    }
+
+    void viewFoodLog()
+    {
+        const size_t PageSize = 25;
+        string date = userProfile.getDate();
+        ColumnRange<LogEntry> dailyLog = foodLog.entriesOn(date);
+    
+        if (dailyLog.size() == 0)
+        {
+            cout << "No food entries for " << date << "\n";
+            return;
+        }
+    
+        TablePrinter table(cout, {{"No.", 5}, {"Food Name", 20}, {"Servings", 10}, {"Calories/Serving", 15}, {"Total Calories", 15}});
+        int totalCalories = 0;
+        for (const LogEntry &entry : dailyLog)
+        {
+            table.widen(1, foodLog.nameOf(entry).size());
+            totalCalories += entry.servings * entry.calories;
+        }
+
+        table.title("Food Log for " + date);
+        table.header();
+    
+        size_t shown = 0;
+        size_t pageEnd = PageSize;
+        while (true)
+        {
+            for (; shown < dailyLog.size() && shown < pageEnd; shown++)
+            {
+                const LogEntry &entry = dailyLog[shown];
+                table.cell(static_cast<int64_t>(shown + 1));
+                table.cell(foodLog.nameOf(entry));
+                table.cell(entry.servings);
+                table.cell(entry.calories);
+                table.cell(static_cast<int64_t>(entry.servings) * entry.calories);
+                table.endRow();
+            }
+            if (shown >= dailyLog.size())
+            {
+                break;
+            }
+
+            table.flush();
+            int more = askShowMore(shown, dailyLog.size());
+            if (more == 0)
+            {
+                break;
+            }
+            pageEnd = more == 2 ? dailyLog.size() : shown + PageSize;
+        }
+    
+        table.rule();
+        table.line("Total Calories: " + to_string(totalCalories));
+    }
+    void removeFoodFromLog()
+    {
+        string date = userProfile.getDate();
+        ColumnRange<LogEntry> dailyLog = foodLog.entriesOn(date);
+
+        if (dailyLog.size() == 0)
+        {
+            cout << "No food entries for " << date << "\n";
+            return;
+        }
+
+        // Display the food log with numbers
+        cout << "\n===== Food Log for " << date << " =====\n";
+        for (int i = 0; i < dailyLog.size(); i++)
+        {
+            string_view foodName = foodLog.nameOf(dailyLog[i]);
+            int servings = dailyLog[i].servings;
+            cout << (i + 1) << ". " << foodName << " (" << servings << " servings)\n";
+        }
+
+        // Ask for selection
+        int selection;
+        cout << "\nSelect entry to remove (enter number): ";
+        while (!(cin >> selection) || selection < 1 || selection > dailyLog.size())
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a number between 1 and " << dailyLog.size() << ": ";
+        }
+        cin.ignore();
+
+        // Convert to zero-based index
+        int arrayIndex = selection - 1;
+
+        // Get the selected food entry
+        string foodName(foodLog.nameOf(dailyLog[arrayIndex]));
+        int currentServings = dailyLog[arrayIndex].servings;
+
+        // Ask for the number of servings to remove
+        int servingsToRemove;
+        cout << "Enter the number of servings to remove: ";
+        while (!(cin >> servingsToRemove) || servingsToRemove <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a positive number: ";
+        }
+        cin.ignore();
+
+        // Check if the servings to remove exceed the current servings
+        if (servingsToRemove > currentServings)
+        {
+            cout << "Error: Cannot remove more servings than currently present (" << currentServings << " servings).\n";
+            return;
+        }
+
+        // Update the servings in the log
+        if (servingsToRemove == currentServings)
+        {
+            // Remove the entry completely if all servings are removed
+            foodLog.removeFoodFromLogByIndex(date, arrayIndex);
+            cout << "Entry removed successfully.\n";
+        }
+        else
+        {
+            // Update the servings in the log using the new method
+            int newServings = currentServings - servingsToRemove;
+            foodLog.updateServingsInLog(date, arrayIndex, newServings);
+            cout << "Updated servings for " << foodName << " to " << newServings << " servings.\n";
+        }
+
+        // No need to update the food database servings - those should be independent
+        // of the log entries, as they represent the database of foods, not consumption.
+    }
+
+    void viewPerformanceStats()
+    {
+#ifdef DIETMANAGER_STATS
+        PerfStats::instance().print();
+
+        int choice;
+        cout << "\nSave statistics as JSON? (1 = Yes, 0 = No): ";
+        while (!(cin >> choice) || (choice != 0 && choice != 1))
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 1 to save, 0 to skip: ";
+        }
+        cin.ignore();
+
+        if (choice == 1)
+        {
+            string path;
+            cout << "Enter file name (default perf_stats.json): ";
+            getline(cin, path);
+            if (path.empty())
+                path = "perf_stats.json";
+            if (PerfStats::instance().writeJson(path))
+                cout << "Statistics written to " << path << "\n";
+            else
+                cout << "Could not write " << path << "\n";
+        }
+#else
+        cout << "Performance statistics are not compiled into this build (rebuild with -DDIETMANAGER_STATS).\n";
+#endif
+    }
+
+    void updateProfile()
+    {
+        userProfile.updateDailyData();
+        cout << "Profile updated successfully.\n";
+        int calorieTarget = userProfile.calculateDailyCalorieTarget();
+        cout << "Your new daily calorie target is: " << calorieTarget << " calories\n";
+    }
+
+    void changeCalorieCalculator()
+    {
+        vector<string> calculators = DietCalculatorFactory::getAvailableCalculators();
+
+        cout << "\n===== Available Calculation Methods =====\n";
+        for (int i = 0; i < calculators.size(); i++)
+        {
+            cout << i + 1 << ". " << calculators[i] << "\n";
+        }
+
+        int selection;
+        cout << "Choose a calculation method: ";
+
+        while (!(cin >> selection) || selection < 1 || selection > calculators.size())
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter a number between 1 and " << calculators.size() << ": ";
+        }
+        cin.ignore();
+
+        calculatorType = calculators[selection - 1];
+        calculator = DietCalculatorFactory::createCalculator(calculatorType);
+        userProfile.setCalculator(calculator);
+
+        cout << "Calculation method changed to: " << calculator->getName() << "\n";
+        cout << "Your daily calorie target is now: " << userProfile.calculateDailyCalorieTarget() << " calories\n";
+    }
+
+    void setDate()
+    {
+        string date;
+        cout << "Enter date (YYYY-MM-DD): ";
+        getline(cin, date);
+
+        // Validate date format using a simple regex check
+        regex datePattern(R"(\d{4}-\d{2}-\d{2})");
+        while (!regex_match(date, datePattern))
+        {
+            cout << "Invalid date format! Please use YYYY-MM-DD: ";
+            getline(cin, date);
+        }
+
+        userProfile.setDate(date);
+        userProfile.startDailyData();
+        cout << "Date set to: " << date << "\n";
+    }
+
+    // One line per nutrient: the total and, over several days, the daily average
+    void printNutrients(const Nutrients &total, size_t days)
     {
-        switch (choice)
+        TablePrinter table(cout, days > 1 ? vector<TablePrinter::Column>{{"Nutrient", 15}, {"Total", 12}, {"Per Day", 12}}
+                                          : vector<TablePrinter::Column>{{"Nutrient", 15}, {"Total", 12}});
+        table.header();
+        char text[32];
+        auto amount = [&](double value, const char *unit) {
+            auto result = to_chars(text, text + sizeof(text) - 4, Nutrients::written(static_cast<float>(value)), chars_format::fixed, 2);
+            *result.ptr++ = ' ';
+            size_t length = strlen(unit);
+            memcpy(result.ptr, unit, length);
+            return string_view(text, result.ptr + length - text);
+        };
+        for (size_t i = 0; i < Nutrients::Count; i++)
         {
-        case 0:
-            cout << "Exiting program. Goodbye!\n";
-            break;
-        case 1:
-            foodDb.addBasicFoodUI();
-            break;
-        case 2:
-            foodDb.addCompositeFoodUI();
-            break;
-        case 3:
-            viewAllFoods();
-            break;
-        case 4:
-            addFoodToLog();
-            break;
-        case 5:
-            viewFoodLog();
-            break;
-        case 6:
-            removeFoodFromLog();
-            break;
-        case 7:
-            updateProfile();
-            break;
-        case 8:
-            changeCalorieCalculator();
-            break;
-        case 9:
-            viewCalorieSummary();
-            break;
-        case 10:
-            setDate();
-            break;
-        case 11:
-            if (foodLog.canUndo())
-            {
-                foodLog.undo();
-                cout << "Last action undone in Daily Food Log.\n";
-            }
-            else if (foodDb.canUndo())
+            table.cell(Nutrients::names[i]);
+            table.cell(amount(total[i], Nutrients::units[i]));
+            if (days > 1)
             {
-                foodDb.undo();
-                cout << "Last action undone in Food Database.\n";
+                table.cell(amount(total[i] / days, Nutrients::units[i]));
             }
-            else
+            table.endRow();
+        }
+    }
+
+    // Asks for a range of dates, defaulting to the current date, and returns it in order
+    void readDateRange(string &from, string &to)
+    {
+        regex datePattern(R"(\d{4}-\d{2}-\d{2})");
+        cout << "From date (YYYY-MM-DD, empty for the current date): ";
+        getline(cin, from);
+        while (!from.empty() && !regex_match(from, datePattern))
+        {
+            cout << "Invalid date format! Please use YYYY-MM-DD: ";
+            getline(cin, from);
+        }
+        if (from.empty())
+        {
+            from = userProfile.getDate();
+        }
+        cout << "To date (YYYY-MM-DD, empty for the same day): ";
+        getline(cin, to);
+        while (!to.empty() && !regex_match(to, datePattern))
+        {
+            cout << "Invalid date format! Please use YYYY-MM-DD: ";
+            getline(cin, to);
+        }
+        if (to.empty())
+        {
+            to = from;
+        }
+        if (to < from)
+        {
+            swap(from, to);
+        }
+    }
+
+    // Nutrient totals and daily averages over a range of dates
+    void viewNutrientSummary()
+    {
+        string from, to;
+        readDateRange(from, to);
+
+        size_t days;
+        Nutrients total = foodLog.getNutrientsBetween(from, to, days);
+        cout << "\n===== Nutrients from " << from << " to " << to << " =====\n";
+        if (days == 0)
+        {
+            cout << "No food entries in this period.\n";
+            return;
+        }
+        cout << "Days with entries: " << days << "\n";
+        printNutrients(total, days);
+    }
+
+    struct DayUse
+    {
+        int64_t servings = 0;
+        int64_t calories = 0;
+    };
+
+    // The composites using a basic food, with its servings per serving of
+    // each (nearest first), and what it made up on each day from..to that
+    // it was eaten on. Both come from maintained indexes: the catalog's
+    // composites by ingredient and the log's dates by food.
+    void whereUsed(uint32_t food, const string &name, int calories, const string &from, const string &to,
+                   vector<pair<uint32_t, int64_t>> &recipes, map<string_view, DayUse> &days)
+    {
+        PERF_SCOPE(WhereUsed);
+        TRACE_SPAN("whereUsed", "search");
+        for (uint32_t composite : foodDb.compositesUsing(food))
+        {
+            const ExpansionCache::Expansion *expansion = foodDb.expandComposite(composite);
+            int64_t servings = expansion ? expansion->servingsOf(food) : 0;
+            if (servings != 0)
             {
-                cout << "Nothing to undo.\n";
+                recipes.emplace_back(composite, servings);
             }
-            break;
+        }
 
-        case 12:
-            if (foodLog.canRedo())
+        // Under the food itself, then under each recipe saved as an
+        // ingredient of a logged composite
+        foodLog.forEachUse(name, from, to, [&](string_view date, const LogUsageIndex::Usage &usage) {
+            DayUse &day = days[date];
+            day.servings += usage.servings + usage.ingredientServings;
+            day.calories += usage.calories + usage.ingredientServings * calories;
+        });
+        for (const auto &[composite, servings] : recipes)
+        {
+            string_view recipe = foodDb.compositeName(composite);
+            if (foodDb.basicFoodId(recipe) != StringInterner::npos)
             {
-                foodLog.redo();
-                cout << "Last action redone in Daily Food Log.\n";
+                continue; // a saved ingredient of this name is the basic food
             }
-            else if (foodDb.canRedo())
+            foodLog.forEachUse(recipe, from, to, [&](string_view date, const LogUsageIndex::Usage &usage) {
+                if (usage.ingredientServings != 0)
+                {
+                    DayUse &day = days[date];
+                    day.servings += usage.ingredientServings * servings;
+                    day.calories += usage.ingredientServings * servings * calories;
+                }
+            });
+        }
+    }
+
+    // Recipes that use a basic food, at any depth, and the days over a range
+    // of dates it was eaten on, with the servings and calories it made up
+    void findWhereUsed()
+    {
+        string name;
+        cout << "Enter basic food name: ";
+        getline(cin, name);
+        transform(name.begin(), name.end(), name.begin(), ::tolower);
+        uint32_t food = foodDb.basicFoodId(name);
+        string matchedName;
+        int calories = 0;
+        if (food == StringInterner::npos || !foodDb.findFood(name, matchedName, calories))
+        {
+            cout << "Basic food not found!\n";
+            return;
+        }
+        string from, to;
+        readDateRange(from, to);
+
+        vector<pair<uint32_t, int64_t>> recipes;
+        map<string_view, DayUse> days;
+        whereUsed(food, matchedName, calories, from, to, recipes, days);
+
+        if (recipes.empty())
+        {
+            cout << "\nNo composite food uses " << matchedName << ".\n";
+        }
+        else
+        {
+            TablePrinter table(cout, {{"Composite Food", 20}, {"Servings per Serving", 20}});
+            for (const auto &recipe : recipes)
             {
-                foodDb.redo();
-                cout << "Last action redone in Food Database.\n";
+                table.widen(0, foodDb.compositeName(recipe.first).size());
             }
-            else
+            table.title("Composite Foods Using " + matchedName);
+            table.header();
+            for (const auto &[composite, servings] : recipes)
             {
-                cout << "Nothing to redo.\n";
+                table.cell(foodDb.compositeName(composite));
+                table.cell(servings);
+                table.endRow();
             }
-            break;
-        case 13:
-            foodDb.saveDatabase();
-            cout << "Database saved successfully.\n";
-            break;
-        default:
-            cout << "Invalid choice! Try again.\n";
+            table.flush();
+        }
+
+        if (days.empty())
+        {
+            cout << "\nNo logged food contains " << matchedName << " from " << from << " to " << to << "\n";
+            return;
+        }
+        TablePrinter table(cout, {{"Date", 12}, {"Servings", 10}, {"Calories", 10}});
+        int64_t totalServings = 0;
+        int64_t totalCalories = 0;
+        table.title("Days With " + matchedName + " from " + from + " to " + to);
+        table.header();
+        for (const auto &[date, day] : days)
+        {
+            table.cell(date);
+            table.cell(day.servings);
+            table.cell(day.calories);
+            table.endRow();
+            totalServings += day.servings;
+            totalCalories += day.calories;
         }
+        table.rule();
+        table.line("Total over " + to_string(days.size()) + (days.size() == 1 ? " day: " : " days: ") + to_string(totalServings) +
+                   " servings, " + to_string(totalCalories) + " calories");
     }
 
-    void viewAllFoods()
+    void viewCalorieSummary()
 {
-    json allFoods = foodDb.getAllFoods();
+    string date = userProfile.getDate();
+    int targetCalories = userProfile.calculateDailyCalorieTarget();
+    int consumedCalories = foodLog.getDailyCalories(date);
+    int difference = consumedCalories - targetCalories;
 
-    cout << "\n===== Basic Foods =====\n";
-    cout << left << setw(20) << "Name" << setw(40) << "Keywords" << setw(10) << "Calories" << "\n";
-    cout << string(70, '-') << "\n";
+    cout << "\n===== Calorie Summary for " << date << " =====\n";
+    cout << left << setw(25) << "Target Calorie Intake" << ": " << targetCalories << " calories\n";
+    cout << left << setw(25) << "Total Calories Consumed" << ": " << consumedCalories << " calories\n";
+    cout << left << setw(25) << "Difference" << ": " << difference << " calories\n";
 
-    for (auto &[name, details] : allFoods["basic"].items())
+    if (difference < 0)
     {
-        cout << left << setw(20) << name;
-
-        string keywords;
-        for (auto &keyword : details["keywords"])
-        {
-            keywords += keyword.get<string>() + ", ";
-        }
-        if (!keywords.empty())
-            keywords.pop_back(), keywords.pop_back(); // Remove trailing ", "
-
-        cout << setw(40) << keywords;
-        cout << setw(10) << details["calories"] << "\n";
+        cout << "You have " << -difference << " calories available for the day.\n";
+    }
+    else if (difference > 0)
+    {
+        cout << "You have consumed " << difference << " calories over your target.\n";
+    }
+    else
+    {
+        cout << "You have exactly met your calorie target for the day.\n";
     }
 
-    cout << "\n===== Composite Foods =====\n";
-    cout << left << setw(20) << "Name" << setw(40) << "Keywords" << setw(10) << "Calories" << "\n";
-    cout << string(70, '-') << "\n";
-
-    for (auto &[name, details] : allFoods["composite"].items())
+    Nutrients nutrients = foodLog.getDailyNutrients(date);
+    if (!nutrients.empty())
     {
-        cout << left << setw(20) << name;
+        cout << "\nNutrients consumed:\n";
+        printNutrients(nutrients, 1);
+    }
 
-        string keywords;
-        for (auto &keyword : details["keywords"])
-        {
-            keywords += keyword.get<string>() + ", ";
-        }
-        if (!keywords.empty())
-            keywords.pop_back(), keywords.pop_back(); // Remove trailing ", "
+    // Additional calculation method information
+    cout << "\nCalorie calculation method: " << calculator->getName() << "\n";
 
-        cout << setw(40) << keywords;
-        cout << setw(10) << details["calories"] << "\n";
-    }
+    // Display basic profile info
+    UserProfile::DailyData profileData = userProfile.getDailyData();
+    cout << "\nCurrent profile settings:\n";
+    cout << left << setw(20) << "Gender" << ": " << profileData.gender << "\n";
+    cout << left << setw(20) << "Height" << ": " << profileData.height << " cm\n";
+    cout << left << setw(20) << "Age" << ": " << profileData.age << " years\n";
+    cout << left << setw(20) << "Weight" << ": " << profileData.weight << " kg\n";
+    cout << left << setw(20) << "Activity Level" << ": " << profileData.activityLevel << "\n";
 }
 
-    void addFoodToLog()
+    // Lists the foods a serving of which still fits in today's calorie budget,
+    // the most filling first, with how many servings would fit
+    void findFoodsThatFit()
     {
-        int selectionMethod;
-        cout << "Select food by:\n";
-        cout << "1. View all foods\n";
-        cout << "2. Search by keywords\n";
-        cout << "Enter choice: ";
-
-        while (!(cin >> selectionMethod) || (selectionMethod != 1 && selectionMethod != 2))
+        const size_t PageSize = 10;
+        string date = userProfile.getDate();
+        int remaining = userProfile.calculateDailyCalorieTarget() - foodLog.getDailyCalories(date);
+        if (remaining <= 0)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter 1 or 2: ";
+            cout << "No calories remain for " << date << ".\n";
+            return;
         }
-        cin.ignore();
 
-        json selectedFoods;
+        string keyword;
+        cout << "You have " << remaining << " calories available for " << date << ".\n";
+        cout << "Only foods with keyword (empty for any): ";
+        getline(cin, keyword);
 
-        if (selectionMethod == 1)
-        {
-            // Show all foods
-            selectedFoods = foodDb.getAllFoods();
-        }
-        else
+        size_t shown = 0, totalMatches = 0;
+        while (true)
         {
-            // Search by keywords
-            int keywordCount;
-            cout << "Enter number of keywords to search: ";
-            while (!(cin >> keywordCount) || keywordCount <= 0)
+            vector<FoodDatabase::SearchHit> page = foodDb.foodsWithin(remaining, keyword, shown, PageSize, totalMatches);
+            if (totalMatches == 0)
             {
-                cin.clear();
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Enter a positive number: ";
+                cout << "No foods fit in " << remaining << " calories.\n";
+                return;
             }
-            cin.ignore();
 
-            vector<string> keywords(keywordCount);
-            for (int i = 0; i < keywordCount; ++i)
+            cout << "\nFoods that fit (" << shown + 1 << "-" << shown + page.size() << " of " << totalMatches << "):\n";
+            cout << left << setw(6) << "#" << setw(30) << "Name" << setw(10) << "Calories" << "Servings that fit\n";
+            cout << string(64, '-') << "\n";
+            for (const auto &hit : page)
             {
-                cout << "Enter keyword " << i + 1 << ": ";
-                getline(cin, keywords[i]);
+                shown++;
+                cout << left << setw(6) << shown << setw(30) << foodDb.nameOf(hit) << setw(10) << hit.calories;
+                if (hit.calories == 0)
+                    cout << "any\n";
+                else
+                    cout << remaining / hit.calories << "\n";
+            }
+            if (shown >= totalMatches)
+            {
+                return;
             }
 
-            int matchOption;
-            cout << "Match:\n";
-            cout << "1. All keywords\n";
-            cout << "2. Any keyword\n";
-            cout << "Enter choice: ";
-
-            while (!(cin >> matchOption) || (matchOption != 1 && matchOption != 2))
+            int more;
+            cout << "\nShow more? (1 = Yes, 0 = No): ";
+            while (!(cin >> more) || (more != 0 && more != 1))
             {
                 cin.clear();
                 cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                cout << "Invalid input! Enter 1 or 2: ";
+                cout << "Invalid input! Enter 1 or 0: ";
             }
             cin.ignore();
-
-            bool matchAll = (matchOption == 1);
-            selectedFoods = foodDb.searchFood(keywords, matchAll);
+            if (more == 0)
+            {
+                return;
+            }
         }
+    }
 
-        // Display search results
-        int totalCount = selectedFoods["basic"].size() + selectedFoods["composite"].size();
-        if (totalCount == 0)
+    // Runs a filter query (see FoodQuery) and pages through the foods it selects
+    void queryFoods()
+    {
+        const size_t PageSize = 10;
+        string text, error;
+        FoodQuery query;
+        cout << "Enter a query, for example: calories < 200 AND keyword:fruit AND NOT keyword:sweet\n";
+        cout << "Query (empty to cancel): ";
+        while (getline(cin, text) && !text.empty() && !FoodQuery::compile(text, query, error))
+        {
+            cout << "Invalid query: " << error << "\n";
+            cout << "Query (empty to cancel): ";
+        }
+        if (text.empty())
         {
-            cout << "No foods found matching your criteria.\n";
             return;
         }
 
-        cout << "\nSearch Results:\n";
-
-        // Display basic foods
-        int index = 1;
-        map<int, pair<string, string>> indexMap; // Maps index to {category, name}
+        FoodDatabase::Selection selection = foodDb.selectFoods(query);
+        if (selection.count == 0)
+        {
+            cout << "No foods match the query.\n";
+            return;
+        }
 
-        if (!selectedFoods["basic"].empty())
+        size_t shown = 0;
+        while (true)
         {
-            cout << "\n--- Basic Foods ---\n";
-            for (auto &[name, details] : selectedFoods["basic"].items())
+            vector<FoodDatabase::SearchHit> page = foodDb.nextPage(selection, PageSize);
+            cout << "\nQuery Results (" << shown + 1 << "-" << shown + page.size() << " of " << selection.count << "):\n";
+            for (const auto &hit : page)
             {
-                cout << index << ". " << name << " (" << details["calories"] << " calories per serving)\n";
-                indexMap[index] = {"basic", name};
-                index++;
+                shown++;
+                cout << shown << ". " << foodDb.nameOf(hit) << " (" << hit.calories << " calories per serving"
+                     << (hit.composite ? ", composite" : "") << ")\n";
+            }
+            if (shown >= selection.count)
+            {
+                return;
+            }
+
+            int more;
+            cout << "\nShow more? (1 = Yes, 0 = No): ";
+            while (!(cin >> more) || (more != 0 && more != 1))
+            {
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                cout << "Invalid input! Enter 1 or 0: ";
+            }
+            cin.ignore();
+            if (more == 0)
+            {
+                return;
             }
         }
+    }
 
-        // Display composite foods
-        if (!selectedFoods["composite"].empty())
+    static vector<string> readTermList(const string &prompt)
+    {
+        string line, term;
+        cout << prompt;
+        getline(cin, line);
+        vector<string> terms;
+        stringstream stream(line);
+        while (getline(stream, term, ','))
         {
-            cout << "\n--- Composite Foods ---\n";
-            for (auto &[name, details] : selectedFoods["composite"].items())
+            term.erase(0, term.find_first_not_of(" \t"));
+            term.erase(term.find_last_not_of(" \t") + 1);
+            if (!term.empty())
             {
-                cout << index << ". " << name << " (" << details["calories"] << " calories per serving)\n";
-                indexMap[index] = {"composite", name};
-                index++;
+                terms.push_back(term);
             }
         }
+        return terms;
+    }
 
-        // Let user select a food
-        int selectedIndex;
-        cout << "\nSelect a food (enter index): ";
+    // Proposes servings of catalog foods that add up to the calories left for
+    // the day, split into meals, and logs them as one action if accepted
+    void planDay()
+    {
+        string date = userProfile.getDate();
+        int target = userProfile.calculateDailyCalorieTarget();
+        int remaining = target - foodLog.getDailyCalories(date);
+        if (remaining <= 0)
+        {
+            cout << "No calories remain for " << date << ".\n";
+            return;
+        }
+        cout << "Planning " << remaining << " of your " << target << " calories for " << date << ".\n";
 
-        while (!(cin >> selectedIndex) || selectedIndex < 1 || selectedIndex >= index)
+        vector<string> include = readTermList("Only foods with keywords (comma separated, empty for any): ");
+        vector<string> exclude = readTermList("Leave out foods with keywords (comma separated, empty for none): ");
+
+        int maxServings, tolerance;
+        cout << "Maximum servings of any one food: ";
+        while (!(cin >> maxServings) || maxServings <= 0)
         {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a number between 1 and " << (index - 1) << ": ";
+            cout << "Invalid input! Enter a positive number: ";
         }
+        cout << "Allowed difference from the target in calories: ";
+        while (!(cin >> tolerance) || tolerance < 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cout << "Invalid input! Enter 0 or a positive number: ";
+        }
+        cin.ignore();
 
-        auto [category, name] = indexMap[selectedIndex];
-        json selectedFood = selectedFoods[category][name];
+        MealPlanner::Plan plan;
+        {
+            PERF_SCOPE(MealPlan);
+            TRACE_SPAN("planDay", "search");
+            plan = MealPlanner::solve(foodDb.planCandidates(include, exclude, foodLog.foodFrequencies()), remaining,
+                                      tolerance, maxServings);
+        }
+        if (!plan.found)
+        {
+            cout << "No combination of the chosen foods comes within " << tolerance << " calories of " << remaining
+                 << ". Allow more servings, a larger difference or more foods.\n";
+            return;
+        }
 
-        // Get number of servings
-        int servings;
-        cout << "Enter number of servings: ";
+        static const char *mealNames[] = {"Breakfast", "Lunch", "Dinner", "Snacks"};
+        vector<vector<MealPlanner::Portion>> meals = MealPlanner::splitIntoMeals(plan, {0.25, 0.35, 0.30, 0.10});
+        cout << "\n===== Meal Plan for " << date << " =====\n";
+        for (size_t m = 0; m < meals.size(); m++)
+        {
+            if (meals[m].empty())
+                continue;
+            cout << "\n--- " << mealNames[m] << " ---\n";
+            for (const auto &portion : meals[m])
+            {
+                cout << left << setw(30) << foodDb.nameOf(portion) << setw(4) << portion.servings << "x " << setw(6)
+                     << portion.calories << "= " << portion.calories * portion.servings << " calories\n";
+            }
+        }
+        cout << "\nTotal: " << plan.calories << " calories (" << showpos << plan.calories - remaining << noshowpos
+             << " from the target)\n";
 
-        while (!(cin >> servings) || servings <= 0)
+        int choice;
+        cout << "Log this plan for " << date << "? (1 = Yes, 0 = No): ";
+        while (!(cin >> choice) || (choice != 0 && choice != 1))
         {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
+            cout << "Invalid input! Enter 1 or 0: ";
         }
         cin.ignore();
-
-        // Add food to log
-        string date = userProfile.getDate();
-        foodLog.addFoodToLog(date, name, servings, selectedFood);
-
-        cout << "Added " << servings << " serving(s) of " << name << " to your log for " << date << "\n";
-    }
-
-    void viewFoodLog()
-    {
-        string date = userProfile.getDate();
-        json dailyLog = foodLog.viewDailyLog(date);
-    
-        if (dailyLog.is_null() || dailyLog.empty())
+        if (choice == 0)
         {
-            cout << "No food entries for " << date << "\n";
+            cout << "Plan discarded.\n";
             return;
         }
-    
-        cout << "\n===== Food Log for " << date << " =====\n";
-        cout << left << setw(5) << "No." << setw(20) << "Food Name" << setw(10) << "Servings" << setw(15) << "Calories/Serving" << setw(15) << "Total Calories" << "\n";
-        cout << string(70, '-') << "\n";
-    
-        int totalCalories = 0;
-        int index = 1;
-        for (const auto &entry : dailyLog)
+
+        Transaction<DailyFoodLog> day(foodLog);
+        for (const auto &portion : plan.portions)
         {
-            string foodName = entry["name"];
-            int servings = entry["servings"];
-            int calories = entry["details"]["calories"];
-            int entryCalories = servings * calories;
-    
-            cout << left << setw(5) << index
-                 << setw(20) << foodName
-                 << setw(10) << servings
-                 << setw(15) << calories
-                 << setw(15) << entryCalories << "\n";
-    
-            totalCalories += entryCalories;
-            index++;
+            string name(foodDb.nameOf(portion));
+            foodLog.addFoodToLog(date, name, portion.servings, foodDb.getFood(name, portion.composite));
         }
-    
-        cout << string(70, '-') << "\n";
-        cout << "Total Calories: " << totalCalories << "\n";
+        day.commit();
+        cout << "Plan logged for " << date << ". Undo removes it as a whole.\n";
     }
-    void removeFoodFromLog()
-    {
-        string date = userProfile.getDate();
-        json dailyLog = foodLog.viewDailyLog(date);
+};
 
-        if (dailyLog.is_null() || dailyLog.empty())
+// Compares the nlohmann stream parser with FastJson on the given files
+int runIngestBenchmark(const vector<string> &files)
+{
+    auto bestOf = [](int runs, const function<void()> &body) {
+        double best = numeric_limits<double>::max();
+        for (int i = 0; i < runs; i++)
         {
-            cout << "No food entries for " << date << "\n";
-            return;
+            auto start = chrono::steady_clock::now();
+            body();
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
         }
+        return best;
+    };
 
-        // Display the food log with numbers
-        cout << "\n===== Food Log for " << date << " =====\n";
-        for (int i = 0; i < dailyLog.size(); i++)
+    cout << left << setw(32) << "File" << right << setw(10) << "MB" << setw(14) << "nlohmann MB/s"
+         << setw(14) << "fast MB/s" << setw(10) << "speedup" << setw(8) << "same" << "\n";
+    cout << string(88, '-') << "\n";
+    StreamFormatGuard format(cout);
+    cout << fixed << setprecision(1);
+
+    for (const auto &path : files)
+    {
+        FastJson::Buffer probe;
+        if (!FastJson::readFile(path, probe))
         {
-            string foodName = dailyLog[i]["name"];
-            int servings = dailyLog[i]["servings"];
-            cout << (i + 1) << ". " << foodName << " (" << servings << " servings)\n";
+            cerr << "Cannot read " << path << "\n";
+            return 1;
         }
-
-        // Ask for selection
-        int selection;
-        cout << "\nSelect entry to remove (enter number): ";
-        while (!(cin >> selection) || selection < 1 || selection > dailyLog.size())
+        double megabytes = probe.length / 1e6;
+        int runs = probe.length > 100000000 ? 1 : 3;
+
+        // Full DOM both ways, the way loadLog and loadProfile used to work
+        json viaStream, viaFast;
+        double streamSeconds = bestOf(runs, [&]() {
+            ifstream file(path);
+            viaStream = json();
+            file >> viaStream;
+        });
+        string error;
+        double fastSeconds = bestOf(runs, [&]() {
+            FastJson::Buffer buffer;
+            FastJson::readFile(path, buffer);
+            viaFast = json();
+            JsonDomBuilder builder(viaFast);
+            error.clear();
+            FastJson::parse(buffer, builder, error);
+        });
+        if (!error.empty())
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a number between 1 and " << dailyLog.size() << ": ";
+            cerr << path << ": " << error << "\n";
+            return 1;
         }
-        cin.ignore();
 
-        // Convert to zero-based index
-        int arrayIndex = selection - 1;
+        cout << left << setw(32) << path.substr(path.size() > 31 ? path.size() - 31 : 0) << right
+             << setw(10) << megabytes << setw(14) << megabytes / streamSeconds << setw(14) << megabytes / fastSeconds
+             << setw(9) << streamSeconds / fastSeconds << "x" << setw(8) << (viaStream == viaFast ? "yes" : "NO") << "\n";
 
-        // Get the selected food entry
-        string foodName = dailyLog[arrayIndex]["name"];
-        int currentServings = dailyLog[arrayIndex]["servings"];
+        // Catalogs also go through the typed loader both ways
+        if (viaFast.is_object() && viaFast.contains("basic"))
+        {
+            size_t streamRecords = 0, fastRecords = 0;
+            auto ignore = [](const FoodRecord &) {};
+            double saxSeconds = bestOf(runs, [&]() {
+                StringInterner strings;
+                FoodRecordSax handler(strings, ignore);
+                ifstream file(path);
+                json::sax_parse(file, &handler);
+                streamRecords = handler.recordCount;
+            });
+            double fastSaxSeconds = bestOf(runs, [&]() {
+                StringInterner strings;
+                FoodRecordSax handler(strings, ignore);
+                FastJson::Buffer buffer;
+                FastJson::readFile(path, buffer);
+                string ignored;
+                FastJson::parse(buffer, handler, ignored);
+                fastRecords = handler.recordCount;
+            });
+            cout << left << setw(32) << "  (typed FoodRecord load)" << right << setw(10) << megabytes
+                 << setw(14) << megabytes / saxSeconds << setw(14) << megabytes / fastSaxSeconds
+                 << setw(9) << saxSeconds / fastSaxSeconds << "x" << setw(8) << (streamRecords == fastRecords ? "yes" : "NO") << "\n";
+        }
 
-        // Ask for the number of servings to remove
-        int servingsToRemove;
-        cout << "Enter the number of servings to remove: ";
-        while (!(cin >> servingsToRemove) || servingsToRemove <= 0)
+        // Logs load into the typed, pool-backed store; "same" checks it writes the file back unchanged
+        bool isLog = viaFast.is_object() && !viaFast.contains("basic") && !viaFast.contains("gender");
+        if (isLog)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a positive number: ";
+            string streamText, fastText;
+            double saxSeconds = bestOf(runs, [&]() {
+                StringInterner strings;
+                FoodLogStore store(strings);
+                FoodLogSax handler(store);
+                ifstream file(path);
+                json::sax_parse(file, &handler);
+                streamText.clear();
+                store.write(streamText);
+            });
+            double fastSaxSeconds = bestOf(runs, [&]() {
+                StringInterner strings;
+                FoodLogStore store(strings);
+                FoodLogSax handler(store);
+                FastJson::Buffer buffer;
+                FastJson::readFile(path, buffer);
+                string ignored;
+                FastJson::parse(buffer, handler, ignored);
+                fastText.clear();
+                store.write(fastText);
+            });
+            cout << left << setw(32) << "  (typed log load + write)" << right << setw(10) << megabytes
+                 << setw(14) << megabytes / saxSeconds << setw(14) << megabytes / fastSaxSeconds
+                 << setw(9) << saxSeconds / fastSaxSeconds << "x" << setw(8) << (streamText == fastText && fastText == viaFast.dump(4) ? "yes" : "NO") << "\n";
         }
-        cin.ignore();
 
-        // Check if the servings to remove exceed the current servings
-        if (servingsToRemove > currentServings)
+#ifdef DIETMANAGER_STATS
+        // Heap allocations for one load and teardown, DOM against the typed in-memory model
+        auto allocationsDuring = [](const function<void()> &body) {
+            uint64_t before = threadAllocations.calls;
+            body();
+            return threadAllocations.calls - before;
+        };
+        uint64_t domAllocations = allocationsDuring([&]() {
+            FastJson::Buffer buffer;
+            FastJson::readFile(path, buffer);
+            json document;
+            JsonDomBuilder builder(document);
+            FastJson::parse(buffer, builder, error);
+        });
+        optional<uint64_t> typedAllocations;
+        if (viaFast.is_object() && viaFast.contains("basic"))
         {
-            cout << "Error: Cannot remove more servings than currently present (" << currentServings << " servings).\n";
-            return;
+            typedAllocations = allocationsDuring([&]() {
+                StringInterner strings;
+                FoodDatabase catalog(path, strings);
+            });
+        }
+        else if (isLog)
+        {
+            typedAllocations = allocationsDuring([&]() {
+                StringInterner strings;
+                FoodLogStore store(strings);
+                FoodLogSax handler(store);
+                FastJson::Buffer buffer;
+                FastJson::readFile(path, buffer);
+                FastJson::parse(buffer, handler, error);
+            });
         }
+        if (typedAllocations)
+        {
+            cout << left << setw(32) << "  (heap allocations)" << right << setw(24) << domAllocations
+                 << setw(14) << *typedAllocations << setw(9) << double(domAllocations) / max<uint64_t>(1, *typedAllocations)
+                 << "x" << "\n";
+        }
+#endif
+    }
+    return 0;
+}
 
-        // Update the servings in the log
-        if (servingsToRemove == currentServings)
+// Exports food logs to the columnar format. Arguments: OUT [--from DATE]
+// [--to DATE] [LOG...]; each log file is a tenant, daily_food_log.json by default.
+// Each tenant's log is loaded whole before its rows are exported, so memory
+// grows with the largest single log, not with the whole export.
+int runLogExport(const vector<string> &args)
+{
+    string from, to;
+    vector<string> logs;
+    for (size_t i = 1; i < args.size(); i++)
+    {
+        if ((args[i] == "--from" || args[i] == "--to") && i + 1 < args.size())
         {
-            // Remove the entry completely if all servings are removed
-            foodLog.removeFoodFromLogByIndex(date, arrayIndex);
-            cout << "Entry removed successfully.\n";
+            (args[i] == "--from" ? from : to) = args[i + 1];
+            i++;
         }
         else
         {
-            // Update the servings in the log using the new method
-            int newServings = currentServings - servingsToRemove;
-            foodLog.updateServingsInLog(date, arrayIndex, newServings);
-            cout << "Updated servings for " << foodName << " to " << newServings << " servings.\n";
+            logs.push_back(args[i]);
         }
-
-        // No need to update the food database servings - those should be independent
-        // of the log entries, as they represent the database of foods, not consumption.
     }
-
-    void updateProfile()
+    if (logs.empty())
     {
-        userProfile.updateDailyData();
-        cout << "Profile updated successfully.\n";
-        int calorieTarget = userProfile.calculateDailyCalorieTarget();
-        cout << "Your new daily calorie target is: " << calorieTarget << " calories\n";
+        logs.push_back("daily_food_log.json");
     }
-
-    void changeCalorieCalculator()
+    for (const string *bound : {&from, &to})
     {
-        vector<string> calculators = DietCalculatorFactory::getAvailableCalculators();
-
-        cout << "\n===== Available Calculation Methods =====\n";
-        for (int i = 0; i < calculators.size(); i++)
+        if (!bound->empty() && !FoodLogStore::isDate(*bound))
         {
-            cout << i + 1 << ". " << calculators[i] << "\n";
+            cerr << "'" << *bound << "' is not a date (YYYY-MM-DD)\n";
+            return 1;
         }
+    }
+    if (!from.empty() && !to.empty() && from > to)
+    {
+        cerr << "--from " << from << " is after --to " << to << "\n";
+        return 1;
+    }
 
-        int selection;
-        cout << "Choose a calculation method: ";
-
-        while (!(cin >> selection) || selection < 1 || selection > calculators.size())
+    auto start = chrono::steady_clock::now();
+    LogExporter exporter(args[0]);
+    if (!exporter.isOpen())
+    {
+        cerr << "Cannot create " << args[0] << "\n";
+        return 1;
+    }
+    bool written = true;
+    for (const string &log : logs)
+    {
+        // One tenant in memory at a time, strings included
+        StringInterner strings;
+        FoodLogStore store(strings);
+        try
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Invalid input! Enter a number between 1 and " << calculators.size() << ": ";
+            if (!DailyFoodLog::readLog(log, store))
+            {
+                cerr << "Cannot read " << log << "\n";
+                return 1;
+            }
         }
-        cin.ignore();
+        catch (const exception &e)
+        {
+            cerr << e.what() << "\n";
+            return 1;
+        }
+        written = exporter.addTenant(log, store, from, to) && written;
+    }
+    written = exporter.finish() && written;
+    if (!written)
+    {
+        cerr << "Could not write " << args[0] << "\n";
+        return 1;
+    }
 
-        calculatorType = calculators[selection - 1];
-        calculator = DietCalculatorFactory::createCalculator(calculatorType);
-        userProfile.setCalculator(calculator);
+    const LogExporter::Result &result = exporter.result();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    StreamFormatGuard format(cout);
+    cout << "Exported " << result.rows << " entries from " << logs.size() << " log(s) in " << result.rowGroups
+         << " row group(s), " << result.dictionarySize << " dictionary strings, " << result.bytes << " bytes in "
+         << fixed << setprecision(2) << seconds << " s\n";
+    return 0;
+}
 
-        cout << "Calculation method changed to: " << calculator->getName() << "\n";
-        cout << "Your daily calorie target is now: " << userProfile.calculateDailyCalorieTarget() << " calories\n";
+// Converts a food log between JSON and the binary encoding, picked by the
+// file extensions, and reports the sizes and times of both forms
+int runLogConversion(const string &from, const string &to)
+{
+    using Clock = chrono::steady_clock;
+    auto seconds = [](Clock::time_point start) { return chrono::duration<double>(Clock::now() - start).count(); };
+
+    StringInterner strings;
+    FoodLogStore store(strings);
+    auto start = Clock::now();
+    try
+    {
+        if (!DailyFoodLog::readLog(from, store))
+        {
+            cerr << "Cannot read " << from << "\n";
+            return 1;
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    double loadSeconds = seconds(start);
+
+    string text;
+    start = Clock::now();
+    DailyFoodLog::encodeLog(to, store, text);
+    double encodeSeconds = seconds(start);
+    ofstream out(to, ios::binary | ios::trunc);
+    if (!out.write(text.data(), static_cast<streamsize>(text.size())))
+    {
+        cerr << "Cannot write " << to << "\n";
+        return 1;
     }
+    out.close();
 
-    void setDate()
+    // Reads the result back; a conversion that changes the log is an error
+    StringInterner checkStrings;
+    FoodLogStore check(checkStrings);
+    string expected, actual;
+    try
     {
-        string date;
-        cout << "Enter date (YYYY-MM-DD): ";
-        getline(cin, date);
+        DailyFoodLog::readLog(to, check);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
+    }
+    store.write(expected);
+    check.write(actual);
+    if (expected != actual)
+    {
+        cerr << to << " does not read back as the log in " << from << "\n";
+        return 1;
+    }
 
-        // Validate date format using a simple regex check
-        regex datePattern(R"(\d{4}-\d{2}-\d{2})");
-        while (!regex_match(date, datePattern))
+    ifstream in(from, ios::binary | ios::ate);
+    double fromBytes = static_cast<double>(in.tellg());
+    StreamFormatGuard format(cout);
+    cout << fixed << setprecision(3)
+         << from << ": " << static_cast<uint64_t>(fromBytes) << " bytes, loaded in " << loadSeconds << " s\n"
+         << to << ": " << text.size() << " bytes, encoded in " << encodeSeconds << " s\n"
+         << setprecision(1) << "Size ratio: " << fromBytes / max<size_t>(1, text.size()) << "x\n";
+    return 0;
+}
+
+// Loads the catalog and a log twice, first each with its own interner and
+// then sharing one, and reports the memory their strings take either way
+int runMemoryReport(const string &catalogPath, const string &logPath)
+{
+    struct Footprint
+    {
+        size_t strings = 0;
+        size_t bytes = 0;
+    };
+    StringReferences references;
+    Footprint separate, shared;
+    try
+    {
         {
-            cout << "Invalid date format! Please use YYYY-MM-DD: ";
-            getline(cin, date);
+            StringInterner catalogStrings, logStrings;
+            FoodDatabase catalog(catalogPath, catalogStrings);
+            FoodLogStore log(logStrings);
+            DailyFoodLog::readLog(logPath, log);
+            catalog.countStringReferences(references);
+            log.countStringReferences(references);
+            separate = {catalogStrings.size() + logStrings.size(), catalogStrings.footprint() + logStrings.footprint()};
         }
-
-        userProfile.setDate(date);
-        cout << "Date set to: " << date << "\n";
+        {
+            StringInterner strings;
+            FoodDatabase catalog(catalogPath, strings);
+            FoodLogStore log(strings);
+            DailyFoodLog::readLog(logPath, log);
+            shared = {strings.size(), strings.footprint()};
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << "\n";
+        return 1;
     }
 
-    void viewCalorieSummary()
+    // References cost a 32-bit ID each once strings are interned
+    size_t idBytes = references.count * sizeof(uint32_t);
+    cout << "String references in " << catalogPath << " and " << logPath << ": " << references.count << "\n\n";
+    cout << left << setw(34) << "" << right << setw(12) << "strings" << setw(16) << "bytes" << "\n";
+    cout << string(62, '-') << "\n";
+    cout << left << setw(34) << "a std::string per reference" << right << setw(12) << references.count
+         << setw(16) << references.unsharedBytes << "\n";
+    cout << left << setw(34) << "interner per store (before)" << right << setw(12) << separate.strings
+         << setw(16) << separate.bytes + idBytes << "\n";
+    cout << left << setw(34) << "one shared interner (after)" << right << setw(12) << shared.strings
+         << setw(16) << shared.bytes + idBytes << "\n";
+    return 0;
+}
+
+// Times the meal planner's solve on synthetic catalogs of growing size, then
+// the whole plan (candidate scan and solve) on any food databases given
+int runPlannerBenchmark(const vector<string> &files)
 {
-    string date = userProfile.getDate();
-    int targetCalories = userProfile.calculateDailyCalorieTarget();
-    int consumedCalories = foodLog.getDailyCalories(date);
-    int difference = consumedCalories - targetCalories;
+    const int Target = 2000, Tolerance = 10, MaxServings = 3, Runs = 5;
+    auto bestOf = [](int runs, const function<void()> &body) {
+        double best = numeric_limits<double>::max();
+        for (int i = 0; i < runs; i++)
+        {
+            auto start = chrono::steady_clock::now();
+            body();
+            best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+    auto printRow = [](const string &label, size_t foods, const MealPlanner::Plan &plan, double seconds) {
+        cout << left << setw(32) << label << right << setw(10) << foods << setw(10) << plan.candidates << setw(10)
+             << plan.pieces << setw(10) << (plan.found ? to_string(plan.calories) : "-") << setw(12) << seconds * 1000 << "\n";
+    };
+
+    cout << "Target " << Target << " +/- " << Tolerance << " calories, at most " << MaxServings << " servings per food\n\n";
+    cout << left << setw(32) << "Catalog" << right << setw(10) << "foods" << setw(10) << "kept" << setw(10) << "pieces"
+         << setw(10) << "calories" << setw(12) << "ms" << "\n";
+    cout << string(84, '-') << "\n";
+    StreamFormatGuard format(cout);
+    cout << fixed << setprecision(3);
+
+    // Calories skewed towards small servings, a few foods logged often
+    mt19937 random(42);
+    for (size_t size : {1000, 10000, 100000, 1000000})
+    {
+        vector<MealPlanner::Candidate> candidates(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            int calories = 1 + static_cast<int>(900 * pow(uniform_real_distribution<double>(0, 1)(random), 2));
+            uint32_t frequency = random() % 10 == 0 ? random() % 50 : 0;
+            candidates[i] = {static_cast<uint32_t>(i), false, calories, frequency};
+        }
+        MealPlanner::Plan plan;
+        double seconds = bestOf(Runs, [&]() { plan = MealPlanner::solve(candidates, Target, Tolerance, MaxServings); });
+        printRow("synthetic", size, plan, seconds);
+    }
 
-    cout << "\n===== Calorie Summary for " << date << " =====\n";
-    cout << left << setw(25) << "Target Calorie Intake" << ": " << targetCalories << " calories\n";
-    cout << left << setw(25) << "Total Calories Consumed" << ": " << consumedCalories << " calories\n";
-    cout << left << setw(25) << "Difference" << ": " << difference << " calories\n";
+    for (const auto &path : files)
+    {
+        try
+        {
+            StringInterner strings;
+            FoodDatabase catalog(path, strings);
+            vector<MealPlanner::Candidate> candidates;
+            MealPlanner::Plan plan;
+            double seconds = bestOf(Runs, [&]() {
+                candidates = catalog.planCandidates({}, {}, {});
+                plan = MealPlanner::solve(candidates, Target, Tolerance, MaxServings);
+            });
+            printRow(path, candidates.size(), plan, seconds);
+        }
+        catch (const exception &e)
+        {
+            cerr << path << ": " << e.what() << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    if (difference < 0)
+// Prints the foods a filter query selects, one per line as name, category
+// and calories separated by tabs, a page at a time so output starts at once
+int runQuery(const string &text, const string &catalogPath)
+{
+    const size_t PageSize = 4096;
+    FoodQuery query;
+    string error;
+    if (!FoodQuery::compile(text, query, error))
     {
-        cout << "You have " << -difference << " calories available for the day.\n";
+        cerr << "Invalid query: " << error << "\n";
+        return 1;
     }
-    else if (difference > 0)
+    try
     {
-        cout << "You have consumed " << difference << " calories over your target.\n";
+        StringInterner strings;
+        FoodDatabase catalog(catalogPath, strings);
+        FoodDatabase::Selection selection = catalog.selectFoods(query);
+        for (auto page = catalog.nextPage(selection, PageSize); !page.empty(); page = catalog.nextPage(selection, PageSize))
+        {
+            for (const auto &hit : page)
+            {
+                cout << catalog.nameOf(hit) << '\t' << (hit.composite ? "composite" : "basic") << '\t' << hit.calories << '\n';
+            }
+        }
+        cerr << selection.count << (selection.count == 1 ? " food\n" : " foods\n");
     }
-    else
+    catch (const exception &e)
     {
-        cout << "You have exactly met your calorie target for the day.\n";
+        cerr << e.what() << "\n";
+        return 1;
     }
+    return 0;
+}
 
-    // Additional calculation method information
-    cout << "\nCalorie calculation method: " << calculator->getName() << "\n";
-
-    // Display basic profile info
-    json profileData = userProfile.getDailyData();
-    cout << "\nCurrent profile settings:\n";
-    cout << left << setw(20) << "Gender" << ": " << profileData["gender"].get<string>() << "\n";
-    cout << left << setw(20) << "Height" << ": " << profileData["height"].get<int>() << " cm\n";
-    cout << left << setw(20) << "Age" << ": " << profileData["age"].get<int>() << " years\n";
-    cout << left << setw(20) << "Weight" << ": " << profileData["weight"].get<int>() << " kg\n";
-    cout << left << setw(20) << "Activity Level" << ": " << profileData["activityLevel"].get<string>() << "\n";
+// Imports one file into food_db.json without starting the interactive app
+int runImport(const string &path)
+{
+    vector<ImportRow> rows;
+    ImportReport report;
+    bool readable = FoodImporter::read(path, rows, report);
+    if (readable)
+    {
+        FoodDatabase foodDb;
+        foodDb.importFoods(rows, path, report);
+        BackgroundWriter::instance().flush(true);
+    }
+    report.print(cout);
+    return readable ? 0 : 1;
 }
-};
 
 // Main function
-int main()
+int main(int argc, char *argv[])
 {
-    DietManagerApp app;
-    app.run();
-    return 0;
+    string statsFile;
+    chrono::milliseconds saveDelay(100);
+    BackgroundWriter::SyncPolicy syncPolicy = BackgroundWriter::SyncPolicy::OnExit;
+    string importFile;
+    string logFile = "daily_food_log.json";
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--stats-json" && i + 1 < argc)
+        {
+            statsFile = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            TraceRecorder::instance().start(argv[++i]);
+        }
+        else if (arg == "--save-delay" && i + 1 < argc)
+        {
+            saveDelay = chrono::milliseconds(atoi(argv[++i]));
+        }
+        else if (arg == "--fsync" && i + 1 < argc && BackgroundWriter::parsePolicy(argv[i + 1], syncPolicy))
+        {
+            i++;
+        }
+        else if (arg == "--log-format" && i + 1 < argc && (string(argv[i + 1]) == "json" || string(argv[i + 1]) == "binary"))
+        {
+            logFile = string(argv[++i]) == "binary" ? "daily_food_log.dmlog" : "daily_food_log.json";
+        }
+        else if (arg == "--memory-report")
+        {
+            bool paths = i + 2 < argc;
+            return runMemoryReport(paths ? argv[i + 1] : "food_db.json", paths ? argv[i + 2] : "daily_food_log.json");
+        }
+        else if (arg == "--convert-log" && i + 2 < argc)
+        {
+            return runLogConversion(argv[i + 1], argv[i + 2]);
+        }
+        else if (arg == "--import" && i + 1 < argc)
+        {
+            importFile = argv[++i];
+        }
+        else if (arg == "--export-log" && i + 1 < argc)
+        {
+            return runLogExport(vector<string>(argv + i + 1, argv + argc));
+        }
+        else if (arg == "--bench-ingest" && i + 1 < argc)
+        {
+            return runIngestBenchmark(vector<string>(argv + i + 1, argv + argc));
+        }
+        else if (arg == "--query" && i + 1 < argc)
+        {
+            return runQuery(argv[i + 1], i + 2 < argc ? argv[i + 2] : "food_db.json");
+        }
+        else if (arg == "--bench-planner")
+        {
+            return runPlannerBenchmark(vector<string>(argv + i + 1, argv + argc));
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--stats-json FILE] [--trace FILE] [--save-delay MS] [--fsync never|exit|always]\n"
+                 << "       " << string(strlen(argv[0]), ' ') << " [--log-format json|binary]\n"
+                 << "       " << argv[0] << " [--save-delay MS] [--fsync never|exit|always] --import FILE\n"
+                 << "       " << argv[0] << " --export-log OUT [--from DATE] [--to DATE] [LOG...]\n"
+                 << "       " << argv[0] << " --convert-log FROM TO\n"
+                 << "       " << argv[0] << " --memory-report [FOOD_DB LOG]\n"
+                 << "       " << argv[0] << " --query EXPR [FOOD_DB]\n"
+                 << "       " << argv[0] << " --bench-ingest FILE...\n"
+                 << "       " << argv[0] << " --bench-planner [FOOD_DB...]\n";
+            return 1;
+        }
+    }
+
+    BackgroundWriter::instance().configure(saveDelay, syncPolicy);
+    int status = 0;
+    if (!importFile.empty())
+    {
+        status = runImport(importFile);
+    }
+    else
+    {
+        DietManagerApp app(logFile);
+        app.run();
+    }
+    BackgroundWriter::instance().stop();
+
+    // Written after the app is destroyed so the final saves are included
+    if (!TraceRecorder::instance().flush())
+    {
+        cerr << "Could not write the trace file\n";
+    }
+
+    if (!statsFile.empty())
+    {
+#ifdef DIETMANAGER_STATS
+        if (!PerfStats::instance().writeJson(statsFile))
+        {
+            cerr << "Could not write " << statsFile << "\n";
+        }
+#else
+        cerr << "Performance statistics are not compiled into this build (rebuild with -DDIETMANAGER_STATS).\n";
+#endif
+    }
+    return status;
 }
\ No newline at end of file